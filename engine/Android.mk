@@ -6,7 +6,16 @@ LOCAL_MODULE		:= engine
 LOCAL_CFLAGS		:= -Werror -O2
 LOCAL_EXPORT_C_INCLUDES := $(LOCAL_PATH)
 LOCAL_EXPORT_LDLIBS := -llog -landroid -lGLESv2
-LOCAL_SRC_FILES	:= gui.c game.c world.c image.c gl_defs.c matrix.c vector.c quaternion.c frustum.c tex2d.c shader.c stream_android.c bbox.c resman.c material.c timestamp.c
+LOCAL_SRC_FILES	:= gui.c game.c world.c image.c gl_defs.c matrix.c affine.c vector.c quaternion.c frustum.c tex2d.c shader.c stream_android.c bbox.c hierarchy.c nodes.c bvh.c occlusion.c pvs.c impostor.c vcache.c atom.c resman.c material.c timestamp.c
+
+# The armeabi-v7a build requires NEON, the SIMD kernels are built with it
+# and called without a runtime check. armeabi gets their scalar versions.
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+LOCAL_SRC_FILES += matrix_simd.c.neon
+else
+LOCAL_SRC_FILES += matrix_simd.c
+endif
+
 LOCAL_STATIC_LIBRARIES := physics png bullet
 
 include $(BUILD_STATIC_LIBRARY)
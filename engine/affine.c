@@ -0,0 +1,126 @@
+#include "mathlib.h"
+#include "common.h"
+
+void affine_set_identity(affine_t* m)
+{
+   memset(m->m, 0, sizeof(m->m));
+   m->m11 = m->m22 = m->m33 = 1.0f;
+}
+
+void affine_from_mat4(affine_t* m, const mat4f_t* a)
+{
+   m->m11 = a->m11; m->m21 = a->m21; m->m31 = a->m31;
+   m->m12 = a->m12; m->m22 = a->m22; m->m32 = a->m32;
+   m->m13 = a->m13; m->m23 = a->m23; m->m33 = a->m33;
+   m->m14 = a->m14; m->m24 = a->m24; m->m34 = a->m34;
+}
+
+void affine_to_mat4(mat4f_t* m, const affine_t* a)
+{
+   m->m11 = a->m11; m->m21 = a->m21; m->m31 = a->m31; m->m41 = 0.0f;
+   m->m12 = a->m12; m->m22 = a->m22; m->m32 = a->m32; m->m42 = 0.0f;
+   m->m13 = a->m13; m->m23 = a->m23; m->m33 = a->m33; m->m43 = 0.0f;
+   m->m14 = a->m14; m->m24 = a->m24; m->m34 = a->m34; m->m44 = 1.0f;
+}
+
+void affine_mult(affine_t* m, const affine_t* a, const affine_t* b)
+{
+   affine_t r;
+
+   r.m11 = a->m11*b->m11 + a->m12*b->m21 + a->m13*b->m31;
+   r.m12 = a->m11*b->m12 + a->m12*b->m22 + a->m13*b->m32;
+   r.m13 = a->m11*b->m13 + a->m12*b->m23 + a->m13*b->m33;
+   r.m14 = a->m11*b->m14 + a->m12*b->m24 + a->m13*b->m34 + a->m14;
+
+   r.m21 = a->m21*b->m11 + a->m22*b->m21 + a->m23*b->m31;
+   r.m22 = a->m21*b->m12 + a->m22*b->m22 + a->m23*b->m32;
+   r.m23 = a->m21*b->m13 + a->m22*b->m23 + a->m23*b->m33;
+   r.m24 = a->m21*b->m14 + a->m22*b->m24 + a->m23*b->m34 + a->m24;
+
+   r.m31 = a->m31*b->m11 + a->m32*b->m21 + a->m33*b->m31;
+   r.m32 = a->m31*b->m12 + a->m32*b->m22 + a->m33*b->m32;
+   r.m33 = a->m31*b->m13 + a->m32*b->m23 + a->m33*b->m33;
+   r.m34 = a->m31*b->m14 + a->m32*b->m24 + a->m33*b->m34 + a->m34;
+
+   (*m) = r;
+}
+
+void affine_mult_vec3(vec3f_t* r, const affine_t* m, const vec3f_t* a)
+{
+   float x = a->x;
+   float y = a->y;
+   float z = a->z;
+
+   r->x = m->m11 * x + m->m12 * y + m->m13 * z + m->m14;
+   r->y = m->m21 * x + m->m22 * y + m->m23 * z + m->m24;
+   r->z = m->m31 * x + m->m32 * y + m->m33 * z + m->m34;
+}
+
+// cofactor matrix of the 3x3 part, returns its determinant
+static float affine_cofactors(mat3f_t* c, const affine_t* a)
+{
+   c->m11 = a->m22*a->m33 - a->m23*a->m32;
+   c->m12 = a->m23*a->m31 - a->m21*a->m33;
+   c->m13 = a->m21*a->m32 - a->m22*a->m31;
+
+   c->m21 = a->m13*a->m32 - a->m12*a->m33;
+   c->m22 = a->m11*a->m33 - a->m13*a->m31;
+   c->m23 = a->m12*a->m31 - a->m11*a->m32;
+
+   c->m31 = a->m12*a->m23 - a->m13*a->m22;
+   c->m32 = a->m13*a->m21 - a->m11*a->m23;
+   c->m33 = a->m11*a->m22 - a->m12*a->m21;
+
+   return a->m11*c->m11 + a->m12*c->m12 + a->m13*c->m13;
+}
+
+void affine_inverted(affine_t* m, const affine_t* a)
+{
+   mat3f_t c;
+   float invdet = 1.0f / affine_cofactors(&c, a);
+
+   affine_t r;
+   r.m11 = c.m11 * invdet; r.m12 = c.m21 * invdet; r.m13 = c.m31 * invdet;
+   r.m21 = c.m12 * invdet; r.m22 = c.m22 * invdet; r.m23 = c.m32 * invdet;
+   r.m31 = c.m13 * invdet; r.m32 = c.m23 * invdet; r.m33 = c.m33 * invdet;
+
+   r.m14 = -(r.m11*a->m14 + r.m12*a->m24 + r.m13*a->m34);
+   r.m24 = -(r.m21*a->m14 + r.m22*a->m24 + r.m23*a->m34);
+   r.m34 = -(r.m31*a->m14 + r.m32*a->m24 + r.m33*a->m34);
+
+   (*m) = r;
+}
+
+// inverse transpose of the 3x3 part, used to transform normals
+void affine_normal_matrix(mat3f_t* m, const affine_t* a)
+{
+   float invdet = 1.0f / affine_cofactors(m, a);
+
+   int i = 0;
+   for (i = 0; i < 9; ++i)
+   {
+      m->m[i] *= invdet;
+   }
+}
+
+void mat4_mult_affine_scalar(mat4f_t* m, const mat4f_t* a, const affine_t* b)
+{
+   // columns of the result are combinations of the columns of a, the last
+   // row of b being (0, 0, 0, 1) saves a quarter of mat4_mult
+   int i = 0;
+   for (i = 0; i < 4; ++i)
+   {
+      m->m[i]      = a->m[i]*b->m11 + a->m[4 + i]*b->m21 + a->m[8 + i]*b->m31;
+      m->m[4 + i]  = a->m[i]*b->m12 + a->m[4 + i]*b->m22 + a->m[8 + i]*b->m32;
+      m->m[8 + i]  = a->m[i]*b->m13 + a->m[4 + i]*b->m23 + a->m[8 + i]*b->m33;
+      m->m[12 + i] = a->m[i]*b->m14 + a->m[4 + i]*b->m24 + a->m[8 + i]*b->m34 + a->m[12 + i];
+   }
+}
+
+void mat4_from_mat3(mat4f_t* m, const mat3f_t* a)
+{
+   m->m11 = a->m11; m->m21 = a->m21; m->m31 = a->m31; m->m41 = 0.0f;
+   m->m12 = a->m12; m->m22 = a->m22; m->m32 = a->m32; m->m42 = 0.0f;
+   m->m13 = a->m13; m->m23 = a->m23; m->m33 = a->m33; m->m43 = 0.0f;
+   m->m14 = 0.0f;   m->m24 = 0.0f;   m->m34 = 0.0f;   m->m44 = 1.0f;
+}
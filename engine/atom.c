@@ -0,0 +1,177 @@
+#include "atom.h"
+#include "common.h"
+
+typedef struct atom_table_t
+{
+   unsigned int natoms;
+   unsigned int capacity;
+   unsigned int nslots;
+
+   char** names;
+   unsigned int* hashes;
+
+   // open addressing, 0 marks an empty slot as ATOM_NULL is never stored
+   atom_t* slots;
+} atom_table_t;
+
+static atom_table_t table;
+
+#define ATOM_STRING(name) #name,
+#define ATOM_PATH_STRING(name, path) path,
+static const char* builtins[] =
+{
+   ATOM_BUILTINS(ATOM_STRING)
+   ATOM_BUILTIN_PATHS(ATOM_PATH_STRING)
+};
+#undef ATOM_STRING
+#undef ATOM_PATH_STRING
+
+// FNV-1a
+static unsigned int atom_hash(const char* name)
+{
+   unsigned int hash = 2166136261u;
+   while (*name != '\0')
+   {
+      hash ^= (unsigned char)(*name++);
+      hash *= 16777619u;
+   }
+   return hash;
+}
+
+static atom_t atom_lookup(const char* name, unsigned int hash, unsigned int* pslot)
+{
+   unsigned int mask = table.nslots - 1;
+   unsigned int slot = hash & mask;
+   while (table.slots[slot] != ATOM_NULL)
+   {
+      atom_t atom = table.slots[slot];
+      if (table.hashes[atom] == hash && strcmp(table.names[atom], name) == 0)
+      {
+         break;
+      }
+      slot = (slot + 1) & mask;
+   }
+
+   (*pslot) = slot;
+   return table.slots[slot];
+}
+
+static void atom_rehash(unsigned int nslots)
+{
+   free(table.slots);
+   table.nslots = nslots;
+   table.slots = (atom_t*)malloc(nslots * sizeof(atom_t));
+   memset(table.slots, 0, nslots * sizeof(atom_t));
+
+   atom_t atom = 0;
+   for (atom = 1; atom < table.natoms; ++atom)
+   {
+      unsigned int slot = table.hashes[atom] & (nslots - 1);
+      while (table.slots[slot] != ATOM_NULL)
+      {
+         slot = (slot + 1) & (nslots - 1);
+      }
+      table.slots[slot] = atom;
+   }
+}
+
+static atom_t atom_add(const char* name, unsigned int hash)
+{
+   if (table.natoms == table.capacity)
+   {
+      table.capacity *= 2;
+      table.names = (char**)realloc(table.names, table.capacity * sizeof(char*));
+      table.hashes = (unsigned int*)realloc(table.hashes, table.capacity * sizeof(unsigned int));
+   }
+
+   atom_t atom = table.natoms++;
+   size_t size = strlen(name) + 1;
+   table.names[atom] = (char*)malloc(size);
+   memcpy(table.names[atom], name, size);
+   table.hashes[atom] = hash;
+
+   // keep the load factor under one half
+   if (2 * table.natoms > table.nslots)
+   {
+      atom_rehash(2 * table.nslots);
+   }
+   else
+   {
+      unsigned int slot = 0;
+      atom_lookup(name, hash, &slot);
+      table.slots[slot] = atom;
+   }
+   return atom;
+}
+
+static void atom_init(void)
+{
+   table.natoms = 1;
+   table.capacity = 256;
+   table.names = (char**)malloc(table.capacity * sizeof(char*));
+   table.hashes = (unsigned int*)malloc(table.capacity * sizeof(unsigned int));
+   table.names[ATOM_NULL] = "";
+   table.hashes[ATOM_NULL] = 0;
+   atom_rehash(512);
+
+   unsigned int i = 0;
+   for (i = 0; i < sizeof(builtins) / sizeof(builtins[0]); ++i)
+   {
+      atom_add(builtins[i], atom_hash(builtins[i]));
+   }
+}
+
+atom_t atom_intern(const char* name)
+{
+   if (table.natoms == 0)
+   {
+      atom_init();
+   }
+
+   if (name[0] == '\0')
+   {
+      return ATOM_NULL;
+   }
+
+   unsigned int hash = atom_hash(name);
+   unsigned int slot = 0;
+   atom_t atom = atom_lookup(name, hash, &slot);
+   if (atom == ATOM_NULL)
+   {
+      atom = atom_add(name, hash);
+   }
+   return atom;
+}
+
+// same as atom_intern, but names that were never interned give ATOM_NULL
+// instead of growing the table
+atom_t atom_find(const char* name)
+{
+   if (table.natoms == 0)
+   {
+      atom_init();
+   }
+
+   if (name[0] == '\0')
+   {
+      return ATOM_NULL;
+   }
+
+   unsigned int slot = 0;
+   return atom_lookup(name, atom_hash(name), &slot);
+}
+
+const char* atom_name(atom_t atom)
+{
+   if (table.natoms == 0)
+   {
+      atom_init();
+   }
+
+   if (atom >= table.natoms)
+   {
+      LOGE("Unknown atom %u", atom);
+      return "";
+   }
+   return table.names[atom];
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+// Interned strings. Every distinct name gets a small integer id, so names are
+// stored in 4 bytes and compared and looked up as integers. Ids stay valid
+// for the lifetime of the process, the empty string is ATOM_NULL.
+typedef unsigned int atom_t;
+
+// names the engine refers to in code, interned first so that their ids are
+// compile time constants
+#define ATOM_BUILTINS(X) \
+   X(uMVP) X(uMV) X(uMVI) X(uLightPos) \
+   X(uTex) X(uTexScale) X(uTexOffset) X(uMatDiffuse) X(uMatSpecular) X(uMatShininess) \
+   X(aPos) X(aNormal) X(aTexCoord) X(aColor) \
+   X(LampsMaterial) X(PhysicsMaterial) X(SkyboxMaterial)
+
+// builtin names that are not identifiers, with the id they go by
+#define ATOM_BUILTIN_PATHS(X) \
+   X(bbox_shader, "shaders/bbox.shader")
+
+#define ATOM_ENUM(name) ATOM_##name,
+#define ATOM_PATH_ENUM(name, path) ATOM_##name,
+enum atom_builtin_t
+{
+   ATOM_NULL = 0,
+   ATOM_BUILTINS(ATOM_ENUM)
+   ATOM_BUILTIN_PATHS(ATOM_PATH_ENUM)
+   ATOM_NBUILTINS
+};
+#undef ATOM_ENUM
+#undef ATOM_PATH_ENUM
+
+atom_t atom_intern(const char* name);
+atom_t atom_find(const char* name);
+const char* atom_name(atom_t atom);
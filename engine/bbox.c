@@ -5,6 +5,7 @@
 #include "resman.h"
 #include "game.h"
 #include "gl_defs.h"
+#include "simd.h"
 
 void bbox_reset(bbox_t* b)
 {
@@ -133,66 +134,140 @@ void bbox_draw(const bbox_t* b, const camera_t* camera)
       vertices[i + 2] = b->min.z * (1.0f - vertices[i + 2]) + b->max.z * vertices[i + 2];
    }
 
-   shader_t* shader = resman_get_shader(game->resman, "shaders/bbox.shader");
+   shader_t* shader = resman_get_shader(game->resman, ATOM_bbox_shader);
    if (shader == NULL)
       return;
 
    shader_use(shader);
-   shader_set_uniform_matrices(shader, "uMVP", 1, mat4_data(&mvp));
-   shader_set_attrib_vertices(shader, "aPos", 3, GL_FLOAT, 0, &vertices[0]);
+   shader_set_uniform_matrices(shader, ATOM_uMVP, 1, mat4_data(&mvp));
+   shader_set_attrib_vertices(shader, ATOM_aPos, 3, GL_FLOAT, 0, &vertices[0]);
    glDrawArrays(GL_LINES, 0, sizeof(vertices)/sizeof(vertices[0])/3);
    shader_unuse(shader);
 }
 
-void bbox_transform(bbox_t* b, const mat4f_t* transform)
+int bbox_soa_create(bbox_soa_t** psoa, long n)
 {
-   float vertices[] =
+   bbox_soa_t* soa = (bbox_soa_t*)malloc(sizeof(bbox_soa_t));
+   soa->n = n;
+
+   // padding boxes are empty and at the origin
+   long padded = (n + 3) & ~3L;
+   int i = 0;
+   for (i = 0; i < 3; ++i)
    {
-      0.0f, 0.0f, 0.0f,
-      0.0f, 0.0f, 1.0f,
-      0.0f, 0.0f, 0.0f,
-      0.0f, 1.0f, 0.0f,
-      0.0f, 0.0f, 0.0f,
-      1.0f, 0.0f, 0.0f,
+      soa->center[i] = (float*)malloc(padded * sizeof(float));
+      soa->extent[i] = (float*)malloc(padded * sizeof(float));
+      memset(soa->center[i], 0, padded * sizeof(float));
+      memset(soa->extent[i], 0, padded * sizeof(float));
+   }
 
-      1.0f, 1.0f, 1.0f,
-      1.0f, 1.0f, 0.0f,
-      1.0f, 1.0f, 1.0f,
-      1.0f, 0.0f, 1.0f,
-      1.0f, 1.0f, 1.0f,
-      0.0f, 1.0f, 1.0f,
+   (*psoa) = soa;
+   return 0;
+}
 
-      0.0f, 0.0f, 1.0f,
-      0.0f, 1.0f, 1.0f,
-      0.0f, 0.0f, 1.0f,
-      1.0f, 0.0f, 1.0f,
+void bbox_soa_free(bbox_soa_t* soa)
+{
+   int i = 0;
+   for (i = 0; i < 3; ++i)
+   {
+      free(soa->center[i]);
+      free(soa->extent[i]);
+   }
+   free(soa);
+}
 
-      0.0f, 1.0f, 0.0f,
-      1.0f, 1.0f, 0.0f,
-      0.0f, 1.0f, 0.0f,
-      0.0f, 1.0f, 1.0f,
+// copies n min/max boxes to the entries starting at first
+void bbox_soa_set(bbox_soa_t* soa, const bbox_t* boxes, long first, long n)
+{
+   long l = 0;
+   for (l = 0; l < n; ++l)
+   {
+      const float* min = &boxes[l].min.x;
+      const float* max = &boxes[l].max.x;
+
+      int i = 0;
+      for (i = 0; i < 3; ++i)
+      {
+         soa->center[i][first + l] = (max[i] + min[i]) * 0.5f;
+         soa->extent[i][first + l] = (max[i] - min[i]) * 0.5f;
+      }
+   }
+}
 
-      1.0f, 0.0f, 0.0f,
-      1.0f, 1.0f, 0.0f,
-      1.0f, 0.0f, 0.0f,
-      1.0f, 0.0f, 1.0f,
-   };
+void bbox_transform(bbox_t* b, const affine_t* transform)
+{
+   bbox_transform_batch(b, b, transform, 1);
+}
 
-   bbox_t bbox;
-   bbox_reset(&bbox);
-   int i = 0;
-   for (i = 0; i < sizeof(vertices)/sizeof(vertices[0]); i += 3)
+// Arvo, "Transforming Axis-Aligned Bounding Boxes": the center goes through
+// the full transform and the half extents through the absolute 3x3 part,
+// which gives the same box as transforming all 8 corners.
+#ifdef MATHLIB_SIMD
+
+void bbox_transform_batch(bbox_t* r, const bbox_t* boxes, const affine_t* transforms, long n)
+{
+   const v4f half = v4f_splat(0.5f);
+
+   long l = 0;
+   for (l = 0; l < n; ++l)
    {
-      vec3f_t vert;
-      vert.x = b->min.x * (1.0f - vertices[i + 0]) + b->max.x * vertices[i + 0];
-      vert.y = b->min.y * (1.0f - vertices[i + 1]) + b->max.y * vertices[i + 1];
-      vert.z = b->min.z * (1.0f - vertices[i + 2]) + b->max.z * vertices[i + 2];
-
-      vec3f_t transformed;
-      mat4_mult_vec3(&transformed, transform, &vert);
-      bbox_inflate(&bbox, &transformed);
+      const affine_t* m = &transforms[l];
+      const bbox_t* b = &boxes[l];
+
+      v4f c0 = v4f_load(&m->m[0]);
+      v4f c1 = v4f_load(&m->m[3]);
+      v4f c2 = v4f_load(&m->m[6]);
+      v4f c3 = v4f_set(m->m14, m->m24, m->m34, 0.0f);
+
+      v4f bmin = v4f_set(b->min.x, b->min.y, b->min.z, 0.0f);
+      v4f bmax = v4f_set(b->max.x, b->max.y, b->max.z, 0.0f);
+
+      float c[4];
+      float e[4];
+      v4f_store(c, v4f_mul(v4f_add(bmax, bmin), half));
+      v4f_store(e, v4f_mul(v4f_sub(bmax, bmin), half));
+
+      v4f center = v4f_madd(c0, v4f_splat(c[0]), c3);
+      center = v4f_madd(c1, v4f_splat(c[1]), center);
+      center = v4f_madd(c2, v4f_splat(c[2]), center);
+
+      v4f extent = v4f_mul(v4f_abs(c0), v4f_splat(e[0]));
+      extent = v4f_madd(v4f_abs(c1), v4f_splat(e[1]), extent);
+      extent = v4f_madd(v4f_abs(c2), v4f_splat(e[2]), extent);
+
+      float t[4];
+      v4f_store(&r[l].min.x, v4f_sub(center, extent));
+      v4f_store(t, v4f_add(center, extent));
+      r[l].max.x = t[0];
+      r[l].max.y = t[1];
+      r[l].max.z = t[2];
    }
+}
+
+#else
 
-   *b = bbox;
+void bbox_transform_batch(bbox_t* r, const bbox_t* boxes, const affine_t* transforms, long n)
+{
+   long l = 0;
+   for (l = 0; l < n; ++l)
+   {
+      const affine_t* m = &transforms[l];
+      const bbox_t* b = &boxes[l];
+
+      vec3f_t c = { (b->max.x + b->min.x) * 0.5f, (b->max.y + b->min.y) * 0.5f, (b->max.z + b->min.z) * 0.5f };
+      vec3f_t e = { (b->max.x - b->min.x) * 0.5f, (b->max.y - b->min.y) * 0.5f, (b->max.z - b->min.z) * 0.5f };
+
+      vec3f_t center;
+      affine_mult_vec3(&center, m, &c);
+
+      vec3f_t extent;
+      extent.x = fabsf(m->m11) * e.x + fabsf(m->m12) * e.y + fabsf(m->m13) * e.z;
+      extent.y = fabsf(m->m21) * e.x + fabsf(m->m22) * e.y + fabsf(m->m23) * e.z;
+      extent.z = fabsf(m->m31) * e.x + fabsf(m->m32) * e.y + fabsf(m->m33) * e.z;
+
+      vec3_sub(&r[l].min, &center, &extent);
+      vec3_add(&r[l].max, &center, &extent);
+   }
 }
 
+#endif
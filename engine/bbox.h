@@ -10,10 +10,24 @@ typedef struct bbox_t
    vec3f_t max;
 } bbox_t;
 
+// Boxes as centers and half extents, one array per component, for the batch
+// kernels that work on four boxes at a time. The arrays are padded to a
+// multiple of four.
+typedef struct bbox_soa_t
+{
+   long n;
+   float* center[3];
+   float* extent[3];
+} bbox_soa_t;
+
 void bbox_reset(bbox_t* b);
 void bbox_inflate(bbox_t* b, vec3f_t* v);
 void bbox_show(const bbox_t* b);
-void bbox_transform(bbox_t* b, const mat4f_t* transform);
+void bbox_transform(bbox_t* b, const affine_t* transform);
+void bbox_transform_batch(bbox_t* r, const bbox_t* boxes, const affine_t* transforms, long n);
 int bbox_tri_intersection(const bbox_t* bbox, const vec3f_t* a, const vec3f_t* b, const vec3f_t* c);
 int bbox_ray_intersection(const bbox_t* bbox, const vec3f_t* pos, const vec3f_t* dir, float* pt);
+int bbox_soa_create(bbox_soa_t** psoa, long n);
+void bbox_soa_free(bbox_soa_t* soa);
+void bbox_soa_set(bbox_soa_t* soa, const bbox_t* boxes, long first, long n);
 void bbox_draw(const bbox_t* b, const struct camera_t* camera);
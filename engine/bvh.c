@@ -0,0 +1,390 @@
+#include "bvh.h"
+#include "frustum.h"
+#include "common.h"
+
+// a leaf fills one group of four boxes of frustum_cull_batch
+#define BVH_LEAF_SIZE 4
+
+// the tree is balanced, so this covers far more items than a scene can hold
+#define BVH_STACK_SIZE 64
+
+static void bbox_union(bbox_t* r, const bbox_t* a, const bbox_t* b)
+{
+   r->min.x = fminf(a->min.x, b->min.x);
+   r->min.y = fminf(a->min.y, b->min.y);
+   r->min.z = fminf(a->min.z, b->min.z);
+   r->max.x = fmaxf(a->max.x, b->max.x);
+   r->max.y = fmaxf(a->max.y, b->max.y);
+   r->max.z = fmaxf(a->max.z, b->max.z);
+}
+
+static void bvh_node_bounds(const bvh_t* bvh, const bbox_t* bounds, const bvh_node_t* node, bbox_t* r)
+{
+   if (node->child != 0)
+   {
+      bbox_union(r, &bvh->nodes[node->child].bounds, &bvh->nodes[node->child + 1].bounds);
+      return;
+   }
+
+   bbox_reset(r);
+   long l = 0;
+   for (l = node->first; l < node->first + node->count; ++l)
+   {
+      bbox_union(r, r, &bounds[bvh->items[l]]);
+   }
+}
+
+// twice the center, only used for comparisons
+static float bbox_center(const bbox_t* b, int axis)
+{
+   return (&b->min.x)[axis] + (&b->max.x)[axis];
+}
+
+// partially sorts items by box center so that the k-th one is in place
+static void bvh_select(long* items, long n, long k, const bbox_t* bounds, int axis)
+{
+   long lo = 0;
+   long hi = n - 1;
+   while (lo < hi)
+   {
+      float pivot = bbox_center(&bounds[items[(lo + hi) / 2]], axis);
+      long i = lo;
+      long j = hi;
+      while (i <= j)
+      {
+         while (bbox_center(&bounds[items[i]], axis) < pivot) ++i;
+         while (bbox_center(&bounds[items[j]], axis) > pivot) --j;
+         if (i <= j)
+         {
+            long t = items[i];
+            items[i] = items[j];
+            items[j] = t;
+            ++i;
+            --j;
+         }
+      }
+
+      if (k <= j)
+         hi = j;
+      else if (k >= i)
+         lo = i;
+      else
+         break;
+   }
+}
+
+// median split along the longest axis of the box centers
+static void bvh_build(bvh_t* bvh, const bbox_t* bounds, long index, long first, long count)
+{
+   bvh_node_t* node = &bvh->nodes[index];
+   node->child = 0;
+   node->first = first;
+   node->count = count;
+
+   long l = 0;
+   if (count <= BVH_LEAF_SIZE)
+   {
+      for (l = first; l < first + count; ++l)
+      {
+         bvh->leaves[bvh->items[l]] = index;
+      }
+      bvh_node_bounds(bvh, bounds, node, &node->bounds);
+      return;
+   }
+
+   bbox_t centers;
+   bbox_reset(&centers);
+   for (l = first; l < first + count; ++l)
+   {
+      const bbox_t* b = &bounds[bvh->items[l]];
+      vec3f_t c = { b->min.x + b->max.x, b->min.y + b->max.y, b->min.z + b->max.z };
+      bbox_inflate(&centers, &c);
+   }
+
+   float dx = centers.max.x - centers.min.x;
+   float dy = centers.max.y - centers.min.y;
+   float dz = centers.max.z - centers.min.z;
+   int axis = (dx >= dy && dx >= dz) ? 0 : ((dy >= dz) ? 1 : 2);
+
+   long half = count / 2;
+   bvh_select(&bvh->items[first], count, half, bounds, axis);
+
+   long child = bvh->nnodes;
+   bvh->nnodes += 2;
+   node->child = child;
+   bvh->nodes[child].parent = index;
+   bvh->nodes[child + 1].parent = index;
+
+   bvh_build(bvh, bounds, child, first, half);
+   bvh_build(bvh, bounds, child + 1, first + half, count - half);
+   bvh_node_bounds(bvh, bounds, node, &node->bounds);
+}
+
+// builds the tree over the boxes listed in items, or over all nbounds boxes if
+// items is NULL. Boxes left out are ignored by bvh_refit.
+int bvh_create(bvh_t** pbvh, const bbox_t* bounds, long nbounds, const long* items, long nitems)
+{
+   bvh_t* bvh = (bvh_t*)malloc(sizeof(bvh_t));
+   memset(bvh, 0, sizeof(bvh_t));
+
+   if (items == NULL)
+   {
+      nitems = nbounds;
+   }
+
+   // a binary tree with at least one item per leaf
+   long maxnodes = (nitems > 0) ? 2 * nitems - 1 : 1;
+
+   bvh->nitems = nitems;
+   bvh->nodes = (bvh_node_t*)malloc(maxnodes * sizeof(bvh_node_t));
+   bvh->items = (long*)malloc((nitems + 1) * sizeof(long));
+   bvh->leaves = (long*)malloc((nbounds + 1) * sizeof(long));
+
+   long l = 0;
+   for (l = 0; l < nbounds; ++l)
+   {
+      bvh->leaves[l] = -1;
+   }
+
+   for (l = 0; l < nitems; ++l)
+   {
+      bvh->items[l] = (items != NULL) ? items[l] : l;
+   }
+
+   if (nitems > 0)
+   {
+      bvh->nnodes = 1;
+      bvh->nodes[0].parent = -1;
+      bvh_build(bvh, bounds, 0, 0, nitems);
+   }
+
+   for (l = 0; l < bvh->nnodes; ++l)
+   {
+      bvh->nleaves += (bvh->nodes[l].child == 0);
+   }
+
+   long ngroups = bvh->nleaves;
+   bbox_soa_create(&bvh->group_boxes, ngroups * BVH_LEAF_SIZE);
+   bvh->group_leaves = (long*)malloc((ngroups + 1) * sizeof(long));
+   bvh->group_planes = (unsigned char*)malloc(ngroups + 1);
+   bvh->group_last_plane = (unsigned char*)malloc(ngroups + 1);
+   bvh->group_visible = (unsigned int*)malloc(((ngroups * BVH_LEAF_SIZE + 31) / 32 + 1) * sizeof(unsigned int));
+   bvh->last_plane = (unsigned char*)malloc(bvh->nnodes + 1);
+   memset(bvh->last_plane, 0, bvh->nnodes + 1);
+
+   LOGI("BVH over %ld items has %ld nodes", nitems, bvh->nnodes);
+
+   (*pbvh) = bvh;
+   return 0;
+}
+
+void bvh_free(bvh_t* bvh)
+{
+   free(bvh->nodes);
+   free(bvh->items);
+   free(bvh->leaves);
+   bbox_soa_free(bvh->group_boxes);
+   free(bvh->group_leaves);
+   free(bvh->group_planes);
+   free(bvh->group_last_plane);
+   free(bvh->group_visible);
+   free(bvh->last_plane);
+   free(bvh);
+}
+
+// updates the nodes above an item whose box changed, stops as soon as a node
+// keeps its bounds
+void bvh_refit(bvh_t* bvh, const bbox_t* bounds, long item)
+{
+   long index = bvh->leaves[item];
+   while (index >= 0)
+   {
+      bvh_node_t* node = &bvh->nodes[index];
+
+      bbox_t b;
+      bvh_node_bounds(bvh, bounds, node, &b);
+      if (memcmp(&b, &node->bounds, sizeof(bbox_t)) == 0)
+      {
+         break;
+      }
+
+      node->bounds = b;
+      index = node->parent;
+   }
+}
+
+// writes the items whose boxes intersect the frustum to visible, which has to
+// hold nitems entries, and returns their number. Subtrees fully inside the
+// frustum are taken without testing their items, and nodes only test the
+// planes their parent straddles. Items of the leaves left are culled in one
+// batch at the end, which goes through the scratch of the bvh.
+long bvh_cull(bvh_t* bvh, const struct frustum_t* frustum, const bbox_t* bounds, long* visible)
+{
+   long nvisible = 0;
+   if (bvh->nnodes == 0)
+   {
+      return 0;
+   }
+
+   long stack[BVH_STACK_SIZE];
+   unsigned int planes[BVH_STACK_SIZE];
+   long top = 0;
+   stack[top] = 0;
+   planes[top++] = 0x3f;
+
+   long ngroups = 0;
+   while (top > 0)
+   {
+      --top;
+      long index = stack[top];
+      unsigned int mask = planes[top];
+      const bvh_node_t* node = &bvh->nodes[index];
+
+      int result = frustum_intersect_aabb_planes(frustum, &node->bounds, &mask);
+      if (result < 0)
+      {
+         continue;
+      }
+
+      if (result > 0)
+      {
+         memcpy(&visible[nvisible], &bvh->items[node->first], node->count * sizeof(long));
+         nvisible += node->count;
+      }
+      else if (node->child != 0)
+      {
+         stack[top] = node->child + 1;
+         planes[top++] = mask;
+         stack[top] = node->child;
+         planes[top++] = mask;
+      }
+      else
+      {
+         long g = ngroups++;
+         bvh->group_leaves[g] = index;
+         bvh->group_planes[g] = (unsigned char)mask;
+         bvh->group_last_plane[g] = bvh->last_plane[index];
+
+         // slots past the items of the leaf repeat its first box so that
+         // they don't keep the group from being rejected as a whole
+         long l = 0;
+         for (l = 0; l < BVH_LEAF_SIZE; ++l)
+         {
+            long item = bvh->items[node->first + ((l < node->count) ? l : 0)];
+            bbox_soa_set(bvh->group_boxes, &bounds[item], g * BVH_LEAF_SIZE + l, 1);
+         }
+      }
+   }
+
+   if (ngroups == 0)
+   {
+      return nvisible;
+   }
+
+   bvh->group_boxes->n = ngroups * BVH_LEAF_SIZE;
+   frustum_cull_batch(frustum, bvh->group_boxes, bvh->group_planes, bvh->group_last_plane, bvh->group_visible);
+
+   const unsigned int* bits = bvh->group_visible;
+   long g = 0;
+   for (g = 0; g < ngroups; ++g)
+   {
+      long index = bvh->group_leaves[g];
+      const bvh_node_t* node = &bvh->nodes[index];
+      bvh->last_plane[index] = bvh->group_last_plane[g];
+
+      long l = 0;
+      for (l = 0; l < node->count; ++l)
+      {
+         long k = g * BVH_LEAF_SIZE + l;
+         if (bits[k >> 5] & (1u << (k & 31)))
+         {
+            visible[nvisible++] = bvh->items[node->first + l];
+         }
+      }
+   }
+
+   return nvisible;
+}
+
+// distance along the ray to where it enters the box of a node grown by
+// margin, or -1 if it misses it
+static float bvh_ray_entry(const bvh_node_t* node, const vec3f_t* from, const vec3f_t* dir, float margin)
+{
+   bbox_t b = node->bounds;
+   b.min.x -= margin; b.min.y -= margin; b.min.z -= margin;
+   b.max.x += margin; b.max.y += margin; b.max.z += margin;
+
+   float dist = 0.0f;
+   return bbox_ray_intersection(&b, from, dir, &dist) ? dist : -1.0f;
+}
+
+// calls visit for the items of every leaf the ray enters, node boxes are grown
+// by margin on every side for callers testing against larger boxes. Children
+// are walked in the order the ray enters them and subtrees entered beyond the
+// distance visit returned are skipped.
+void bvh_raycast(const bvh_t* bvh, const vec3f_t* from, const vec3f_t* dir, float margin, bvh_ray_pf visit, void* user_data)
+{
+   if (bvh->nnodes == 0)
+   {
+      return;
+   }
+
+   float best = 99999999.0f;
+
+   long stack[BVH_STACK_SIZE];
+   float entry[BVH_STACK_SIZE];
+   long top = 0;
+
+   entry[top] = bvh_ray_entry(&bvh->nodes[0], from, dir, margin);
+   if (entry[top] < 0.0f)
+   {
+      return;
+   }
+   stack[top++] = 0;
+
+   while (top > 0)
+   {
+      --top;
+      if (entry[top] > best)
+      {
+         continue;
+      }
+
+      const bvh_node_t* node = &bvh->nodes[stack[top]];
+      if (node->child != 0)
+      {
+         long near = node->child;
+         long far = node->child + 1;
+         float near_dist = bvh_ray_entry(&bvh->nodes[near], from, dir, margin);
+         float far_dist = bvh_ray_entry(&bvh->nodes[far], from, dir, margin);
+         if (far_dist >= 0.0f && (near_dist < 0.0f || far_dist < near_dist))
+         {
+            long tmp = near;
+            float tmp_dist = near_dist;
+            near = far;
+            near_dist = far_dist;
+            far = tmp;
+            far_dist = tmp_dist;
+         }
+
+         // the nearer child goes last so that it is popped first
+         if (far_dist >= 0.0f && far_dist <= best)
+         {
+            entry[top] = far_dist;
+            stack[top++] = far;
+         }
+         if (near_dist >= 0.0f && near_dist <= best)
+         {
+            entry[top] = near_dist;
+            stack[top++] = near;
+         }
+         continue;
+      }
+
+      long l = 0;
+      for (l = node->first; l < node->first + node->count; ++l)
+      {
+         best = visit(bvh->items[l], user_data);
+      }
+   }
+}
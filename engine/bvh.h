@@ -0,0 +1,53 @@
+#pragma once
+
+#include "bbox.h"
+
+struct frustum_t;
+
+typedef struct bvh_node_t
+{
+   bbox_t bounds;
+   long parent;
+
+   // the children of inner nodes are stored at child and child + 1, leaves
+   // have child 0. Items of a subtree are contiguous, first and count cover
+   // all of them.
+   long child;
+   long first;
+   long count;
+} bvh_node_t;
+
+// Bounding volume hierarchy over an array of boxes, or a subset of them,
+// indexed by the position of the boxes in that array. Nodes are stored after
+// their parent.
+typedef struct bvh_t
+{
+   long nnodes;
+   long nitems;
+
+   bvh_node_t* nodes;
+   long* items;
+   long* leaves;
+
+   // scratch of bvh_cull, the items of every leaf the frustum cuts through
+   // are copied to a group of four boxes and culled in one batch, see
+   // frustum_cull_batch. last_plane keeps by node the plane that last
+   // rejected the items of a leaf.
+   long nleaves;
+   bbox_soa_t* group_boxes;
+   long* group_leaves;
+   unsigned char* group_planes;
+   unsigned char* group_last_plane;
+   unsigned int* group_visible;
+   unsigned char* last_plane;
+} bvh_t;
+
+// returns the distance the traversal still has to beat, items and subtrees
+// further along the ray are skipped
+typedef float (*bvh_ray_pf)(long item, void* user_data);
+
+int bvh_create(bvh_t** pbvh, const bbox_t* bounds, long nbounds, const long* items, long nitems);
+void bvh_free(bvh_t* bvh);
+void bvh_refit(bvh_t* bvh, const bbox_t* bounds, long item);
+long bvh_cull(bvh_t* bvh, const struct frustum_t* frustum, const bbox_t* bounds, long* visible);
+void bvh_raycast(const bvh_t* bvh, const vec3f_t* from, const vec3f_t* dir, float margin, bvh_ray_pf visit, void* user_data);
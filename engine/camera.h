@@ -1,10 +1,11 @@
 #pragma once
 
 #include "mathlib.h"
+#include "atom.h"
 
 typedef struct camera_t
 {
-   char name[64];
+   atom_t name;
 
    enum
    {
@@ -1,6 +1,7 @@
 #include "frustum.h"
 #include "common.h"
 #include "bbox.h"
+#include "simd.h"
 
 void frustum_set(frustum_t* frustum, const mat4f_t* proj, const mat4f_t* view)
 {
@@ -138,3 +139,177 @@ int frustum_intersect_aabb(const frustum_t* frustum, const bbox_t* aabb)
    return result;
 }
 
+// like frustum_intersect_aabb but only tests the planes whose bit is set in
+// planes, and clears the bits of the planes the box is fully inside of. The
+// boxes of a hierarchy are inside every plane their parent is inside of, so
+// children start from the bits left by their parent.
+int frustum_intersect_aabb_planes(const frustum_t* frustum, const bbox_t* aabb, unsigned int* planes)
+{
+   const vec3f_t* min = &aabb->min;
+   const vec3f_t* max = &aabb->max;
+   vec3f_t tmp;
+
+   int i = 0;
+   for (i = 0; i < 6; ++i)
+   {
+      if (!((*planes) & (1u << i)))
+         continue;
+
+      const plane_t* plane = &frustum->planes[i];
+
+      tmp.x = (plane->x < 0.0f) ? min->x : max->x;
+      tmp.y = (plane->y < 0.0f) ? min->y : max->y;
+      tmp.z = (plane->z < 0.0f) ? min->z : max->z;
+
+      if (plane->x * tmp.x + plane->y * tmp.y + plane->z * tmp.z + plane->w < 0.0f)
+         return -1;
+
+      tmp.x = (plane->x < 0.0f) ? max->x : min->x;
+      tmp.y = (plane->y < 0.0f) ? max->y : min->y;
+      tmp.z = (plane->z < 0.0f) ? max->z : min->z;
+
+      if (plane->x * tmp.x + plane->y * tmp.y + plane->z * tmp.z + plane->w > 0.0f)
+         (*planes) &= ~(1u << i);
+   }
+
+   return ((*planes) == 0) ? 1 : 0;
+}
+
+
+// Tests boxes four at a time and sets bit i of visible for every box i not
+// fully outside one of the planes, visible has to hold (n + 31) / 32 words.
+// A box is outside a plane when its center is further behind it than the
+// projected half extents, the same test frustum_intersect_aabb does on the
+// nearest corner.
+//
+// Boxes culled in one frame are usually culled by the same plane in the next,
+// so last_plane keeps per group of four boxes the plane that rejected the
+// whole group and testing starts there. It has to hold (n + 3) / 4 entries
+// below 6, zero on the first call. planes holds per group the bits of the
+// planes to test, see frustum_intersect_aabb_planes, NULL tests all six.
+#ifdef MATHLIB_SIMD
+
+void frustum_cull_batch(const frustum_t* frustum, const struct bbox_soa_t* boxes, const unsigned char* planes, unsigned char* last_plane, unsigned int* visible)
+{
+   v4f normal[6][3];
+   v4f absnormal[6][3];
+   v4f offset[6];
+   int i = 0;
+   for (i = 0; i < 6; ++i)
+   {
+      const plane_t* plane = &frustum->planes[i];
+      normal[i][0] = v4f_splat(plane->x);
+      normal[i][1] = v4f_splat(plane->y);
+      normal[i][2] = v4f_splat(plane->z);
+      absnormal[i][0] = v4f_splat(fabsf(plane->x));
+      absnormal[i][1] = v4f_splat(fabsf(plane->y));
+      absnormal[i][2] = v4f_splat(fabsf(plane->z));
+      offset[i] = v4f_splat(plane->w);
+   }
+
+   const v4f zero = v4f_splat(0.0f);
+   const float* const* center = (const float* const*)boxes->center;
+   const float* const* extent = (const float* const*)boxes->extent;
+   long ngroups = (boxes->n + 3) / 4;
+
+   memset(visible, 0, ((boxes->n + 31) / 32) * sizeof(unsigned int));
+
+   long g = 0;
+   for (g = 0; g < ngroups; ++g)
+   {
+      long l = g * 4;
+      v4f cx = v4f_load(&center[0][l]);
+      v4f cy = v4f_load(&center[1][l]);
+      v4f cz = v4f_load(&center[2][l]);
+      v4f ex = v4f_load(&extent[0][l]);
+      v4f ey = v4f_load(&extent[1][l]);
+      v4f ez = v4f_load(&extent[2][l]);
+
+      int outside = 0;
+      int mask = (planes != NULL) ? planes[g] : 0x3f;
+      int p = last_plane[g];
+      for (i = 0; i < 6; ++i, p = (p == 5) ? 0 : p + 1)
+      {
+         if (!(mask & (1 << p)))
+            continue;
+
+         v4f dist = v4f_madd(normal[p][0], cx, offset[p]);
+         dist = v4f_madd(normal[p][1], cy, dist);
+         dist = v4f_madd(normal[p][2], cz, dist);
+         dist = v4f_madd(absnormal[p][0], ex, dist);
+         dist = v4f_madd(absnormal[p][1], ey, dist);
+         dist = v4f_madd(absnormal[p][2], ez, dist);
+
+         outside |= v4f_mask_lt(dist, zero);
+         if (outside == 0xf)
+         {
+            last_plane[g] = (unsigned char)p;
+            break;
+         }
+      }
+
+      visible[g >> 3] |= (unsigned int)(~outside & 0xf) << ((g & 7) * 4);
+   }
+
+   // padding boxes at the origin may have passed
+   long n = boxes->n;
+   if (n & 31)
+   {
+      visible[n >> 5] &= (1u << (n & 31)) - 1u;
+   }
+}
+
+#else
+
+void frustum_cull_batch(const frustum_t* frustum, const struct bbox_soa_t* boxes, const unsigned char* planes, unsigned char* last_plane, unsigned int* visible)
+{
+   const float* const* center = (const float* const*)boxes->center;
+   const float* const* extent = (const float* const*)boxes->extent;
+   long n = boxes->n;
+
+   long ngroups = (n + 3) / 4;
+
+   memset(visible, 0, ((n + 31) / 32) * sizeof(unsigned int));
+
+   // goes group by group like the SIMD version, so that last_plane only
+   // changes when a plane rejects the last boxes of a whole group
+   long g = 0;
+   for (g = 0; g < ngroups; ++g)
+   {
+      int outside = 0;
+      int mask = (planes != NULL) ? planes[g] : 0x3f;
+      int p = last_plane[g];
+      int i = 0;
+      for (i = 0; i < 6; ++i, p = (p == 5) ? 0 : p + 1)
+      {
+         if (!(mask & (1 << p)))
+            continue;
+
+         const plane_t* plane = &frustum->planes[p];
+         int k = 0;
+         for (k = 0; k < 4; ++k)
+         {
+            long l = g * 4 + k;
+            float dist = plane->x * center[0][l] + plane->y * center[1][l] + plane->z * center[2][l] + plane->w;
+            dist += fabsf(plane->x) * extent[0][l] + fabsf(plane->y) * extent[1][l] + fabsf(plane->z) * extent[2][l];
+            outside |= (dist < 0.0f) << k;
+         }
+
+         if (outside == 0xf)
+         {
+            last_plane[g] = (unsigned char)p;
+            break;
+         }
+      }
+
+      visible[g >> 3] |= (unsigned int)(~outside & 0xf) << ((g & 7) * 4);
+   }
+
+   // padding boxes at the origin may have passed
+   if (n & 31)
+   {
+      visible[n >> 5] &= (1u << (n & 31)) - 1u;
+   }
+}
+
+#endif
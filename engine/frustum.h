@@ -3,6 +3,7 @@
 #include "mathlib.h"
 
 struct bbox_t;
+struct bbox_soa_t;
 
 typedef struct frustum_t
 {
@@ -12,4 +13,6 @@ typedef struct frustum_t
 void frustum_set(frustum_t* frustum, const mat4f_t* proj, const mat4f_t* view);
 void frustum_show(const frustum_t* frustum);
 int frustum_intersect_aabb(const frustum_t* frustum, const struct bbox_t* aabb);
+int frustum_intersect_aabb_planes(const frustum_t* frustum, const struct bbox_t* aabb, unsigned int* planes);
+void frustum_cull_batch(const frustum_t* frustum, const struct bbox_soa_t* boxes, const unsigned char* planes, unsigned char* last_plane, unsigned int* visible);
 
@@ -4,20 +4,29 @@
 #include "common.h"
 #include "resman.h"
 #include "gl_defs.h"
+#include "frustum.h"
+#include "hierarchy.h"
+#include "nodes.h"
+#include "bvh.h"
+#include "occlusion.h"
+#include "pvs.h"
+#include "impostor.h"
 #include <physics.h>
 #include <timestamp.h>
 
-camera_t* setup_camera(const struct game_t* game, const struct scene_t* scene, const char* camera_name)
+camera_t* setup_camera(const struct game_t* game, const struct scene_t* scene, const struct nodes_t* nodes, atom_t camera_name)
 {
    node_t* camera_node = scene_get_node(scene, camera_name);
    if (camera_node == NULL)
    {
-      LOGE("Unable to find camera node '%s'", camera_name);
+      LOGE("Unable to find camera node '%s'", atom_name(camera_name));
       return NULL;
    }
 
    camera_t* camera = world_get_camera(game->world, camera_node->data);
-   mat4_inverted(&camera->view, &camera_node->transform);
+   affine_t view;
+   affine_inverted(&view, &nodes->hierarchy->world[camera_node - scene->nodes]);
+   affine_to_mat4(&camera->view, &view);
 
    if (camera->type == CAMERA_PERSPECTIVE)
    {
@@ -44,10 +53,27 @@ void game_update(struct game_t* game, float dt)
       int maxSteps = (int)((dt / interval) + 1.0f);
       physics_world_step(game->phys, dt, maxSteps, interval);
 
-      LOGD("Physics update time: %ld ms", timestamp_elapsed(&delta));
+      LOGD("Physics update time: %ld us", timestamp_elapsed_us(&delta));
+
+      if (game_is_option_set(game, GAME_PROFILE_PHYSICS))
+      {
+         physics_profile_t profile;
+         if (physics_world_get_profile(game->phys, &profile) == 0)
+         {
+            physics_profile_show(&profile);
+         }
+      }
    }
+
+   // picks up the bodies moved by physics and everything parented to them
+   nodes_update(game->nodes);
+   nodes_update(game->gui.nodes);
 }
 
+#define GAME_DETAIL_PIXELS 2.0f
+#define GAME_DETAIL_HYSTERESIS 0.2f
+#define GAME_LOD_BIAS 1.0f
+
 #define MAX_LINES 8192
 int nlines;
 vec3f_t vertices[MAX_LINES * 2];
@@ -67,7 +93,7 @@ void dd_draw_line(const vec3f_t* from, const vec3f_t* to, const vec3f_t* color)
 
 void game_render_physics(const struct game_t* game, const struct physics_world_t* world, const struct camera_t* camera)
 {
-   material_t* material = resman_get_material(game->resman, "PhysicsMaterial");
+   material_t* material = resman_get_material(game->resman, ATOM_PhysicsMaterial);
    if (material == NULL)
       return;
 
@@ -82,9 +108,9 @@ void game_render_physics(const struct game_t* game, const struct physics_world_t
    mat4_mult(&mvp, &camera->proj, &camera->view);
 
    shader_use(shader);
-   shader_set_uniform_matrices(shader, "uMVP", 1, mat4_data(&mvp));
-   shader_set_attrib_vertices(shader, "aPos", 3, GL_FLOAT, 0, &vertices[0]);
-   shader_set_attrib_vertices(shader, "aColor", 3, GL_FLOAT, 0, &colors[0]);
+   shader_set_uniform_matrices(shader, ATOM_uMVP, 1, mat4_data(&mvp));
+   shader_set_attrib_vertices(shader, ATOM_aPos, 3, GL_FLOAT, 0, &vertices[0]);
+   shader_set_attrib_vertices(shader, ATOM_aColor, 3, GL_FLOAT, 0, &colors[0]);
 
    glLineWidth(2);
    glDrawArrays(GL_LINES, 0, nlines * 2);
@@ -97,7 +123,7 @@ void game_render(const struct game_t* game)
    timestamp_t delta;
    timestamp_set(&delta);
 
-   game_render_scene(game, game->scene, game->camera);
+   game_render_scene(game, game->nodes, game->phys, game->camera);
 
    if (game_is_option_set(game, GAME_DRAW_PHYSICS))
    {
@@ -107,28 +133,304 @@ void game_render(const struct game_t* game)
    glEnable(GL_BLEND);
    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-   camera_t* gui_camera = setup_camera(game, game->gui.scene, game->gui.scene->camera);
-   game_render_scene(game, game->gui.scene, gui_camera);
+   camera_t* gui_camera = setup_camera(game, game->gui.scene, game->gui.nodes, game->gui.scene->camera);
+   game_render_scene(game, game->gui.nodes, NULL, gui_camera);
 
    glDisable(GL_BLEND);
 
    LOGD("Render time: %ld ms", timestamp_elapsed(&delta));
 }
 
-void game_render_scene(const struct game_t* game, const struct scene_t* scene, const struct camera_t* camera)
+static int compare_index(const void* a, const void* b)
 {
-   long l = 0;
-   struct node_t* node = &scene->nodes[0];
-   for (l = 0; l < scene->nnodes; ++l, ++node)
+   long la = *(const long*)a;
+   long lb = *(const long*)b;
+   return (la > lb) - (la < lb);
+}
+
+// culls dynamic nodes against the up to date body bounds of the broadphase,
+// which holds the bodies of static nodes too. Dynamic nodes without a body
+// are tested against their own world bounds.
+static long game_cull_dynamic(const struct game_t* game, const struct nodes_t* nodes, const struct physics_world_t* phys, const frustum_t* frustum, long* visible)
+{
+   const unsigned char* flags = nodes->flags;
+   long n = 0;
+
+   long nbodies = -1;
+   if (phys != NULL)
+   {
+      nbodies = physics_world_cull(phys, frustum->planes, 6, nodes->visible_bodies, nodes->nnodes);
+   }
+
+   long i = 0;
+   for (i = 0; i < nbodies; ++i)
+   {
+      long l = (const node_t*)nodes->visible_bodies[i] - nodes->scene->nodes;
+      if (flags[l] & NODE_DYNAMIC)
+      {
+         visible[n++] = l;
+      }
+   }
+
+   for (i = 0; i < nodes->ndynamic; ++i)
+   {
+      long l = nodes->dynamic[i];
+      int has_body = (nbodies >= 0 && game->bodies != NULL && game->bodies[l] != NULL);
+      if (!has_body && frustum_intersect_aabb(frustum, &nodes->world_bounds[l]) >= 0)
+      {
+         visible[n++] = l;
+      }
+   }
+   return n;
+}
+
+// the camera position out of its rigid view transform
+static void game_camera_eye(vec3f_t* eye, const struct camera_t* camera)
+{
+   const mat4f_t* v = &camera->view;
+   eye->x = -(v->m11 * v->m14 + v->m21 * v->m24 + v->m31 * v->m34);
+   eye->y = -(v->m12 * v->m14 + v->m22 * v->m24 + v->m32 * v->m34);
+   eye->z = -(v->m13 * v->m14 + v->m23 * v->m24 + v->m33 * v->m34);
+}
+
+// center and radius of the sphere around a box
+static float game_bounding_sphere(vec3f_t* center, const bbox_t* bounds)
+{
+   vec3f_t extent;
+   vec3_scale(center, vec3_add(center, &bounds->min, &bounds->max), 0.5f);
+   vec3_sub(&extent, &bounds->max, center);
+   return sqrtf(vec3_dot(&extent, &extent));
+}
+
+// drops nodes covering less than game->detail_pixels of the viewport height
+// and nodes beyond their draw distance. The size is the diameter of the
+// bounding sphere, which at clip w spans r * proj.m22 * height / w pixels.
+// A dropped node has to get past its threshold by GAME_DETAIL_HYSTERESIS to
+// come back, and a drawn one by as much to go, so nodes near a threshold
+// don't pop in and out as the camera moves.
+static long game_cull_detail(const struct game_t* game, struct nodes_t* nodes, const struct camera_t* camera, const mat4f_t* clip, const vec3f_t* eye, long* visible, long nvisible)
+{
+   float scale = camera->proj.m22 * game->viewport_height;
+
+   unsigned char* flags = nodes->flags;
+   const bbox_t* bounds = nodes->world_bounds;
+   const float* draw_distances = nodes->draw_distances;
+
+   long n = 0;
+   long i = 0;
+   for (i = 0; i < nvisible; ++i)
+   {
+      long l = visible[i];
+
+      vec3f_t center;
+      float radius = game_bounding_sphere(&center, &bounds[l]);
+
+      int culled = (flags[l] & NODE_DETAIL_CULLED) != 0;
+      float far_scale = culled ? 1.0f : 1.0f + GAME_DETAIL_HYSTERESIS;
+      float size_scale = culled ? 1.0f + GAME_DETAIL_HYSTERESIS : 1.0f;
+
+      int drop = 0;
+      if (draw_distances[l] > 0.0f)
+      {
+         vec3f_t v;
+         vec3_sub(&v, &center, eye);
+         drop = vec3_dot(&v, &v) > draw_distances[l] * draw_distances[l] * far_scale * far_scale;
+      }
+
+      float w = clip->m41 * center.x + clip->m42 * center.y + clip->m43 * center.z + clip->m44;
+      if (!drop && scale > 0.0f && w > radius)
+      {
+         drop = radius * scale < game->detail_pixels * size_scale * w;
+      }
+
+      if (drop)
+      {
+         flags[l] |= NODE_DETAIL_CULLED;
+      }
+      else
+      {
+         flags[l] &= ~NODE_DETAIL_CULLED;
+         visible[n++] = l;
+      }
+   }
+
+   LOGD("Detail culled %ld of %ld nodes", nvisible - n, nvisible);
+   return n;
+}
+
+// picks the level of a mesh whose error spans at most game->lod_bias pixels,
+// measured at the center of the node like the detail cull. Errors are in mesh
+// units and grow with the largest scale of the node transform.
+static long game_select_lod(const struct game_t* game, const struct camera_t* camera, const mat4f_t* clip, const mesh_t* mesh, const affine_t* transform, const bbox_t* bounds)
+{
+   if (game->viewport_height <= 0 || mesh->nsubmeshes == 0 || mesh->submeshes[0].nlods == 0)
+   {
+      return 0;
+   }
+
+   vec3f_t center;
+   float radius = game_bounding_sphere(&center, bounds);
+   float w = clip->m41 * center.x + clip->m42 * center.y + clip->m43 * center.z + clip->m44;
+   if (w <= radius)
    {
-      switch (node->type)
+      return 0;
+   }
+
+   const affine_t* m = transform;
+   float scale = sqrtf(m->m11 * m->m11 + m->m21 * m->m21 + m->m31 * m->m31);
+   scale = fmaxf(scale, sqrtf(m->m12 * m->m12 + m->m22 * m->m22 + m->m32 * m->m32));
+   scale = fmaxf(scale, sqrtf(m->m13 * m->m13 + m->m23 * m->m23 + m->m33 * m->m33));
+
+   float max_error = game->lod_bias * w / (camera->proj.m22 * game->viewport_height * scale);
+   return mesh_select_lod(mesh, max_error);
+}
+
+static int game_is_distant(const bbox_t* bounds, const vec3f_t* eye, float distance)
+{
+   vec3f_t center;
+   vec3f_t v;
+   game_bounding_sphere(&center, bounds);
+   vec3_sub(&v, &center, eye);
+   return vec3_dot(&v, &v) > distance * distance;
+}
+
+// keeps the nodes of the baked set of the cell the camera is in, dynamic nodes
+// move out of the sets and are always kept. Outside of the baked cells
+// nothing is dropped.
+static long game_cull_pvs(struct nodes_t* nodes, const vec3f_t* eye, long* visible, long nvisible)
+{
+   long cell = pvs_find_cell(nodes->pvs, eye);
+   if (cell < 0)
+   {
+      return nvisible;
+   }
+
+   if (cell != nodes->pvs_cell)
+   {
+      pvs_decompress(nodes->pvs, cell, nodes->pvs_bits);
+      nodes->pvs_cell = cell;
+   }
+
+   const unsigned char* bits = nodes->pvs_bits;
+   const unsigned char* flags = nodes->flags;
+   long n = 0;
+   long i = 0;
+   for (i = 0; i < nvisible; ++i)
+   {
+      long l = visible[i];
+      if ((bits[l >> 3] & (1 << (l & 7))) || (flags[l] & NODE_DYNAMIC))
+      {
+         visible[n++] = l;
+      }
+   }
+   return n;
+}
+
+// draws the visible occluders into the occlusion buffer and drops the nodes
+// hidden behind them. Occluders are always kept, dynamic nodes too as the
+// broadphase has their bounds.
+static long game_cull_occluded(const struct game_t* game, const struct nodes_t* nodes, const struct camera_t* camera, long* visible, long nvisible)
+{
+   occlusion_t* occlusion = game->occlusion;
+   const unsigned char* flags = nodes->flags;
+   const affine_t* transforms = nodes->hierarchy->world;
+
+   long noccluders = 0;
+   long i = 0;
+   for (i = 0; i < nvisible; ++i)
+   {
+      long l = visible[i];
+      if (flags[l] & NODE_OCCLUDER)
+      {
+         if (noccluders++ == 0)
+         {
+            occlusion_begin(occlusion, &camera->proj, &camera->view);
+         }
+         occlusion_draw_mesh(occlusion, (const mesh_t*)nodes->data[l], &transforms[l]);
+      }
+   }
+
+   if (noccluders == 0)
+   {
+      return nvisible;
+   }
+
+   long n = 0;
+   for (i = 0; i < nvisible; ++i)
+   {
+      long l = visible[i];
+      if ((flags[l] & (NODE_OCCLUDER | NODE_DYNAMIC)) || occlusion_test_aabb(occlusion, &nodes->world_bounds[l]))
+      {
+         visible[n++] = l;
+      }
+   }
+
+   LOGD("Occlusion culled %ld of %ld nodes", nvisible - n, nvisible);
+   return n;
+}
+
+void game_render_scene(const struct game_t* game, struct nodes_t* nodes, const struct physics_world_t* phys, const struct camera_t* camera)
+{
+   frustum_t frustum;
+   frustum_set(&frustum, &camera->proj, &camera->view);
+
+   // the bvh returns visible nodes in tree order, going back to scene order
+   // keeps blending of overlapping gui controls stable
+   long* visible = nodes->visible;
+   long nvisible = bvh_cull(nodes->bvh, &frustum, nodes->world_bounds, visible);
+   nvisible += game_cull_dynamic(game, nodes, phys, &frustum, &visible[nvisible]);
+   qsort(visible, nvisible, sizeof(long), compare_index);
+
+   mat4f_t clip;
+   mat4_mult(&clip, &camera->proj, &camera->view);
+
+   vec3f_t eye;
+   game_camera_eye(&eye, camera);
+
+   if (game_is_option_set(game, GAME_CULL_DETAIL))
+   {
+      nvisible = game_cull_detail(game, nodes, camera, &clip, &eye, visible, nvisible);
+   }
+
+   if (nodes->pvs != NULL)
+   {
+      nvisible = game_cull_pvs(nodes, &eye, visible, nvisible);
+   }
+
+   if (game->occlusion != NULL && game_is_option_set(game, GAME_CULL_OCCLUDED))
+   {
+      nvisible = game_cull_occluded(game, nodes, camera, visible, nvisible);
+   }
+
+   const unsigned char* types = nodes->types;
+   const unsigned char* flags = nodes->flags;
+   const affine_t* transforms = nodes->hierarchy->world;
+
+   // impostors only hold up under perspective, the gui is drawn as it is
+   int use_impostors = game->impostors != NULL && camera->type == CAMERA_PERSPECTIVE && game_is_option_set(game, GAME_DRAW_IMPOSTORS);
+
+   long i = 0;
+   for (i = 0; i < nvisible; ++i)
+   {
+      long l = visible[i];
+      if (!(flags[l] & NODE_DRAWABLE))
+         continue;
+
+      switch (types[l])
       {
       case NODE_MESH:
       {
          if (game_is_option_set(game, GAME_DRAW_MESHES))
          {
-            struct mesh_t* mesh = resman_get_mesh(game->resman, node->data);
-            world_render_mesh(game->world, camera, mesh, &node->transform);
+            const mesh_t* mesh = (const mesh_t*)nodes->data[l];
+            if (use_impostors && game_is_distant(&nodes->world_bounds[l], &eye, game->impostors->atlas->distance) &&
+                impostor_batch_add(game->impostors, mesh, &transforms[l], &eye) == 0)
+            {
+               break;
+            }
+
+            long lod = game_select_lod(game, camera, &clip, mesh, &transforms[l], &nodes->world_bounds[l]);
+            world_render_mesh(game->world, camera, mesh, &transforms[l], lod);
          }
          break;
       }
@@ -136,8 +438,7 @@ void game_render_scene(const struct game_t* game, const struct scene_t* scene, c
       {
          if (game_is_option_set(game, GAME_DRAW_CAMERAS))
          {
-            struct camera_t* cam = world_get_camera(game->world, node->data);
-            world_render_camera(game->world, camera, cam, &node->transform);
+            world_render_camera(game->world, camera, (const camera_t*)nodes->data[l], &transforms[l]);
          }
          break;
       }
@@ -145,14 +446,17 @@ void game_render_scene(const struct game_t* game, const struct scene_t* scene, c
       {
          if (game_is_option_set(game, GAME_DRAW_LAMPS))
          {
-            struct lamp_t* lamp = world_get_lamp(game->world, node->data);
-            world_render_lamp(game->world, camera, lamp, &node->transform);
+            world_render_lamp(game->world, camera, (const lamp_t*)nodes->data[l], &transforms[l]);
          }
          break;
       }
       }
    }
 
+   if (use_impostors)
+   {
+      impostor_batch_draw(game->impostors, camera);
+   }
 }
 
 int game_init(game_t** pgame, const char* fname)
@@ -168,9 +472,21 @@ int game_init(game_t** pgame, const char* fname)
    memset(game, 0, sizeof(game_t));
    gui_reset(&game->gui);
    game->world = world;
-   game->gui.scene = world_get_scene(world, "GUI_SCN_Default");;
+   game->gui.scene = world_get_scene(world, atom_find("GUI_SCN_Default"));;
+   if (nodes_create(&game->gui.nodes, world, game->gui.scene) != 0)
+   {
+      world_free(world);
+      free(game);
+      return -1;
+   }
+   if (occlusion_create(&game->occlusion, OCCLUSION_WIDTH, OCCLUSION_HEIGHT) != 0)
+   {
+      game->occlusion = NULL;
+   }
+   game->detail_pixels = GAME_DETAIL_PIXELS;
+   game->lod_bias = GAME_LOD_BIAS;
    game_set_scene(game, /*world->scenes[0].name*/"w01d01s01");
-   game_set_option(game, GAME_DRAW_MESHES | GAME_DRAW_LAMPS | GAME_UPDATE_PHYSICS);
+   game_set_option(game, GAME_DRAW_MESHES | GAME_DRAW_LAMPS | GAME_UPDATE_PHYSICS | GAME_CULL_OCCLUDED | GAME_CULL_CLUSTERS | GAME_CULL_DETAIL | GAME_DRAW_IMPOSTORS);
 
    (*pgame) = game;
    return 0;
@@ -211,6 +527,22 @@ void game_free(game_t* game)
       game->resman = NULL;
    }
 
+   if (game->nodes != NULL)
+   {
+      nodes_free(game->nodes);
+   }
+   nodes_free(game->gui.nodes);
+
+   if (game->occlusion != NULL)
+   {
+      occlusion_free(game->occlusion);
+   }
+
+   if (game->impostors != NULL)
+   {
+      impostor_batch_free(game->impostors);
+   }
+
    world_free(game->world);
    free(game);
 }
@@ -223,20 +555,41 @@ int game_restore(game_t* game)
    {
       resman_free(game->resman);
    }
-   return resman_init(&game->resman, game->world);
+
+   if (game->impostors != NULL)
+   {
+      impostor_batch_free(game->impostors);
+      game->impostors = NULL;
+   }
+
+   if (resman_init(&game->resman, game->world) != 0)
+   {
+      return -1;
+   }
+
+   if (game->world->impostors != NULL && impostor_batch_create(&game->impostors, game->world) != 0)
+   {
+      LOGE("Unable to load impostors, distant props are drawn as meshes");
+      game->impostors = NULL;
+   }
+   return 0;
 }
 
+extern struct game_t* game;
+
+// bodies keep their node as user data, physics works with world transforms
 void node_transform_setter(const struct physics_rigid_body_t* b, const mat4f_t* transform, void* user_data)
 {
    struct node_t* node = (struct node_t*)(user_data);
-   //rigidbody_get_transform(b, &node->transform);
-   node->transform = *transform;
+   affine_t world;
+   affine_from_mat4(&world, transform);
+   hierarchy_set_world(game->nodes->hierarchy, node - game->scene->nodes, &world);
 }
 
 void node_transform_getter(const struct physics_rigid_body_t* b, mat4f_t* transform, void* user_data)
 {
    struct node_t* node = (struct node_t*)(user_data);
-   *transform = node->transform;
+   affine_to_mat4(transform, &game->nodes->hierarchy->world[node - game->scene->nodes]);
 }
 
 void game_set_scene(game_t* game, const char* scenename)
@@ -246,14 +599,26 @@ void game_set_scene(game_t* game, const char* scenename)
 
    game_reset_physics(game);
 
-   game->scene = world_get_scene(game->world, scenename);
+   game->scene = world_get_scene(game->world, atom_find(scenename));
    if (game->scene == NULL)
    {
       LOGE("Unable to find scene '%s'", scenename);
       return;
    }
 
-   game->camera = setup_camera(game, game->scene, game->scene->camera);
+   if (game->nodes != NULL)
+   {
+      nodes_free(game->nodes);
+      game->nodes = NULL;
+   }
+
+   if (nodes_create(&game->nodes, game->world, game->scene) != 0)
+   {
+      game->scene = NULL;
+      return;
+   }
+
+   game->camera = setup_camera(game, game->scene, game->nodes, game->scene->camera);
    if (game->camera == NULL)
    {
       return;
@@ -11,6 +11,9 @@ struct resman_t;
 struct node_t;
 struct vec2f_t;
 struct game_t;
+struct nodes_t;
+struct occlusion_t;
+struct impostor_batch_t;
 
 typedef struct game_t
 {
@@ -18,10 +21,22 @@ typedef struct game_t
    struct physics_world_t* phys;
    struct world_t* world;
    struct scene_t* scene;
+   struct nodes_t* nodes;
    struct physics_rigid_body_t** bodies;
    struct camera_t* camera;
+   struct occlusion_t* occlusion;
+   struct impostor_batch_t* impostors;
    struct gui_t gui;
 
+   // nodes smaller than detail_pixels on a viewport of viewport_height
+   // pixels are not drawn, zero height until the first resize disables it
+   int viewport_height;
+   float detail_pixels;
+
+   // meshes switch to a simplified level once its error covers less than
+   // lod_bias pixels, higher bias gives coarser levels
+   float lod_bias;
+
    enum option_t
    {
       GAME_DRAW_MESHES = (1<<0),
@@ -29,6 +44,11 @@ typedef struct game_t
       GAME_DRAW_LAMPS = (1<<2),
       GAME_DRAW_PHYSICS = (1<<3),
       GAME_UPDATE_PHYSICS = (1<<4),
+      GAME_PROFILE_PHYSICS = (1<<5),
+      GAME_CULL_OCCLUDED = (1<<6),
+      GAME_CULL_CLUSTERS = (1<<7),
+      GAME_CULL_DETAIL = (1<<8),
+      GAME_DRAW_IMPOSTORS = (1<<9),
    } game_options;
 } game_t;
 
@@ -37,7 +57,7 @@ void game_free(game_t* game);
 int game_restore(game_t* game);
 void game_update(game_t* game, float dt);
 void game_render(const game_t* game);
-void game_render_scene(const struct game_t* game, const struct scene_t* scene, const struct camera_t* camera);
+void game_render_scene(const struct game_t* game, struct nodes_t* nodes, const struct physics_world_t* phys, const struct camera_t* camera);
 void game_set_scene(game_t* game, const char* scene);
 int game_is_option_set(const game_t* game, int option);
 void game_set_option(game_t* game, int option);
@@ -62,11 +62,11 @@ void gui_dispatch_pointer_down(gui_t* gui, long pointer_id, const vec2f_t* point
 
    pointer->state = POINTER_DOWN;
    pointer->point = *point;
-   pointer->control = (control_t*)scene_pick_node(game->world, gui->scene, &pointer->point);
+   pointer->control = (control_t*)scene_pick_node(game->world, gui->scene, gui->nodes, &pointer->point);
 
    if (pointer->control != NULL)
    {
-      LOGI("POINTER DOWN ON %s", pointer->control->name);
+      LOGI("POINTER DOWN ON %s", atom_name(pointer->control->name));
       gui_invoke_handlers(gui, pointer->control, ACTION_DOWN, &pointer->point);
    }
 }
@@ -78,11 +78,11 @@ void gui_dispatch_pointer_up(gui_t* gui, long pointer_id, const struct vec2f_t*
 
    pointer->state = POINTER_UP;
    pointer->point = *point;
-   pointer->control = (control_t*)scene_pick_node(game->world, gui->scene, &pointer->point);
+   pointer->control = (control_t*)scene_pick_node(game->world, gui->scene, gui->nodes, &pointer->point);
 
    if (pointer->control != NULL)
    {
-      LOGI("POINTER UP ON %s", pointer->control->name);
+      LOGI("POINTER UP ON %s", atom_name(pointer->control->name));
       gui_invoke_handlers(gui, pointer->control, ACTION_UP, &pointer->point);
    }
 }
@@ -95,32 +95,32 @@ void gui_dispatch_pointer_move(gui_t* gui, long pointer_id, const struct vec2f_t
    control_t* old_control = pointer->control;
 
    pointer->point = *point;
-   pointer->control = (control_t*)scene_pick_node(game->world, gui->scene, &pointer->point);
+   pointer->control = (control_t*)scene_pick_node(game->world, gui->scene, gui->nodes, &pointer->point);
 
    if (old_control != pointer->control)
    {
       if (old_control != NULL)
       {
-         LOGI("POINTER LEAVED FROM %s", old_control->name);
+         LOGI("POINTER LEAVED FROM %s", atom_name(old_control->name));
          gui_invoke_handlers(gui, old_control, ACTION_LEAVE, &pointer->point);
       }
 
       if (pointer->control != NULL)
       {
-         LOGI("POINTER ENTERED TO %s", pointer->control->name);
+         LOGI("POINTER ENTERED TO %s", atom_name(pointer->control->name));
          gui_invoke_handlers(gui, pointer->control, ACTION_ENTER, &pointer->point);
       }
    }
 
    if (pointer->control != NULL)
    {
-      LOGI("POINTER MOVED OVER %s", pointer->control->name);
+      LOGI("POINTER MOVED OVER %s", atom_name(pointer->control->name));
       gui_invoke_handlers(gui, pointer->control, ACTION_MOVE, &pointer->point);
    }
 }
 
 control_t* gui_get_control(gui_t* gui, const char* name)
 {
-   return (control_t*)scene_get_node(gui->scene, name);
+   return (control_t*)scene_get_node(gui->scene, atom_find(name));
 }
 
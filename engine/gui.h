@@ -8,6 +8,7 @@
 struct node_t;
 struct scene_t;
 struct gui_t;
+struct nodes_t;
 
 typedef struct node_t control_t;
 
@@ -57,6 +58,7 @@ typedef struct gui_t
    long nhandlers;
 
    struct scene_t* scene;
+   struct nodes_t* nodes;
    struct handler_t handlers[MAX_HANDLERS];
    struct pointer_t pointers[MAX_POINTERS];
 } gui_t;
@@ -0,0 +1,129 @@
+#include "hierarchy.h"
+#include "world.h"
+#include "common.h"
+
+int hierarchy_create(hierarchy_t** phierarchy, const struct scene_t* scene)
+{
+   long nnodes = scene->nnodes;
+
+   hierarchy_t* hierarchy = (hierarchy_t*)malloc(sizeof(hierarchy_t));
+   memset(hierarchy, 0, sizeof(hierarchy_t));
+
+   hierarchy->nnodes = nnodes;
+   hierarchy->first_dirty = 0;
+   hierarchy->parents = (long*)malloc(nnodes * sizeof(long));
+   hierarchy->local = (affine_t*)malloc(nnodes * sizeof(affine_t));
+   hierarchy->world = (affine_t*)malloc(nnodes * sizeof(affine_t));
+   hierarchy->dirty = (unsigned char*)malloc(nnodes * sizeof(unsigned char));
+
+   long l = 0;
+   for (l = 0; l < nnodes; ++l)
+   {
+      const node_t* node = &scene->nodes[l];
+      if (node->parent_index >= l)
+      {
+         LOGE("Node '%s' is stored before its parent %ld", atom_name(node->name), node->parent_index);
+         hierarchy_free(hierarchy);
+         return -1;
+      }
+
+      hierarchy->parents[l] = node->parent_index;
+      affine_from_mat4(&hierarchy->local[l], &node->transform);
+      hierarchy->dirty[l] = 1;
+   }
+
+   hierarchy_clear_dirty(hierarchy, hierarchy_update(hierarchy));
+
+   (*phierarchy) = hierarchy;
+   return 0;
+}
+
+void hierarchy_free(hierarchy_t* hierarchy)
+{
+   free(hierarchy->parents);
+   free(hierarchy->local);
+   free(hierarchy->world);
+   free(hierarchy->dirty);
+   free(hierarchy);
+}
+
+static void hierarchy_mark_dirty(hierarchy_t* hierarchy, long index)
+{
+   hierarchy->dirty[index] = 1;
+   if (index < hierarchy->first_dirty)
+   {
+      hierarchy->first_dirty = index;
+   }
+}
+
+void hierarchy_set_local(hierarchy_t* hierarchy, long index, const affine_t* local)
+{
+   hierarchy->local[index] = *local;
+   hierarchy_mark_dirty(hierarchy, index);
+}
+
+// The local transform is derived from the current world transform of the
+// parent, which lags behind by one update if the parent is dirty too.
+void hierarchy_set_world(hierarchy_t* hierarchy, long index, const affine_t* world)
+{
+   long parent = hierarchy->parents[index];
+   if (parent < 0)
+   {
+      hierarchy->local[index] = *world;
+   }
+   else
+   {
+      affine_t inverse;
+      affine_inverted(&inverse, &hierarchy->world[parent]);
+      affine_mult(&hierarchy->local[index], &inverse, world);
+   }
+
+   hierarchy->world[index] = *world;
+   hierarchy_mark_dirty(hierarchy, index);
+}
+
+// returns the first node whose world transform may have changed, nnodes if
+// none did. The dirty flags of the updated nodes stay set so callers can tell
+// which nodes moved, hierarchy_clear_dirty has to follow before the next
+// change.
+long hierarchy_update(hierarchy_t* hierarchy)
+{
+   long first = hierarchy->first_dirty;
+   long nnodes = hierarchy->nnodes;
+   if (first >= nnodes)
+   {
+      return nnodes;
+   }
+
+   const long* parents = hierarchy->parents;
+   unsigned char* dirty = hierarchy->dirty;
+
+   long l = 0;
+   for (l = first; l < nnodes; ++l)
+   {
+      long parent = parents[l];
+      if (parent >= 0)
+      {
+         dirty[l] |= dirty[parent];
+         if (dirty[l])
+         {
+            affine_mult(&hierarchy->world[l], &hierarchy->world[parent], &hierarchy->local[l]);
+         }
+      }
+      else if (dirty[l])
+      {
+         hierarchy->world[l] = hierarchy->local[l];
+      }
+   }
+
+   hierarchy->first_dirty = nnodes;
+   return first;
+}
+
+void hierarchy_clear_dirty(hierarchy_t* hierarchy, long first)
+{
+   if (first < hierarchy->nnodes)
+   {
+      memset(&hierarchy->dirty[first], 0, (hierarchy->nnodes - first) * sizeof(unsigned char));
+   }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "mathlib.h"
+
+struct scene_t;
+
+// Local and world transforms of the nodes of a scene. Nodes are stored parent
+// before child (the exporter writes them in that order), so one forward pass
+// recomputes the world transforms of every changed node and its subtree.
+typedef struct hierarchy_t
+{
+   long nnodes;
+   long first_dirty;
+
+   long* parents;
+   affine_t* local;
+   affine_t* world;
+   unsigned char* dirty;
+} hierarchy_t;
+
+int hierarchy_create(hierarchy_t** phierarchy, const struct scene_t* scene);
+void hierarchy_free(hierarchy_t* hierarchy);
+void hierarchy_set_local(hierarchy_t* hierarchy, long index, const affine_t* local);
+void hierarchy_set_world(hierarchy_t* hierarchy, long index, const affine_t* world);
+long hierarchy_update(hierarchy_t* hierarchy);
+void hierarchy_clear_dirty(hierarchy_t* hierarchy, long first);
@@ -0,0 +1,177 @@
+#include "impostor.h"
+#include "common.h"
+#include "world.h"
+#include "camera.h"
+#include "image.h"
+#include "tex2d.h"
+#include "shader.h"
+#include "gl_defs.h"
+
+int impostor_batch_create(impostor_batch_t** pbatch, const struct world_t* world)
+{
+   const impostor_atlas_t* atlas = world->impostors;
+   if (atlas == NULL)
+   {
+      return -1;
+   }
+
+   image_t* image = NULL;
+   if (image_load(&image, atlas->path) != 0)
+   {
+      return -1;
+   }
+
+   tex2d_t* texture = NULL;
+   if (tex2d_create(&texture, image, GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE) != 0)
+   {
+      image_free(image);
+      return -1;
+   }
+   image_free(image);
+
+   shader_t* shader = NULL;
+   if (shader_load(&shader, "shaders/impostor.shader") != 0)
+   {
+      tex2d_free(texture);
+      return -1;
+   }
+
+   impostor_batch_t* batch = (impostor_batch_t*)malloc(sizeof(impostor_batch_t));
+   memset(batch, 0, sizeof(impostor_batch_t));
+   batch->world = world;
+   batch->atlas = atlas;
+   batch->texture = texture;
+   batch->shader = shader;
+
+   batch->meshes = (const impostor_t**)malloc((world->nmeshes + 1) * sizeof(impostor_t*));
+   memset(batch->meshes, 0, (world->nmeshes + 1) * sizeof(impostor_t*));
+
+   long l = 0;
+   for (l = 0; l < atlas->nimpostors; ++l)
+   {
+      const impostor_t* impostor = &atlas->impostors[l];
+      if (impostor->mesh < world->nmeshes)
+      {
+         batch->meshes[impostor->mesh] = impostor;
+      }
+   }
+
+   batch->vertices = (impostor_vertex_t*)malloc(IMPOSTOR_MAX_QUADS * 4 * sizeof(impostor_vertex_t));
+   batch->indices = (unsigned short*)malloc(IMPOSTOR_MAX_QUADS * 6 * sizeof(unsigned short));
+   for (l = 0; l < IMPOSTOR_MAX_QUADS; ++l)
+   {
+      unsigned short* index = &batch->indices[l * 6];
+      unsigned short first = (unsigned short)(l * 4);
+      index[0] = first;
+      index[1] = first + 1;
+      index[2] = first + 2;
+      index[3] = first;
+      index[4] = first + 2;
+      index[5] = first + 3;
+   }
+
+   LOGI("Impostor atlas '%s' has %ld meshes in %ld views", atlas->path, atlas->nimpostors, atlas->nviews);
+
+   (*pbatch) = batch;
+   return 0;
+}
+
+void impostor_batch_free(impostor_batch_t* batch)
+{
+   tex2d_free(batch->texture);
+   shader_free(batch->shader);
+   free(batch->meshes);
+   free(batch->vertices);
+   free(batch->indices);
+   free(batch);
+}
+
+// queues the quad of a mesh seen from eye, returns -1 if the mesh has no
+// impostor or the batch is full and the mesh has to be drawn
+int impostor_batch_add(impostor_batch_t* batch, const struct mesh_t* mesh, const affine_t* transform, const vec3f_t* eye)
+{
+   const impostor_t* impostor = batch->meshes[mesh - batch->world->meshes];
+   if (impostor == NULL || batch->nquads >= IMPOSTOR_MAX_QUADS)
+   {
+      return -1;
+   }
+
+   const affine_t* m = transform;
+   vec3f_t x = { m->m11, m->m21, m->m31 };
+   vec3f_t y = { m->m12, m->m22, m->m32 };
+   vec3f_t axis = { m->m13, m->m23, m->m33 };
+
+   vec3f_t center;
+   affine_mult_vec3(&center, transform, &impostor->center);
+
+   // the quad turns around the z axis of the node, seen from along the axis
+   // there is no side to show
+   float scale = sqrtf(vec3_dot(&axis, &axis));
+   vec3f_t forward;
+   vec3f_t right;
+   vec3_sub(&forward, &center, eye);
+   vec3_cross(&right, &forward, &axis);
+   float length = sqrtf(vec3_dot(&right, &right));
+   if (length < 1e-6f * scale)
+   {
+      return -1;
+   }
+
+   float size = impostor->radius * scale;
+   vec3f_t up;
+   vec3_scale(&right, &right, size / length);
+   vec3_scale(&up, &axis, size / scale);
+
+   // view closest to the direction of the eye in mesh space
+   float azimuth = atan2f(-vec3_dot(&forward, &y) / vec3_dot(&y, &y), -vec3_dot(&forward, &x) / vec3_dot(&x, &x));
+   long nviews = batch->atlas->nviews;
+   long view = (long)floorf(azimuth / (2.0f * M_PI) * nviews + 0.5f);
+   view = ((view % nviews) + nviews) % nviews;
+
+   float u0 = view * batch->atlas->tile_u;
+   float u1 = u0 + batch->atlas->tile_u;
+
+   impostor_vertex_t* v = &batch->vertices[batch->nquads * 4];
+   vec3_sub(&v[0].point, vec3_sub(&v[0].point, &center, &right), &up);
+   vec3_sub(&v[1].point, vec3_add(&v[1].point, &center, &right), &up);
+   vec3_add(&v[2].point, vec3_add(&v[2].point, &center, &right), &up);
+   vec3_add(&v[3].point, vec3_sub(&v[3].point, &center, &right), &up);
+   v[0].uv.x = u0;
+   v[0].uv.y = impostor->v0;
+   v[1].uv.x = u1;
+   v[1].uv.y = impostor->v0;
+   v[2].uv.x = u1;
+   v[2].uv.y = impostor->v1;
+   v[3].uv.x = u0;
+   v[3].uv.y = impostor->v1;
+
+   ++batch->nquads;
+   return 0;
+}
+
+// draws the queued quads in one call and empties the batch
+void impostor_batch_draw(impostor_batch_t* batch, const struct camera_t* camera)
+{
+   if (batch->nquads == 0)
+   {
+      return;
+   }
+
+   mat4f_t mvp;
+   mat4_mult(&mvp, &camera->proj, &camera->view);
+
+   shader_t* shader = batch->shader;
+   int sampler = 0;
+
+   shader_use(shader);
+   shader_set_uniform_matrices(shader, ATOM_uMVP, 1, mat4_data(&mvp));
+   shader_set_uniform_integers(shader, ATOM_uTex, 1, &sampler);
+   shader_set_attrib_vertices(shader, ATOM_aPos, 3, GL_FLOAT, sizeof(impostor_vertex_t), &batch->vertices[0].point);
+   shader_set_attrib_vertices(shader, ATOM_aTexCoord, 2, GL_FLOAT, sizeof(impostor_vertex_t), &batch->vertices[0].uv);
+   tex2d_bind(batch->texture, sampler);
+
+   glDrawElements(GL_TRIANGLES, batch->nquads * 6, GL_UNSIGNED_SHORT, batch->indices);
+
+   shader_unuse(shader);
+   batch->nquads = 0;
+}
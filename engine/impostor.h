@@ -0,0 +1,71 @@
+#pragma once
+
+#include "mathlib.h"
+
+struct world_t;
+struct mesh_t;
+struct camera_t;
+struct tex2d_t;
+struct shader_t;
+
+#define IMPOSTOR_PATH_SIZE 64
+#define IMPOSTOR_MAX_QUADS 1024
+
+// Camera facing quads standing in for distant props, baked by
+// tools/impostor_bake. Each mesh is rendered from nviews directions around its
+// z axis into a row of the atlas, view i looking from azimuth 2 pi i / nviews.
+// Quads turn around the z axis of their node and show the closest view.
+typedef struct impostor_t
+{
+   // index into world->meshes
+   unsigned long mesh;
+
+   // mesh space center and half size of the quad, rows of the atlas in
+   // texture coordinates
+   vec3f_t center;
+   float radius;
+   float v0;
+   float v1;
+} impostor_t;
+
+typedef struct impostor_atlas_t
+{
+   char path[IMPOSTOR_PATH_SIZE];
+
+   // nodes farther than this are drawn as impostors
+   float distance;
+
+   unsigned long nviews;
+   float tile_u;
+
+   unsigned long nimpostors;
+   struct impostor_t* impostors;
+} impostor_atlas_t;
+
+typedef struct impostor_vertex_t
+{
+   vec3f_t point;
+   vec2f_t uv;
+} impostor_vertex_t;
+
+// quads of one frame, drawn with a single call
+typedef struct impostor_batch_t
+{
+   const struct world_t* world;
+   const impostor_atlas_t* atlas;
+
+   // impostor of every mesh of the world, NULL for meshes without one
+   const impostor_t** meshes;
+
+   struct tex2d_t* texture;
+   struct shader_t* shader;
+
+   long nquads;
+   impostor_vertex_t* vertices;
+   unsigned short* indices;
+} impostor_batch_t;
+
+int impostor_batch_create(impostor_batch_t** pbatch, const struct world_t* world);
+void impostor_batch_free(impostor_batch_t* batch);
+int impostor_batch_add(impostor_batch_t* batch, const struct mesh_t* mesh, const affine_t* transform, const vec3f_t* eye);
+void impostor_batch_draw(impostor_batch_t* batch, const struct camera_t* camera);
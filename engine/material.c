@@ -13,10 +13,10 @@ void material_bind(const material_t* material, int sampler_id)
    tex2d_t* tex2d = resman_get_texture(game->resman, material->texture);
 
    shader_use(shader);
-   shader_set_uniform_integers(shader, "uTex", 1, &sampler_id);
-   shader_set_uniform_vectors(shader, "uMatDiffuse", 1, &material->diffuse.x);
-   shader_set_uniform_vectors(shader, "uMatSpecular", 1, &material->specular.x);
-   shader_set_uniform_floats(shader, "uMatShininess", 1, &material->shininess);
+   shader_set_uniform_integers(shader, ATOM_uTex, 1, &sampler_id);
+   shader_set_uniform_vectors(shader, ATOM_uMatDiffuse, 1, &material->diffuse.x);
+   shader_set_uniform_vectors(shader, ATOM_uMatSpecular, 1, &material->specular.x);
+   shader_set_uniform_floats(shader, ATOM_uMatShininess, 1, &material->shininess);
 
    tex2d_bind(tex2d, sampler_id);
 }
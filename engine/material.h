@@ -1,14 +1,15 @@
 #pragma once
 
 #include "mathlib.h"
+#include "atom.h"
 
 typedef struct vec3f_t color_t;
 
 typedef struct material_t
 {
-   char name[64];
-   char shader[64];
-   char texture[64];
+   atom_t name;
+   atom_t shader;
+   atom_t texture;
 
    color_t diffuse;
    color_t specular;
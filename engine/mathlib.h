@@ -38,6 +38,32 @@ typedef union
    };
 } mat4f_t;
 
+// 3x3 matrix, column major like mat4f_t
+typedef union
+{
+   float m[9];
+   struct
+   {
+      float m11, m21, m31;
+      float m12, m22, m32;
+      float m13, m23, m33;
+   };
+} mat3f_t;
+
+// affine transform, the upper 3x4 part of a mat4f_t with an implicit
+// (0, 0, 0, 1) bottom row, stored column major
+typedef union
+{
+   float m[12];
+   struct
+   {
+      float m11, m21, m31;
+      float m12, m22, m32;
+      float m13, m23, m33;
+      float m14, m24, m34;
+   };
+} affine_t;
+
 typedef vec4f_t quat_t;
 typedef vec4f_t plane_t;
 
@@ -71,6 +97,26 @@ void mat4_set_lookat(mat4f_t* m, const vec3f_t* eye, const vec3f_t* at, const ve
 const float* mat4_data(const mat4f_t* m);
 void mat4_from_quaternion(mat4f_t* m, const quat_t* q);
 
+// scalar reference implementations, the functions above use SIMD when available
+float mat4_determinant_scalar(const mat4f_t* m);
+void mat4_invert_scalar(mat4f_t* m);
+void mat4_mult_scalar(mat4f_t* m, const mat4f_t* a, const mat4f_t* b);
+void mat4_mult_vec3_scalar(vec3f_t* r, const mat4f_t* m, const vec3f_t* a);
+void mat4_mult_vec4_scalar(vec4f_t* r, const mat4f_t* m, const vec4f_t* a);
+void mat4_mult_affine_scalar(mat4f_t* m, const mat4f_t* a, const affine_t* b);
+
+void affine_set_identity(affine_t* m);
+void affine_from_mat4(affine_t* m, const mat4f_t* a);
+void affine_to_mat4(mat4f_t* m, const affine_t* a);
+void affine_mult(affine_t* m, const affine_t* a, const affine_t* b);
+void affine_mult_vec3(vec3f_t* r, const affine_t* m, const vec3f_t* a);
+void affine_inverted(affine_t* m, const affine_t* a);
+void affine_normal_matrix(mat3f_t* m, const affine_t* a);
+void mat4_mult_affine(mat4f_t* m, const mat4f_t* a, const affine_t* b);
+void affine_mult_batch(affine_t* r, const affine_t* a, const affine_t* b, long n);
+void affine_transform_points(vec3f_t* r, const affine_t* m, const vec3f_t* points, long n);
+void mat4_from_mat3(mat4f_t* m, const mat3f_t* a);
+
 quat_t* quat_from_matrix(quat_t* r, const mat4f_t* m);
 quat_t* quat_from_angles(quat_t* r, const vec3f_t* a);
 vec3f_t* quat_to_angles(vec3f_t* r, const quat_t* q);
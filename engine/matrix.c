@@ -32,7 +32,7 @@ void mat4_transposed(mat4f_t* m, const mat4f_t* a)
    mat4_transpose(m);
 }
 
-float mat4_determinant(const mat4f_t* m)
+float mat4_determinant_scalar(const mat4f_t* m)
 {
    float det =
       m->m14*m->m23*m->m32*m->m41 - m->m13*m->m24*m->m32*m->m41 - m->m14*m->m22*m->m33*m->m41 + m->m12*m->m24*m->m33*m->m41 +
@@ -53,9 +53,9 @@ void mat4_scale(mat4f_t* m, float scale)
    }
 }
 
-void mat4_invert(mat4f_t* m)
+void mat4_invert_scalar(mat4f_t* m)
 {
-   float det = mat4_determinant(m);
+   float det = mat4_determinant_scalar(m);
 
    mat4f_t tmp;
    tmp.m11 = m->m23*m->m34*m->m42 - m->m24*m->m33*m->m42 + m->m24*m->m32*m->m43 - m->m22*m->m34*m->m43 - m->m23*m->m32*m->m44 + m->m22*m->m33*m->m44;
@@ -254,7 +254,7 @@ void mat4_set_lookat(mat4f_t* m, const vec3f_t* eye, const vec3f_t* at, const ve
    mat4_mult(m, &r, &t);
 }
 
-void mat4_mult(mat4f_t* m, const mat4f_t* a, const mat4f_t* b)
+void mat4_mult_scalar(mat4f_t* m, const mat4f_t* a, const mat4f_t* b)
 {
    m->m11 = a->m11*b->m11 + a->m12*b->m21 + a->m13*b->m31 + a->m14*b->m41;
    m->m12 = a->m11*b->m12 + a->m12*b->m22 + a->m13*b->m32 + a->m14*b->m42;
@@ -317,14 +317,14 @@ void mat4_from_quaternion(mat4f_t* m, const quat_t* q)
    m->m44 = 1.0f;
 }
 
-void mat4_mult_vec3(vec3f_t* r, const mat4f_t* m, const vec3f_t* a)
+void mat4_mult_vec3_scalar(vec3f_t* r, const mat4f_t* m, const vec3f_t* a)
 {
    r->x = m->m11 * a->x + m->m12 * a->y + m->m13 * a->z + m->m14;
    r->y = m->m21 * a->x + m->m22 * a->y + m->m23 * a->z + m->m24;
    r->z = m->m31 * a->x + m->m32 * a->y + m->m33 * a->z + m->m34;
 }
 
-void mat4_mult_vec4(vec4f_t* r, const mat4f_t* m, const vec4f_t* a)
+void mat4_mult_vec4_scalar(vec4f_t* r, const mat4f_t* m, const vec4f_t* a)
 {
    r->x = m->m11 * a->x + m->m12 * a->y + m->m13 * a->z + m->m14 * a->w;
    r->y = m->m21 * a->x + m->m22 * a->y + m->m23 * a->z + m->m24 * a->w;
@@ -0,0 +1,289 @@
+#include "mathlib.h"
+#include "simd.h"
+
+#ifdef MATHLIB_SIMD
+
+// Cofactors of a 4x4 matrix following Intel's "Streaming SIMD Extensions -
+// Inverse of 4x4 Matrix" (AP-928). The math is the same for row and column
+// major data, minor[i] is the i-th column (or row) of the adjugate.
+static inline void mat4_cofactors(const mat4f_t* m, v4f* row0, v4f* minor)
+{
+   v4f row[4];
+   v4f tmp;
+   v4f minor0, minor1, minor2, minor3;
+
+   v4f_load_transposed(m->m, row);
+   v4f r0 = row[0];
+   v4f r1 = v4f_swap_halves(row[1]);
+   v4f r2 = row[2];
+   v4f r3 = v4f_swap_halves(row[3]);
+
+   tmp = v4f_swap_pairs(v4f_mul(r2, r3));
+   minor0 = v4f_mul(r1, tmp);
+   minor1 = v4f_mul(r0, tmp);
+   tmp = v4f_swap_halves(tmp);
+   minor0 = v4f_sub(v4f_mul(r1, tmp), minor0);
+   minor1 = v4f_swap_halves(v4f_sub(v4f_mul(r0, tmp), minor1));
+
+   tmp = v4f_swap_pairs(v4f_mul(r1, r2));
+   minor0 = v4f_madd(r3, tmp, minor0);
+   minor3 = v4f_mul(r0, tmp);
+   tmp = v4f_swap_halves(tmp);
+   minor0 = v4f_sub(minor0, v4f_mul(r3, tmp));
+   minor3 = v4f_swap_halves(v4f_sub(v4f_mul(r0, tmp), minor3));
+
+   tmp = v4f_swap_pairs(v4f_mul(v4f_swap_halves(r1), r3));
+   r2 = v4f_swap_halves(r2);
+   minor0 = v4f_madd(r2, tmp, minor0);
+   minor2 = v4f_mul(r0, tmp);
+   tmp = v4f_swap_halves(tmp);
+   minor0 = v4f_sub(minor0, v4f_mul(r2, tmp));
+   minor2 = v4f_swap_halves(v4f_sub(v4f_mul(r0, tmp), minor2));
+
+   tmp = v4f_swap_pairs(v4f_mul(r0, r1));
+   minor2 = v4f_madd(r3, tmp, minor2);
+   minor3 = v4f_sub(v4f_mul(r2, tmp), minor3);
+   tmp = v4f_swap_halves(tmp);
+   minor2 = v4f_sub(v4f_mul(r3, tmp), minor2);
+   minor3 = v4f_sub(minor3, v4f_mul(r2, tmp));
+
+   tmp = v4f_swap_pairs(v4f_mul(r0, r3));
+   minor1 = v4f_sub(minor1, v4f_mul(r2, tmp));
+   minor2 = v4f_madd(r1, tmp, minor2);
+   tmp = v4f_swap_halves(tmp);
+   minor1 = v4f_madd(r2, tmp, minor1);
+   minor2 = v4f_sub(minor2, v4f_mul(r1, tmp));
+
+   tmp = v4f_swap_pairs(v4f_mul(r0, r2));
+   minor1 = v4f_madd(r3, tmp, minor1);
+   minor3 = v4f_sub(minor3, v4f_mul(r1, tmp));
+   tmp = v4f_swap_halves(tmp);
+   minor1 = v4f_sub(minor1, v4f_mul(r3, tmp));
+   minor3 = v4f_madd(r1, tmp, minor3);
+
+   (*row0) = r0;
+   minor[0] = minor0;
+   minor[1] = minor1;
+   minor[2] = minor2;
+   minor[3] = minor3;
+}
+
+static inline v4f dot_splat(v4f a, v4f b)
+{
+   v4f d = v4f_mul(a, b);
+   d = v4f_add(v4f_swap_halves(d), d);
+   return v4f_add(v4f_swap_pairs(d), d);
+}
+
+float mat4_determinant(const mat4f_t* m)
+{
+   v4f row0;
+   v4f minor[4];
+   mat4_cofactors(m, &row0, minor);
+
+   float det[4];
+   v4f_store(det, dot_splat(row0, minor[0]));
+   return det[0];
+}
+
+void mat4_invert(mat4f_t* m)
+{
+   v4f row0;
+   v4f minor[4];
+   mat4_cofactors(m, &row0, minor);
+
+   // exact division keeps the result within rounding of the scalar code,
+   // a reciprocal estimate would not
+   float det[4];
+   v4f_store(det, dot_splat(row0, minor[0]));
+   v4f invdet = v4f_splat(1.0f / det[0]);
+
+   v4f_store(&m->m[0], v4f_mul(minor[0], invdet));
+   v4f_store(&m->m[4], v4f_mul(minor[1], invdet));
+   v4f_store(&m->m[8], v4f_mul(minor[2], invdet));
+   v4f_store(&m->m[12], v4f_mul(minor[3], invdet));
+}
+
+void mat4_mult(mat4f_t* m, const mat4f_t* a, const mat4f_t* b)
+{
+   v4f a0 = v4f_load(&a->m[0]);
+   v4f a1 = v4f_load(&a->m[4]);
+   v4f a2 = v4f_load(&a->m[8]);
+   v4f a3 = v4f_load(&a->m[12]);
+
+   // every column of the result is a combination of the columns of a
+   int i = 0;
+   for (i = 0; i < 16; i += 4)
+   {
+      v4f r = v4f_mul(a0, v4f_splat(b->m[i]));
+      r = v4f_madd(a1, v4f_splat(b->m[i + 1]), r);
+      r = v4f_madd(a2, v4f_splat(b->m[i + 2]), r);
+      r = v4f_madd(a3, v4f_splat(b->m[i + 3]), r);
+      v4f_store(&m->m[i], r);
+   }
+}
+
+void mat4_mult_vec3(vec3f_t* r, const mat4f_t* m, const vec3f_t* a)
+{
+   v4f v = v4f_load(&m->m[12]);
+   v = v4f_madd(v4f_load(&m->m[0]), v4f_splat(a->x), v);
+   v = v4f_madd(v4f_load(&m->m[4]), v4f_splat(a->y), v);
+   v = v4f_madd(v4f_load(&m->m[8]), v4f_splat(a->z), v);
+
+   float t[4];
+   v4f_store(t, v);
+   r->x = t[0];
+   r->y = t[1];
+   r->z = t[2];
+}
+
+void mat4_mult_vec4(vec4f_t* r, const mat4f_t* m, const vec4f_t* a)
+{
+   v4f v = v4f_mul(v4f_load(&m->m[0]), v4f_splat(a->x));
+   v = v4f_madd(v4f_load(&m->m[4]), v4f_splat(a->y), v);
+   v = v4f_madd(v4f_load(&m->m[8]), v4f_splat(a->z), v);
+   v = v4f_madd(v4f_load(&m->m[12]), v4f_splat(a->w), v);
+   v4f_store(&r->x, v);
+}
+
+void mat4_mult_affine(mat4f_t* m, const mat4f_t* a, const affine_t* b)
+{
+   v4f a0 = v4f_load(&a->m[0]);
+   v4f a1 = v4f_load(&a->m[4]);
+   v4f a2 = v4f_load(&a->m[8]);
+   v4f a3 = v4f_load(&a->m[12]);
+
+   // the implicit last row of b saves a quarter of mat4_mult
+   int i = 0;
+   for (i = 0; i < 4; ++i)
+   {
+      v4f c = v4f_mul(a0, v4f_splat(b->m[3*i]));
+      c = v4f_madd(a1, v4f_splat(b->m[3*i + 1]), c);
+      c = v4f_madd(a2, v4f_splat(b->m[3*i + 2]), c);
+      v4f_store(&m->m[4*i], (i == 3) ? v4f_add(c, a3) : c);
+   }
+}
+
+// r[i] = a * b[i], the columns of a stay in registers for the whole array
+void affine_mult_batch(affine_t* r, const affine_t* a, const affine_t* b, long n)
+{
+   v4f a0 = v4f_load(&a->m[0]);
+   v4f a1 = v4f_load(&a->m[3]);
+   v4f a2 = v4f_load(&a->m[6]);
+   v4f a3 = v4f_set(a->m14, a->m24, a->m34, 0.0f);
+
+   long l = 0;
+   for (l = 0; l < n; ++l)
+   {
+      // read all of b[l] first, r may alias b
+      affine_t m = b[l];
+
+      v4f c0 = v4f_mul(a0, v4f_splat(m.m11));
+      c0 = v4f_madd(a1, v4f_splat(m.m21), c0);
+      c0 = v4f_madd(a2, v4f_splat(m.m31), c0);
+
+      v4f c1 = v4f_mul(a0, v4f_splat(m.m12));
+      c1 = v4f_madd(a1, v4f_splat(m.m22), c1);
+      c1 = v4f_madd(a2, v4f_splat(m.m32), c1);
+
+      v4f c2 = v4f_mul(a0, v4f_splat(m.m13));
+      c2 = v4f_madd(a1, v4f_splat(m.m23), c2);
+      c2 = v4f_madd(a2, v4f_splat(m.m33), c2);
+
+      v4f c3 = v4f_madd(a0, v4f_splat(m.m14), a3);
+      c3 = v4f_madd(a1, v4f_splat(m.m24), c3);
+      c3 = v4f_madd(a2, v4f_splat(m.m34), c3);
+
+      // the fourth lane of each column store is overwritten by the next one,
+      // the last column goes through a temporary to stay inside r[l]
+      float t[4];
+      v4f_store(&r[l].m[0], c0);
+      v4f_store(&r[l].m[3], c1);
+      v4f_store(&r[l].m[6], c2);
+      v4f_store(t, c3);
+      r[l].m14 = t[0];
+      r[l].m24 = t[1];
+      r[l].m34 = t[2];
+   }
+}
+
+void affine_transform_points(vec3f_t* r, const affine_t* m, const vec3f_t* points, long n)
+{
+   v4f c0 = v4f_load(&m->m[0]);
+   v4f c1 = v4f_load(&m->m[3]);
+   v4f c2 = v4f_load(&m->m[6]);
+   v4f c3 = v4f_set(m->m14, m->m24, m->m34, 0.0f);
+
+   if (n <= 0)
+   {
+      return;
+   }
+
+   // every store spills one float into the next point, which is read ahead
+   // so the transform also works in place
+   vec3f_t p = points[0];
+   long l = 0;
+   for (l = 0; l < n - 1; ++l)
+   {
+      vec3f_t next = points[l + 1];
+      v4f v = v4f_madd(c0, v4f_splat(p.x), c3);
+      v = v4f_madd(c1, v4f_splat(p.y), v);
+      v = v4f_madd(c2, v4f_splat(p.z), v);
+      v4f_store(&r[l].x, v);
+      p = next;
+   }
+
+   affine_mult_vec3(&r[l], m, &p);
+}
+
+#else
+
+float mat4_determinant(const mat4f_t* m)
+{
+   return mat4_determinant_scalar(m);
+}
+
+void mat4_invert(mat4f_t* m)
+{
+   mat4_invert_scalar(m);
+}
+
+void mat4_mult(mat4f_t* m, const mat4f_t* a, const mat4f_t* b)
+{
+   mat4_mult_scalar(m, a, b);
+}
+
+void mat4_mult_vec3(vec3f_t* r, const mat4f_t* m, const vec3f_t* a)
+{
+   mat4_mult_vec3_scalar(r, m, a);
+}
+
+void mat4_mult_vec4(vec4f_t* r, const mat4f_t* m, const vec4f_t* a)
+{
+   mat4_mult_vec4_scalar(r, m, a);
+}
+
+void mat4_mult_affine(mat4f_t* m, const mat4f_t* a, const affine_t* b)
+{
+   mat4_mult_affine_scalar(m, a, b);
+}
+
+void affine_mult_batch(affine_t* r, const affine_t* a, const affine_t* b, long n)
+{
+   long l = 0;
+   for (l = 0; l < n; ++l)
+   {
+      affine_mult(&r[l], a, &b[l]);
+   }
+}
+
+void affine_transform_points(vec3f_t* r, const affine_t* m, const vec3f_t* points, long n)
+{
+   long l = 0;
+   for (l = 0; l < n; ++l)
+   {
+      affine_mult_vec3(&r[l], m, &points[l]);
+   }
+}
+
+#endif
@@ -0,0 +1,177 @@
+#include "nodes.h"
+#include "hierarchy.h"
+#include "bvh.h"
+#include "pvs.h"
+#include "world.h"
+#include "common.h"
+
+static void* nodes_resolve_data(const world_t* world, const node_t* node)
+{
+   switch (node->type)
+   {
+   case NODE_MESH:
+      return world_get_mesh(world, node->data);
+   case NODE_CAMERA:
+      return world_get_camera(world, node->data);
+   case NODE_LAMP:
+      return world_get_lamp(world, node->data);
+   }
+   return NULL;
+}
+
+// picking grows boxes by one unit along the local y axis of the node, which
+// grows the world box by the absolute second column of its transform
+static void nodes_update_pick_margin(nodes_t* nodes, long index)
+{
+   const affine_t* m = &nodes->hierarchy->world[index];
+   nodes->pick_margin = fmaxf(nodes->pick_margin, fabsf(m->m12));
+   nodes->pick_margin = fmaxf(nodes->pick_margin, fabsf(m->m22));
+   nodes->pick_margin = fmaxf(nodes->pick_margin, fabsf(m->m32));
+}
+
+int nodes_create(nodes_t** pnodes, const struct world_t* world, const struct scene_t* scene)
+{
+   long nnodes = scene->nnodes;
+
+   nodes_t* nodes = (nodes_t*)malloc(sizeof(nodes_t));
+   memset(nodes, 0, sizeof(nodes_t));
+
+   if (hierarchy_create(&nodes->hierarchy, scene) != 0)
+   {
+      free(nodes);
+      return -1;
+   }
+
+   nodes->nnodes = nnodes;
+   nodes->scene = scene;
+   nodes->types = (unsigned char*)malloc(nnodes * sizeof(unsigned char));
+   nodes->flags = (unsigned char*)malloc(nnodes * sizeof(unsigned char));
+   nodes->data = (void**)malloc(nnodes * sizeof(void*));
+   nodes->bounds = (bbox_t*)malloc(nnodes * sizeof(bbox_t));
+   nodes->world_bounds = (bbox_t*)malloc(nnodes * sizeof(bbox_t));
+   nodes->draw_distances = (float*)malloc(nnodes * sizeof(float));
+   nodes->dynamic = (long*)malloc((nnodes + 1) * sizeof(long));
+   nodes->visible = (long*)malloc((nnodes + 1) * sizeof(long));
+
+   long l = 0;
+   for (l = 0; l < nnodes; ++l)
+   {
+      const node_t* node = &scene->nodes[l];
+
+      nodes->types[l] = (unsigned char)node->type;
+      nodes->data[l] = nodes_resolve_data(world, node);
+      nodes->bounds[l] = node->bbox;
+      nodes->draw_distances[l] = node->draw_distance;
+
+      // names are resolved once here instead of on every draw
+      nodes->flags[l] = 0;
+      if (nodes->data[l] != NULL)
+      {
+         nodes->flags[l] |= NODE_DRAWABLE;
+      }
+      else
+      {
+         LOGE("Node '%s' uses unknown data '%s'", atom_name(node->name), atom_name(node->data));
+      }
+
+      if (node->occluder && node->type == NODE_MESH && nodes->data[l] != NULL)
+      {
+         nodes->flags[l] |= NODE_OCCLUDER;
+      }
+
+      if (node->phys.type == PHYS_RIGID)
+      {
+         nodes->flags[l] |= NODE_DYNAMIC;
+         nodes->dynamic[nodes->ndynamic++] = l;
+      }
+
+      nodes_update_pick_margin(nodes, l);
+   }
+
+   nodes->visible_bodies = (void**)malloc((nnodes + 1) * sizeof(void*));
+
+   // the other nodes are listed for the bvh, reusing visible as scratch
+   long nstatic = 0;
+   for (l = 0; l < nnodes; ++l)
+   {
+      if (!(nodes->flags[l] & NODE_DYNAMIC))
+      {
+         nodes->visible[nstatic++] = l;
+      }
+   }
+
+   nodes->pvs_cell = -1;
+   if (scene->pvs != NULL && scene->pvs->nnodes == (unsigned long)nnodes)
+   {
+      nodes->pvs = scene->pvs;
+      nodes->pvs_bits = (unsigned char*)malloc((nnodes + 7) / 8 + 1);
+   }
+   else if (scene->pvs != NULL)
+   {
+      LOGE("PVS of scene '%s' was baked for %lu nodes instead of %ld", atom_name(scene->name), scene->pvs->nnodes, nnodes);
+   }
+
+   bbox_transform_batch(nodes->world_bounds, nodes->bounds, nodes->hierarchy->world, nnodes);
+   bvh_create(&nodes->bvh, nodes->world_bounds, nnodes, nodes->visible, nstatic);
+
+   (*pnodes) = nodes;
+   return 0;
+}
+
+void nodes_free(nodes_t* nodes)
+{
+   hierarchy_free(nodes->hierarchy);
+   bvh_free(nodes->bvh);
+   free(nodes->dynamic);
+   free(nodes->visible);
+   free(nodes->visible_bodies);
+   free(nodes->pvs_bits);
+   free(nodes->types);
+   free(nodes->flags);
+   free(nodes->data);
+   free(nodes->bounds);
+   free(nodes->world_bounds);
+   free(nodes->draw_distances);
+   free(nodes);
+}
+
+// recomputes world transforms and the world bounds of the nodes that moved,
+// static nodes never reach the bvh refit. Dynamic nodes are not in the bvh
+// but their bounds are refreshed all the same.
+void nodes_update(nodes_t* nodes)
+{
+   hierarchy_t* hierarchy = nodes->hierarchy;
+   const unsigned char* dirty = hierarchy->dirty;
+   const unsigned char* flags = nodes->flags;
+   long nnodes = nodes->nnodes;
+   long first = hierarchy_update(hierarchy);
+
+   long l = first;
+   while (l < nnodes)
+   {
+      if (!dirty[l])
+      {
+         ++l;
+         continue;
+      }
+
+      // runs of moved nodes go through the batch kernel together
+      long end = l + 1;
+      while (end < nnodes && dirty[end])
+      {
+         ++end;
+      }
+
+      bbox_transform_batch(&nodes->world_bounds[l], &nodes->bounds[l], &hierarchy->world[l], end - l);
+      for (; l < end; ++l)
+      {
+         nodes_update_pick_margin(nodes, l);
+         if (!(flags[l] & NODE_DYNAMIC))
+         {
+            bvh_refit(nodes->bvh, nodes->world_bounds, l);
+         }
+      }
+   }
+
+   hierarchy_clear_dirty(hierarchy, first);
+}
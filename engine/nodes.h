@@ -0,0 +1,65 @@
+#pragma once
+
+#include "bbox.h"
+
+struct world_t;
+struct scene_t;
+struct hierarchy_t;
+struct bvh_t;
+struct pvs_t;
+
+enum node_flag_t
+{
+   NODE_DRAWABLE = (1<<0),
+   NODE_DYNAMIC = (1<<1),
+   NODE_OCCLUDER = (1<<2),
+
+   // dropped by the last detail cull for being too small or too far, see
+   // game_cull_detail
+   NODE_DETAIL_CULLED = (1<<3),
+};
+
+// Per frame data of the nodes of a scene, one array per field and indexed
+// like scene->nodes. Names and physics properties stay in the node_t array
+// of the world file and are only used at load time and for lookups, so the
+// cull, render and pick loops only stream the fields they read. Culling and
+// picking go through a bvh over the world bounds, refitted as nodes move.
+// Nodes with rigid bodies stay out of the bvh, the physics broadphase already
+// tracks their bounds and culls them, see game_render_scene. Their world
+// bounds are still kept up to date for picking and the detail passes.
+typedef struct nodes_t
+{
+   long nnodes;
+   const struct scene_t* scene;
+
+   unsigned char* types;
+   unsigned char* flags;
+   void** data;
+   bbox_t* bounds;
+   bbox_t* world_bounds;
+   float* draw_distances;
+
+   struct hierarchy_t* hierarchy;
+   struct bvh_t* bvh;
+
+   long ndynamic;
+   long* dynamic;
+
+   // culling output, one entry per node for the node indices and for the
+   // node_t pointers of the bodies given back by the broadphase
+   long* visible;
+   void** visible_bodies;
+
+   // how much picking grows world bounds at most, see scene_pick_node
+   float pick_margin;
+
+   // baked visibility of the scene if any, with the bits of the cell the
+   // camera was last in
+   const struct pvs_t* pvs;
+   long pvs_cell;
+   unsigned char* pvs_bits;
+} nodes_t;
+
+int nodes_create(nodes_t** pnodes, const struct world_t* world, const struct scene_t* scene);
+void nodes_free(nodes_t* nodes);
+void nodes_update(nodes_t* nodes);
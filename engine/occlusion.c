@@ -0,0 +1,402 @@
+#include "occlusion.h"
+#include "world.h"
+#include "common.h"
+#include "simd.h"
+
+#define TILE_PIXELS (OCCLUSION_TILE_SIZE * OCCLUSION_TILE_SIZE)
+
+static inline int imin(int a, int b)
+{
+   return (a < b) ? a : b;
+}
+
+static inline int imax(int a, int b)
+{
+   return (a > b) ? a : b;
+}
+
+int occlusion_create(occlusion_t** pocclusion, int width, int height)
+{
+   if ((width % OCCLUSION_TILE_SIZE) != 0 || (height % OCCLUSION_TILE_SIZE) != 0)
+   {
+      LOGE("Occlusion buffer size %dx%d is not a multiple of %d", width, height, OCCLUSION_TILE_SIZE);
+      return -1;
+   }
+
+   occlusion_t* occlusion = (occlusion_t*)malloc(sizeof(occlusion_t));
+   memset(occlusion, 0, sizeof(occlusion_t));
+
+   occlusion->width = width;
+   occlusion->height = height;
+   occlusion->ntiles_x = width / OCCLUSION_TILE_SIZE;
+   occlusion->ntiles_y = height / OCCLUSION_TILE_SIZE;
+   occlusion->depth = (float*)malloc(width * height * sizeof(float));
+   occlusion->tile_max = (float*)malloc(occlusion->ntiles_x * occlusion->ntiles_y * sizeof(float));
+   mat4_set_identity(&occlusion->transform);
+
+   (*pocclusion) = occlusion;
+   return 0;
+}
+
+void occlusion_free(occlusion_t* occlusion)
+{
+   free(occlusion->depth);
+   free(occlusion->tile_max);
+   free(occlusion->vertices);
+   free(occlusion);
+}
+
+// clears the buffer to the far plane for a new frame
+void occlusion_begin(occlusion_t* occlusion, const mat4f_t* proj, const mat4f_t* view)
+{
+   mat4_mult(&occlusion->transform, proj, view);
+
+   long npixels = occlusion->width * occlusion->height;
+   long ntiles = occlusion->ntiles_x * occlusion->ntiles_y;
+   long l = 0;
+   for (l = 0; l < npixels; ++l)
+   {
+      occlusion->depth[l] = 1.0f;
+   }
+   for (l = 0; l < ntiles; ++l)
+   {
+      occlusion->tile_max[l] = 1.0f;
+   }
+}
+
+static void occlusion_clip(vec4f_t* r, const mat4f_t* m, const vec3f_t* p)
+{
+   vec4f_t point = { p->x, p->y, p->z, 1.0f };
+   mat4_mult_vec4(r, m, &point);
+}
+
+// distance to the near plane in clip space, negative behind it
+static inline float occlusion_near(const vec4f_t* clip)
+{
+   return clip->z + clip->w;
+}
+
+// pixel x and y and device z of a clip space point in front of the near plane
+static void occlusion_project(const occlusion_t* occlusion, vec4f_t* r, const vec4f_t* clip)
+{
+   float invw = 1.0f / clip->w;
+   r->x = (clip->x * invw * 0.5f + 0.5f) * occlusion->width;
+   r->y = (clip->y * invw * 0.5f + 0.5f) * occlusion->height;
+   r->z = clip->z * invw;
+   r->w = clip->w;
+}
+
+// edge from a to b as a * x + b * y + c, positive on the inner side of a
+// counter clockwise triangle
+typedef struct edge_t
+{
+   float a;
+   float b;
+   float c;
+} edge_t;
+
+static void edge_set(edge_t* e, const vec4f_t* from, const vec4f_t* to)
+{
+   e->a = from->y - to->y;
+   e->b = to->x - from->x;
+   e->c = -(e->a * from->x + e->b * from->y);
+}
+
+#ifdef MATHLIB_SIMD
+
+static void occlusion_raster_tile(occlusion_t* occlusion, long tile, int x0, int y0, const edge_t* edges, const edge_t* z)
+{
+   float* depth = &occlusion->depth[tile * TILE_PIXELS];
+   const v4f zero = v4f_splat(0.0f);
+   v4f farthest = zero;
+
+   v4f ea[3];
+   v4f eb[3];
+   v4f ec[3];
+   int i = 0;
+   for (i = 0; i < 3; ++i)
+   {
+      ea[i] = v4f_splat(edges[i].a);
+      eb[i] = v4f_splat(edges[i].b);
+      ec[i] = v4f_splat(edges[i].c);
+   }
+   v4f za = v4f_splat(z->a);
+   v4f zb = v4f_splat(z->b);
+   v4f zc = v4f_splat(z->c);
+
+   int row = 0;
+   for (row = 0; row < OCCLUSION_TILE_SIZE; ++row)
+   {
+      v4f y = v4f_splat(y0 + row + 0.5f);
+
+      int span = 0;
+      for (span = 0; span < OCCLUSION_TILE_SIZE; span += 4)
+      {
+         float px = x0 + span + 0.5f;
+         v4f x = v4f_set(px, px + 1.0f, px + 2.0f, px + 3.0f);
+
+         // pixel centers on the inner side of all edges
+         v4f inside = v4f_madd(ea[0], x, v4f_madd(eb[0], y, ec[0]));
+         inside = v4f_min(inside, v4f_madd(ea[1], x, v4f_madd(eb[1], y, ec[1])));
+         inside = v4f_min(inside, v4f_madd(ea[2], x, v4f_madd(eb[2], y, ec[2])));
+
+         float* p = &depth[row * OCCLUSION_TILE_SIZE + span];
+         v4f d = v4f_load(p);
+         v4f zp = v4f_madd(za, x, v4f_madd(zb, y, zc));
+         d = v4f_select_lt(inside, zero, d, v4f_min(d, zp));
+         v4f_store(p, d);
+
+         farthest = v4f_max(farthest, d);
+      }
+   }
+
+   float t[4];
+   v4f_store(t, v4f_max(farthest, v4f_swap_halves(farthest)));
+   occlusion->tile_max[tile] = fmaxf(t[0], t[1]);
+}
+
+#else
+
+static void occlusion_raster_tile(occlusion_t* occlusion, long tile, int x0, int y0, const edge_t* edges, const edge_t* z)
+{
+   float* depth = &occlusion->depth[tile * TILE_PIXELS];
+   float farthest = 0.0f;
+
+   int row = 0;
+   for (row = 0; row < OCCLUSION_TILE_SIZE; ++row)
+   {
+      float y = y0 + row + 0.5f;
+
+      int column = 0;
+      for (column = 0; column < OCCLUSION_TILE_SIZE; ++column)
+      {
+         float x = x0 + column + 0.5f;
+         float* d = &depth[row * OCCLUSION_TILE_SIZE + column];
+
+         if (edges[0].a * x + edges[0].b * y + edges[0].c >= 0.0f &&
+             edges[1].a * x + edges[1].b * y + edges[1].c >= 0.0f &&
+             edges[2].a * x + edges[2].b * y + edges[2].c >= 0.0f)
+         {
+            (*d) = fminf(*d, z->a * x + z->b * y + z->c);
+         }
+
+         farthest = fmaxf(farthest, *d);
+      }
+   }
+
+   occlusion->tile_max[tile] = farthest;
+}
+
+#endif
+
+static void occlusion_raster_triangle(occlusion_t* occlusion, const vec4f_t* v0, const vec4f_t* v1, const vec4f_t* v2)
+{
+   // occluders are drawn two sided, so the winding is made counter clockwise
+   float area = (v1->x - v0->x) * (v2->y - v0->y) - (v2->x - v0->x) * (v1->y - v0->y);
+   if (area == 0.0f)
+   {
+      return;
+   }
+   if (area < 0.0f)
+   {
+      const vec4f_t* t = v1;
+      v1 = v2;
+      v2 = t;
+      area = -area;
+   }
+
+   float zmin = fminf(v0->z, fminf(v1->z, v2->z));
+   if (zmin >= 1.0f)
+   {
+      return;
+   }
+
+   int xmin = (int)floorf(fminf(v0->x, fminf(v1->x, v2->x)));
+   int xmax = (int)floorf(fmaxf(v0->x, fmaxf(v1->x, v2->x)));
+   int ymin = (int)floorf(fminf(v0->y, fminf(v1->y, v2->y)));
+   int ymax = (int)floorf(fmaxf(v0->y, fmaxf(v1->y, v2->y)));
+   xmin = imax(xmin, 0);
+   ymin = imax(ymin, 0);
+   xmax = imin(xmax, occlusion->width - 1);
+   ymax = imin(ymax, occlusion->height - 1);
+   if (xmin > xmax || ymin > ymax)
+   {
+      return;
+   }
+
+   edge_t edges[3];
+   edge_set(&edges[0], v1, v2);
+   edge_set(&edges[1], v2, v0);
+   edge_set(&edges[2], v0, v1);
+
+   // the barycentric weight of each vertex is its opposite edge over the area
+   float inv = 1.0f / area;
+   edge_t z;
+   z.a = (edges[0].a * v0->z + edges[1].a * v1->z + edges[2].a * v2->z) * inv;
+   z.b = (edges[0].b * v0->z + edges[1].b * v1->z + edges[2].b * v2->z) * inv;
+   z.c = (edges[0].c * v0->z + edges[1].c * v1->z + edges[2].c * v2->z) * inv;
+
+   int ty = 0;
+   for (ty = ymin / OCCLUSION_TILE_SIZE; ty <= ymax / OCCLUSION_TILE_SIZE; ++ty)
+   {
+      int tx = 0;
+      for (tx = xmin / OCCLUSION_TILE_SIZE; tx <= xmax / OCCLUSION_TILE_SIZE; ++tx)
+      {
+         long tile = ty * occlusion->ntiles_x + tx;
+         if (zmin >= occlusion->tile_max[tile])
+         {
+            continue;
+         }
+
+         occlusion_raster_tile(occlusion, tile, tx * OCCLUSION_TILE_SIZE, ty * OCCLUSION_TILE_SIZE, edges, &z);
+      }
+   }
+}
+
+// clips a triangle of clip space vertices against the near plane, which gives
+// up to four vertices, and rasterizes it as a fan. The other planes only
+// bound the pixel loops.
+static void occlusion_draw_triangle(occlusion_t* occlusion, const vec4f_t* c0, const vec4f_t* c1, const vec4f_t* c2)
+{
+   const vec4f_t* in[3] = { c0, c1, c2 };
+   float d[3] = { occlusion_near(c0), occlusion_near(c1), occlusion_near(c2) };
+   if (d[0] < 0.0f && d[1] < 0.0f && d[2] < 0.0f)
+   {
+      return;
+   }
+
+   vec4f_t out[4];
+   int nout = 0;
+   int i = 0;
+   for (i = 0; i < 3; ++i)
+   {
+      int j = (i + 1) % 3;
+      if (d[i] >= 0.0f)
+      {
+         occlusion_project(occlusion, &out[nout++], in[i]);
+      }
+
+      if ((d[i] >= 0.0f) != (d[j] >= 0.0f))
+      {
+         float t = d[i] / (d[i] - d[j]);
+         vec4f_t c;
+         c.x = in[i]->x + (in[j]->x - in[i]->x) * t;
+         c.y = in[i]->y + (in[j]->y - in[i]->y) * t;
+         c.z = in[i]->z + (in[j]->z - in[i]->z) * t;
+         c.w = in[i]->w + (in[j]->w - in[i]->w) * t;
+         occlusion_project(occlusion, &out[nout++], &c);
+      }
+   }
+
+   for (i = 2; i < nout; ++i)
+   {
+      occlusion_raster_triangle(occlusion, &out[0], &out[i - 1], &out[i]);
+   }
+}
+
+void occlusion_draw_mesh(occlusion_t* occlusion, const struct mesh_t* mesh, const affine_t* transform)
+{
+   if (occlusion->nvertices < (long)mesh->nvertices)
+   {
+      occlusion->nvertices = mesh->nvertices;
+      occlusion->vertices = (vec4f_t*)realloc(occlusion->vertices, occlusion->nvertices * sizeof(vec4f_t));
+   }
+
+   mat4f_t mvp;
+   mat4_mult_affine(&mvp, &occlusion->transform, transform);
+
+   vec4f_t* vertices = occlusion->vertices;
+   unsigned long l = 0;
+   for (l = 0; l < mesh->nvertices; ++l)
+   {
+      vec3f_t point;
+      mesh_get_point(mesh, l, &point);
+      occlusion_clip(&vertices[l], &mvp, &point);
+   }
+
+   const submesh_t* submesh = &mesh->submeshes[0];
+   for (l = 0; l < mesh->nsubmeshes; ++l, ++submesh)
+   {
+      unsigned long i = 0;
+      for (i = 0; i + 2 < submesh->nindices; i += 3)
+      {
+         unsigned long i0 = submesh_get_index(submesh, i);
+         unsigned long i1 = submesh_get_index(submesh, i + 1);
+         unsigned long i2 = submesh_get_index(submesh, i + 2);
+         occlusion_draw_triangle(occlusion, &vertices[i0], &vertices[i1], &vertices[i2]);
+      }
+   }
+}
+
+// returns 0 if the box is behind the drawn occluders at every pixel it covers
+// and 1 otherwise, boxes crossing the near plane are always visible
+int occlusion_test_aabb(const occlusion_t* occlusion, const struct bbox_t* aabb)
+{
+   float xmin = 99999999.0f;
+   float ymin = 99999999.0f;
+   float xmax = -99999999.0f;
+   float ymax = -99999999.0f;
+   float zmin = 1.0f;
+
+   int i = 0;
+   for (i = 0; i < 8; ++i)
+   {
+      vec3f_t corner = { (i & 1) ? aabb->max.x : aabb->min.x, (i & 2) ? aabb->max.y : aabb->min.y, (i & 4) ? aabb->max.z : aabb->min.z };
+      vec4f_t clip;
+      occlusion_clip(&clip, &occlusion->transform, &corner);
+      if (occlusion_near(&clip) < 0.0f)
+      {
+         return 1;
+      }
+
+      vec4f_t p;
+      occlusion_project(occlusion, &p, &clip);
+
+      xmin = fminf(xmin, p.x);
+      xmax = fmaxf(xmax, p.x);
+      ymin = fminf(ymin, p.y);
+      ymax = fmaxf(ymax, p.y);
+      zmin = fminf(zmin, p.z);
+   }
+
+   int x0 = imax((int)floorf(xmin), 0);
+   int y0 = imax((int)floorf(ymin), 0);
+   int x1 = imin((int)floorf(xmax), occlusion->width - 1);
+   int y1 = imin((int)floorf(ymax), occlusion->height - 1);
+   if (x0 > x1 || y0 > y1)
+   {
+      return 1;
+   }
+
+   int ty = 0;
+   for (ty = y0 / OCCLUSION_TILE_SIZE; ty <= y1 / OCCLUSION_TILE_SIZE; ++ty)
+   {
+      int tx = 0;
+      for (tx = x0 / OCCLUSION_TILE_SIZE; tx <= x1 / OCCLUSION_TILE_SIZE; ++tx)
+      {
+         long tile = ty * occlusion->ntiles_x + tx;
+         if (occlusion->tile_max[tile] < zmin)
+         {
+            continue;
+         }
+
+         const float* depth = &occlusion->depth[tile * TILE_PIXELS];
+         int top = ty * OCCLUSION_TILE_SIZE;
+         int left = tx * OCCLUSION_TILE_SIZE;
+         int y = 0;
+         for (y = imax(y0, top); y <= imin(y1, top + OCCLUSION_TILE_SIZE - 1); ++y)
+         {
+            int x = 0;
+            for (x = imax(x0, left); x <= imin(x1, left + OCCLUSION_TILE_SIZE - 1); ++x)
+            {
+               if (depth[(y - top) * OCCLUSION_TILE_SIZE + (x - left)] >= zmin)
+               {
+                  return 1;
+               }
+            }
+         }
+      }
+   }
+
+   return 0;
+}
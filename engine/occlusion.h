@@ -0,0 +1,38 @@
+#pragma once
+
+#include "mathlib.h"
+
+struct bbox_t;
+struct mesh_t;
+
+#define OCCLUSION_TILE_SIZE 8
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 160
+
+// Low resolution depth buffer the occluder meshes are rasterized into on the
+// cpu, before the boxes of the other nodes are tested against it. Depth is
+// the normalized device z, pixels are stored tile by tile and each tile keeps
+// its farthest depth so boxes and triangles in front of or behind a whole
+// tile skip its pixels. No gl calls are made, the buffer works headless.
+typedef struct occlusion_t
+{
+   int width;
+   int height;
+   int ntiles_x;
+   int ntiles_y;
+
+   mat4f_t transform;
+
+   float* depth;
+   float* tile_max;
+
+   // clip space vertices of the mesh being drawn
+   long nvertices;
+   vec4f_t* vertices;
+} occlusion_t;
+
+int occlusion_create(occlusion_t** pocclusion, int width, int height);
+void occlusion_free(occlusion_t* occlusion);
+void occlusion_begin(occlusion_t* occlusion, const mat4f_t* proj, const mat4f_t* view);
+void occlusion_draw_mesh(occlusion_t* occlusion, const struct mesh_t* mesh, const affine_t* transform);
+int occlusion_test_aabb(const occlusion_t* occlusion, const struct bbox_t* aabb);
@@ -0,0 +1,88 @@
+#include "pvs.h"
+#include "common.h"
+
+long pvs_cell_count(const pvs_t* pvs)
+{
+   return pvs->ncells[0] * pvs->ncells[1] * pvs->ncells[2];
+}
+
+// returns the cell containing point, or -1 outside of the baked bounds
+long pvs_find_cell(const pvs_t* pvs, const vec3f_t* point)
+{
+   const float* p = &point->x;
+   const float* min = &pvs->bounds.min.x;
+   const float* max = &pvs->bounds.max.x;
+
+   long cell = 0;
+   int i = 0;
+   for (i = 2; i >= 0; --i)
+   {
+      if (p[i] < min[i] || p[i] > max[i])
+      {
+         return -1;
+      }
+
+      long n = (long)pvs->ncells[i];
+      long c = (long)((p[i] - min[i]) / (max[i] - min[i]) * n);
+      if (c >= n)
+      {
+         c = n - 1;
+      }
+      cell = cell * n + c;
+   }
+   return cell;
+}
+
+// expands the bitset of a cell to (nnodes + 7) / 8 bytes
+void pvs_decompress(const pvs_t* pvs, long cell, unsigned char* bits)
+{
+   long nbytes = (pvs->nnodes + 7) / 8;
+   const unsigned char* in = &pvs->data[pvs->offsets[cell]];
+   const unsigned char* end = &pvs->data[pvs->offsets[cell + 1]];
+
+   long n = 0;
+   while (in < end && n < nbytes)
+   {
+      if (*in != 0)
+      {
+         bits[n++] = *in++;
+         continue;
+      }
+
+      long run = in[1];
+      in += 2;
+      while (run-- > 0 && n < nbytes)
+      {
+         bits[n++] = 0;
+      }
+   }
+
+   // trailing zeros may be left out
+   memset(&bits[n], 0, nbytes - n);
+}
+
+// writes the compressed form of nbytes bytes to r, which needs room for
+// nbytes + nbytes / 2 + 2 bytes, and returns its size
+long pvs_compress(unsigned char* r, const unsigned char* bits, long nbytes)
+{
+   long size = 0;
+   long n = 0;
+   while (n < nbytes)
+   {
+      if (bits[n] != 0)
+      {
+         r[size++] = bits[n++];
+         continue;
+      }
+
+      long run = 0;
+      while (n < nbytes && bits[n] == 0 && run < 255)
+      {
+         ++run;
+         ++n;
+      }
+      r[size++] = 0;
+      r[size++] = (unsigned char)run;
+   }
+   return size;
+}
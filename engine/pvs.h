@@ -0,0 +1,26 @@
+#pragma once
+
+#include "bbox.h"
+
+// Potentially visible sets of a scene, baked offline by tools/pvs_bake. The
+// bounds of the scene are split into a grid of cells and every cell keeps one
+// bit per node, set if the node was seen from somewhere in the cell. Bits are
+// packed eight nodes per byte and runs of zero bytes are stored as a zero
+// followed by the run length, so a cell seeing little of the level takes a
+// few bytes.
+typedef struct pvs_t
+{
+   bbox_t bounds;
+   unsigned long ncells[3];
+   unsigned long nnodes;
+
+   // ncells + 1 offsets into data, cell i is stored between the i-th and the
+   // next one
+   unsigned long* offsets;
+   unsigned char* data;
+} pvs_t;
+
+long pvs_cell_count(const pvs_t* pvs);
+long pvs_find_cell(const pvs_t* pvs, const vec3f_t* point);
+void pvs_decompress(const pvs_t* pvs, long cell, unsigned char* bits);
+long pvs_compress(unsigned char* r, const unsigned char* bits, long nbytes);
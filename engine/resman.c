@@ -7,7 +7,7 @@
 
 typedef struct entry_t
 {
-   char key[64];
+   atom_t key;
    void* value;
 } entry_t;
 
@@ -27,13 +27,13 @@ struct resman_t
    char texture_root[32];
 };
 
-static void* entry_get(const entry_t* entries, long nentries, const char* key)
+static void* entry_get(const entry_t* entries, long nentries, atom_t key)
 {
    long l = 0;
    const entry_t* e = &entries[0];
    for (l = 0; l < nentries; ++l)
    {
-      if (strcmp(e->key, key) == 0)
+      if (e->key == key)
       {
          return e->value;
       }
@@ -68,11 +68,12 @@ int add_texture(resman_t* rm, const struct texture_t* texture)
       image_t* image = NULL;
 
       char fname[256] = {0};
-      modify_texture_path(fname, rm->texture_root, texture->path);
+      const char* path = atom_name(texture->path);
+      modify_texture_path(fname, rm->texture_root, path);
 
       if (image_load(&image, fname) != 0)
       {
-         if (image_load_from_png(&image, texture->path) != 0)
+         if (image_load_from_png(&image, path) != 0)
          {
             return -1;
          }
@@ -87,24 +88,24 @@ int add_texture(resman_t* rm, const struct texture_t* texture)
 
       image_free(image);
 
-      strcpy(rm->textures[rm->ntextures].key, texture->name);
+      rm->textures[rm->ntextures].key = texture->name;
       rm->textures[rm->ntextures].value = tex2d;
       ++rm->ntextures;
    }
    return 0;
 }
 
-int add_shader(resman_t* rm, const char* name)
+int add_shader(resman_t* rm, atom_t name)
 {
    shader_t* shader = resman_get_shader(rm, name);
    if (shader == NULL)
    {
-      if (shader_load(&shader, name) != 0)
+      if (shader_load(&shader, atom_name(name)) != 0)
       {
          return -1;
       }
 
-      strcpy(rm->shaders[rm->nshaders].key, name);
+      rm->shaders[rm->nshaders].key = name;
       rm->shaders[rm->nshaders].value = shader;
       ++rm->nshaders;
    }
@@ -196,7 +197,7 @@ void resman_show(const resman_t* rm)
    e = &rm->shaders[0];
    for (l = 0; l < rm->nshaders; ++l)
    {
-      LOGI("\t\t#%04ld:\t%s", l, e->key);
+      LOGI("\t\t#%04ld:\t%s", l, atom_name(e->key));
       ++e;
    }
 
@@ -204,28 +205,28 @@ void resman_show(const resman_t* rm)
    e = &rm->textures[0];
    for (l = 0; l < rm->ntextures; ++l)
    {
-      LOGI("\t\t#%04ld:\t%s", l, e->key);
+      LOGI("\t\t#%04ld:\t%s", l, atom_name(e->key));
       ++e;
    }
 }
 
-shader_t* resman_get_shader(resman_t* rm, const char* name)
+shader_t* resman_get_shader(resman_t* rm, atom_t name)
 {
    return (shader_t*)entry_get(rm->shaders, rm->nshaders, name);
 }
 
-struct tex2d_t* resman_get_texture(resman_t* rm, const char* name)
+struct tex2d_t* resman_get_texture(resman_t* rm, atom_t name)
 {
    return (tex2d_t*)entry_get(rm->textures, rm->ntextures, name);
 }
 
-struct material_t* resman_get_material(resman_t* rm, const char* name)
+struct material_t* resman_get_material(resman_t* rm, atom_t name)
 {
    long l = 0;
    struct material_t* material = &rm->world->materials[0];
    for (l = 0; l < rm->world->nmaterials; ++l, ++material)
    {
-      if (strcmp(material->name, name) == 0)
+      if (material->name == name)
       {
          return material;
       }
@@ -233,13 +234,13 @@ struct material_t* resman_get_material(resman_t* rm, const char* name)
    return NULL;
 }
 
-struct mesh_t* resman_get_mesh(resman_t* rm, const char* name)
+struct mesh_t* resman_get_mesh(resman_t* rm, atom_t name)
 {
    long l = 0;
    struct mesh_t* mesh = &rm->world->meshes[0];
    for (l = 0; l < rm->world->nmeshes; ++l, ++mesh)
    {
-      if (strcmp(mesh->name, name) == 0)
+      if (mesh->name == name)
       {
          return mesh;
       }
@@ -13,13 +13,13 @@ typedef struct shader_var_t
       VAR_UNIFORM,
    } type;
 
-   char name[32];
+   atom_t name;
    long location;
 } shader_var_t;
 
 struct shader_t
 {
-   char name[64];
+   atom_t name;
    long program;
 
    long nvars;
@@ -63,12 +63,12 @@ static GLuint load_shader_from_string(GLenum type, const char* src)
    return shader;
 }
 
-static const shader_var_t* find_var(const shader_t* shader, const char* name)
+static const shader_var_t* find_var(const shader_t* shader, atom_t name)
 {
    long i = 0;
    for (; i < shader->nvars; ++i)
    {
-      if (strcmp(name, shader->vars[i].name) == 0)
+      if (shader->vars[i].name == name)
       {
          return &shader->vars[i];
       }
@@ -76,37 +76,37 @@ static const shader_var_t* find_var(const shader_t* shader, const char* name)
    return NULL;
 }
 
-static shader_var_t* add_var(shader_t* shader, const char* name, GLuint location, int type)
+static shader_var_t* add_var(shader_t* shader, atom_t name, GLuint location, int type)
 {
-   LOGD("Adding var %s[%d] location %d program %ld", name, type, location, shader->program);
+   LOGD("Adding var %s[%d] location %d program %ld", atom_name(name), type, location, shader->program);
 
    shader_var_t* var = &shader->vars[shader->nvars];
    ++shader->nvars;
 
-   strcpy(var->name, name);
+   var->name = name;
    var->location = location;
    var->type = type;
    return var;
 }
 
-static const shader_var_t* get_attrib_var(shader_t* shader, const char* name)
+static const shader_var_t* get_attrib_var(shader_t* shader, atom_t name)
 {
    const shader_var_t* var = find_var(shader, name);
    if (var == NULL)
    {
-      GLuint location = glGetAttribLocation(shader->program, name);
+      GLuint location = glGetAttribLocation(shader->program, atom_name(name));
       checkGLError("glGetAttribLocation");
       var = add_var(shader, name, location, VAR_ATTRIB);
    }
    return var;
 }
 
-static const shader_var_t* get_uniform_var(shader_t* shader, const char* name)
+static const shader_var_t* get_uniform_var(shader_t* shader, atom_t name)
 {
    const shader_var_t* var = find_var(shader, name);
    if (var == NULL)
    {
-      GLuint location = glGetUniformLocation(shader->program, name);
+      GLuint location = glGetUniformLocation(shader->program, atom_name(name));
       checkGLError("glGetUniformLocation");
       var = add_var(shader, name, location, VAR_UNIFORM);
    }
@@ -208,7 +208,7 @@ int shader_load(shader_t** pshader, const char* name)
 
    shader_t* shader = (shader_t*)malloc(sizeof(shader_t));
    memset(shader, 0, sizeof(shader_t));
-   strcpy(shader->name, name);
+   shader->name = atom_intern(name);
    shader->program = program;
 
    (*pshader) = shader;
@@ -250,19 +250,20 @@ void shader_unuse(const shader_t* shader)
    checkGLError("glUseProgram");
 }
 
-void shader_set_attrib_vertices(shader_t* shader, const char* name, long components, long type, long stride, const void* values)
+void shader_set_attrib_vertices(shader_t* shader, atom_t name, long components, long type, long stride, const void* values)
 {
    const shader_var_t* var = get_attrib_var(shader, name);
    if (var->location < 0) return;
 
-   glVertexAttribPointer(var->location, components, type, GL_FALSE, stride, values);
+   // integer attributes are packed, see vertex_packed_t
+   glVertexAttribPointer(var->location, components, type, (type == GL_FLOAT) ? GL_FALSE : GL_TRUE, stride, values);
    checkGLError("glVertexAttribPointer");
 
    glEnableVertexAttribArray(var->location);
    checkGLError("glEnableVertexAttribArray");
 }
 
-void shader_set_uniform_matrices(shader_t* shader, const char* name, long count, const float* values)
+void shader_set_uniform_matrices(shader_t* shader, atom_t name, long count, const float* values)
 {
    const shader_var_t* var = get_uniform_var(shader, name);
    if (var->location < 0) return;
@@ -271,7 +272,7 @@ void shader_set_uniform_matrices(shader_t* shader, const char* name, long count,
    checkGLError("glUniformMatrix4fv");
 }
 
-void shader_set_uniform_vectors(shader_t* shader, const char* name, long count, const float* values)
+void shader_set_uniform_vectors(shader_t* shader, atom_t name, long count, const float* values)
 {
    const shader_var_t* var = get_uniform_var(shader, name);
    if (var->location < 0) return;
@@ -281,7 +282,7 @@ void shader_set_uniform_vectors(shader_t* shader, const char* name, long count,
    checkGLError("glUniform3iv");
 }
 
-void shader_set_uniform_integers(shader_t* shader, const char* name, long count, const int* values)
+void shader_set_uniform_integers(shader_t* shader, atom_t name, long count, const int* values)
 {
    const shader_var_t* var = get_uniform_var(shader, name);
    if (var->location < 0) return;
@@ -290,7 +291,7 @@ void shader_set_uniform_integers(shader_t* shader, const char* name, long count,
    checkGLError("glUniform1iv");
 }
 
-void shader_set_uniform_floats(shader_t* shader, const char* name, long count, const float* values)
+void shader_set_uniform_floats(shader_t* shader, atom_t name, long count, const float* values)
 {
    const shader_var_t* var = get_uniform_var(shader, name);
    if (var->location < 0) return;
@@ -0,0 +1,101 @@
+#pragma once
+
+// Thin 4-wide float vector layer over SSE2 and NEON. The implementation is
+// picked at compile time from the target flags; define MATHLIB_NO_SIMD to
+// force the scalar code paths.
+
+#if !defined(MATHLIB_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+
+#include <emmintrin.h>
+
+#define MATHLIB_SIMD 1
+#define MATHLIB_SSE2 1
+
+typedef __m128 v4f;
+
+static inline v4f v4f_load(const float* p)            { return _mm_loadu_ps(p); }
+static inline void v4f_store(float* p, v4f a)         { _mm_storeu_ps(p, a); }
+static inline v4f v4f_splat(float s)                  { return _mm_set1_ps(s); }
+static inline v4f v4f_set(float x, float y, float z, float w) { return _mm_setr_ps(x, y, z, w); }
+static inline v4f v4f_add(v4f a, v4f b)               { return _mm_add_ps(a, b); }
+static inline v4f v4f_sub(v4f a, v4f b)               { return _mm_sub_ps(a, b); }
+static inline v4f v4f_mul(v4f a, v4f b)               { return _mm_mul_ps(a, b); }
+static inline v4f v4f_madd(v4f a, v4f b, v4f c)       { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+static inline v4f v4f_min(v4f a, v4f b)               { return _mm_min_ps(a, b); }
+static inline v4f v4f_max(v4f a, v4f b)               { return _mm_max_ps(a, b); }
+static inline v4f v4f_abs(v4f a)                      { return _mm_and_ps(a, _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff))); }
+
+// bit i set where a[i] < b[i]
+static inline int v4f_mask_lt(v4f a, v4f b)           { return _mm_movemask_ps(_mm_cmplt_ps(a, b)); }
+
+// x[i] where a[i] < b[i], y[i] elsewhere
+static inline v4f v4f_select_lt(v4f a, v4f b, v4f x, v4f y)
+{
+   v4f m = _mm_cmplt_ps(a, b);
+   return _mm_or_ps(_mm_and_ps(m, x), _mm_andnot_ps(m, y));
+}
+
+// (y, x, w, z)
+static inline v4f v4f_swap_pairs(v4f a)               { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)); }
+// (z, w, x, y)
+static inline v4f v4f_swap_halves(v4f a)              { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 0, 3, 2)); }
+
+// loads 16 consecutive floats as the columns of their transpose
+static inline void v4f_load_transposed(const float* p, v4f* r)
+{
+   r[0] = _mm_loadu_ps(p);
+   r[1] = _mm_loadu_ps(p + 4);
+   r[2] = _mm_loadu_ps(p + 8);
+   r[3] = _mm_loadu_ps(p + 12);
+   _MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+}
+
+#elif !defined(MATHLIB_NO_SIMD) && (defined(__ARM_NEON__) || defined(__ARM_NEON))
+
+#include <arm_neon.h>
+
+#define MATHLIB_SIMD 1
+#define MATHLIB_NEON 1
+
+typedef float32x4_t v4f;
+
+static inline v4f v4f_load(const float* p)            { return vld1q_f32(p); }
+static inline void v4f_store(float* p, v4f a)         { vst1q_f32(p, a); }
+static inline v4f v4f_splat(float s)                  { return vdupq_n_f32(s); }
+static inline v4f v4f_set(float x, float y, float z, float w) { float t[4] = { x, y, z, w }; return vld1q_f32(t); }
+static inline v4f v4f_add(v4f a, v4f b)               { return vaddq_f32(a, b); }
+static inline v4f v4f_sub(v4f a, v4f b)               { return vsubq_f32(a, b); }
+static inline v4f v4f_mul(v4f a, v4f b)               { return vmulq_f32(a, b); }
+static inline v4f v4f_madd(v4f a, v4f b, v4f c)       { return vmlaq_f32(c, a, b); }
+static inline v4f v4f_min(v4f a, v4f b)               { return vminq_f32(a, b); }
+static inline v4f v4f_max(v4f a, v4f b)               { return vmaxq_f32(a, b); }
+static inline v4f v4f_abs(v4f a)                      { return vabsq_f32(a); }
+
+// bit i set where a[i] < b[i]
+static inline int v4f_mask_lt(v4f a, v4f b)
+{
+   static const uint32_t lanes[4] = { 1, 2, 4, 8 };
+   uint32x4_t bits = vandq_u32(vcltq_f32(a, b), vld1q_u32(lanes));
+   uint32x2_t sum = vadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+   return (int)(vget_lane_u32(sum, 0) | vget_lane_u32(sum, 1));
+}
+
+// x[i] where a[i] < b[i], y[i] elsewhere
+static inline v4f v4f_select_lt(v4f a, v4f b, v4f x, v4f y) { return vbslq_f32(vcltq_f32(a, b), x, y); }
+
+// (y, x, w, z)
+static inline v4f v4f_swap_pairs(v4f a)               { return vrev64q_f32(a); }
+// (z, w, x, y)
+static inline v4f v4f_swap_halves(v4f a)              { return vcombine_f32(vget_high_f32(a), vget_low_f32(a)); }
+
+// loads 16 consecutive floats as the columns of their transpose
+static inline void v4f_load_transposed(const float* p, v4f* r)
+{
+   float32x4x4_t t = vld4q_f32(p);
+   r[0] = t.val[0];
+   r[1] = t.val[1];
+   r[2] = t.val[2];
+   r[3] = t.val[3];
+}
+
+#endif
@@ -25,3 +25,15 @@ long timestamp_update(timestamp_t* timestamp)
    return timestamp_diff(timestamp, &prev);
 }
 
+
+long timestamp_diff_us(const timestamp_t* timestamp1, const timestamp_t* timestamp2)
+{
+   return (timestamp1->value.tv_sec - timestamp2->value.tv_sec) * 1000000 + (timestamp1->value.tv_usec - timestamp2->value.tv_usec);
+}
+
+long timestamp_elapsed_us(const timestamp_t* timestamp)
+{
+   timestamp_t current;
+   timestamp_set(&current);
+   return timestamp_diff_us(&current, timestamp);
+}
@@ -11,4 +11,6 @@ void timestamp_set(timestamp_t* timestamp);
 long timestamp_diff(const timestamp_t* timestamp1, const timestamp_t* timestamp2);
 long timestamp_elapsed(const timestamp_t* timestamp);
 long timestamp_update(timestamp_t* timestamp);
+long timestamp_diff_us(const timestamp_t* timestamp1, const timestamp_t* timestamp2);
+long timestamp_elapsed_us(const timestamp_t* timestamp);
 
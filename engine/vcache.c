@@ -0,0 +1,265 @@
+#include "vcache.h"
+#include "common.h"
+#include <math.h>
+
+// Forsyth's linear speed vertex cache optimisation. Vertices score for their
+// position in the cache and for the few triangles left using them, the
+// triangle with the best sum of its vertices among those touching the cache
+// goes next.
+#define FORSYTH_CACHE_DECAY 1.5f
+#define FORSYTH_LAST_TRIANGLE 0.75f
+#define FORSYTH_VALENCE_SCALE 2.0f
+#define FORSYTH_VALENCE_POWER 0.5f
+
+// counts every vertex fetched by the cache, indices at or above nvertices
+// are not valid
+void vcache_analyze(vcache_stats_t* stats, const unsigned int* indices, long nindices, long nvertices)
+{
+   // a vertex is in the fifo while fewer than its size misses followed the
+   // one that brought it in
+   long* stamps = (long*)malloc(nvertices * sizeof(long));
+   long l = 0;
+   for (l = 0; l < nvertices; ++l)
+   {
+      stamps[l] = -1;
+   }
+
+   memset(stats, 0, sizeof(vcache_stats_t));
+   stats->ntriangles = nindices / 3;
+
+   for (l = 0; l < nindices; ++l)
+   {
+      unsigned int v = indices[l];
+      if (stamps[v] < 0)
+      {
+         ++stats->nvertices;
+      }
+      if (stamps[v] < 0 || stats->misses - stamps[v] >= VCACHE_FIFO_SIZE)
+      {
+         stamps[v] = stats->misses;
+         ++stats->misses;
+      }
+   }
+
+   free(stamps);
+}
+
+float vcache_acmr(const vcache_stats_t* stats)
+{
+   return (stats->ntriangles > 0) ? (float)stats->misses / stats->ntriangles : 0.0f;
+}
+
+float vcache_atvr(const vcache_stats_t* stats)
+{
+   return (stats->nvertices > 0) ? (float)stats->misses / stats->nvertices : 0.0f;
+}
+
+static float vcache_vertex_score(long position, long live)
+{
+   if (live == 0)
+   {
+      return -1.0f;
+   }
+
+   float score = 0.0f;
+   if (position >= 0 && position < 3)
+   {
+      // vertices of the last triangle score below the next ones in the
+      // cache, which keeps the order from running off in long strips
+      score = FORSYTH_LAST_TRIANGLE;
+   }
+   else if (position >= 3)
+   {
+      score = powf(1.0f - (float)(position - 3) / (VCACHE_SIZE - 3), FORSYTH_CACHE_DECAY);
+   }
+   return score + FORSYTH_VALENCE_SCALE * powf((float)live, -FORSYTH_VALENCE_POWER);
+}
+
+// reorders the triangles of indices in place for the post transform cache,
+// the set of triangles and their windings stay the same
+int vcache_optimize(unsigned int* indices, long nindices, long nvertices)
+{
+   long ntriangles = nindices / 3;
+   if (ntriangles < 2)
+   {
+      return 0;
+   }
+
+   // triangles of every vertex, live ones first
+   long* live = (long*)malloc(nvertices * sizeof(long));
+   long* first = (long*)malloc((nvertices + 1) * sizeof(long));
+   long* triangles = (long*)malloc(ntriangles * 3 * sizeof(long));
+   long* position = (long*)malloc(nvertices * sizeof(long));
+   float* vertex_score = (float*)malloc(nvertices * sizeof(float));
+   float* triangle_score = (float*)malloc(ntriangles * sizeof(float));
+   unsigned char* emitted = (unsigned char*)malloc(ntriangles);
+   unsigned int* out = (unsigned int*)malloc(ntriangles * 3 * sizeof(unsigned int));
+
+   memset(live, 0, nvertices * sizeof(long));
+   long l = 0;
+   for (l = 0; l < ntriangles * 3; ++l)
+   {
+      ++live[indices[l]];
+   }
+
+   first[0] = 0;
+   for (l = 0; l < nvertices; ++l)
+   {
+      first[l + 1] = first[l] + live[l];
+      live[l] = 0;
+      position[l] = -1;
+   }
+
+   for (l = 0; l < ntriangles * 3; ++l)
+   {
+      unsigned int v = indices[l];
+      triangles[first[v] + live[v]++] = l / 3;
+   }
+
+   for (l = 0; l < nvertices; ++l)
+   {
+      vertex_score[l] = vcache_vertex_score(-1, live[l]);
+   }
+
+   for (l = 0; l < ntriangles; ++l)
+   {
+      const unsigned int* tri = &indices[l * 3];
+      triangle_score[l] = vertex_score[tri[0]] + vertex_score[tri[1]] + vertex_score[tri[2]];
+   }
+   memset(emitted, 0, ntriangles);
+
+   long cache[VCACHE_SIZE + 3];
+   long ncache = 0;
+
+   long best = 0;
+   long cursor = 0;
+   long nout = 0;
+   while (nout < ntriangles)
+   {
+      if (best < 0)
+      {
+         // nothing in the cache touches a triangle left, start over with the
+         // next one in the input order
+         while (emitted[cursor])
+         {
+            ++cursor;
+         }
+         best = cursor;
+      }
+
+      const unsigned int* tri = &indices[best * 3];
+      emitted[best] = 1;
+      out[nout * 3 + 0] = tri[0];
+      out[nout * 3 + 1] = tri[1];
+      out[nout * 3 + 2] = tri[2];
+      ++nout;
+
+      int k = 0;
+      for (k = 0; k < 3; ++k)
+      {
+         unsigned int v = tri[k];
+         long* t = &triangles[first[v]];
+         long i = 0;
+         while (t[i] != best)
+         {
+            ++i;
+         }
+         t[i] = t[live[v] - 1];
+         t[live[v] - 1] = best;
+         --live[v];
+      }
+
+      // the vertices of the triangle go to the front of the cache
+      long next[VCACHE_SIZE + 3];
+      long nnext = 0;
+      for (k = 0; k < 3; ++k)
+      {
+         next[nnext++] = tri[k];
+      }
+      for (l = 0; l < ncache; ++l)
+      {
+         if (cache[l] != tri[0] && cache[l] != tri[1] && cache[l] != tri[2])
+         {
+            next[nnext++] = cache[l];
+         }
+      }
+
+      for (l = 0; l < nnext; ++l)
+      {
+         long v = next[l];
+         position[v] = (l < VCACHE_SIZE) ? l : -1;
+         vertex_score[v] = vcache_vertex_score(position[v], live[v]);
+      }
+
+      ncache = (nnext < VCACHE_SIZE) ? nnext : VCACHE_SIZE;
+      memcpy(cache, next, ncache * sizeof(long));
+
+      // only triangles of the touched vertices change score
+      best = -1;
+      float best_score = -1.0f;
+      for (l = 0; l < nnext; ++l)
+      {
+         long v = next[l];
+         long i = 0;
+         for (i = 0; i < live[v]; ++i)
+         {
+            long t = triangles[first[v] + i];
+            const unsigned int* other = &indices[t * 3];
+            triangle_score[t] = vertex_score[other[0]] + vertex_score[other[1]] + vertex_score[other[2]];
+            if (triangle_score[t] > best_score)
+            {
+               best_score = triangle_score[t];
+               best = t;
+            }
+         }
+      }
+   }
+
+   memcpy(indices, out, ntriangles * 3 * sizeof(unsigned int));
+
+   free(live);
+   free(first);
+   free(triangles);
+   free(position);
+   free(vertex_score);
+   free(triangle_score);
+   free(emitted);
+   free(out);
+   return 0;
+}
+
+// numbers vertices in the order the indices first use them so that fetches
+// go forward through memory, and rewrites the indices. remap gets the new
+// position of every old vertex, the unused ones go last in their old order.
+// Returns the number of vertices used.
+long vcache_optimize_fetch(unsigned int* remap, unsigned int* indices, long nindices, long nvertices)
+{
+   const unsigned int unused = ~0u;
+
+   long l = 0;
+   for (l = 0; l < nvertices; ++l)
+   {
+      remap[l] = unused;
+   }
+
+   long nused = 0;
+   for (l = 0; l < nindices; ++l)
+   {
+      unsigned int v = indices[l];
+      if (remap[v] == unused)
+      {
+         remap[v] = nused++;
+      }
+      indices[l] = remap[v];
+   }
+
+   long n = nused;
+   for (l = 0; l < nvertices; ++l)
+   {
+      if (remap[l] == unused)
+      {
+         remap[l] = n++;
+      }
+   }
+   return nused;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+// size of the LRU cache the triangle order is tuned for
+#define VCACHE_SIZE 32
+
+// size of the FIFO cache the stats simulate, a common post transform cache
+#define VCACHE_FIFO_SIZE 16
+
+// Post transform vertex cache statistics of an index array. The average cache
+// miss ratio is the number of transformed vertices per triangle, 0.5 at best
+// for a regular grid and 3 at worst. The average transformed vertex ratio
+// divides them by the vertices used instead, 1 at best.
+typedef struct vcache_stats_t
+{
+   long ntriangles;
+   long nvertices;
+   long misses;
+} vcache_stats_t;
+
+void vcache_analyze(vcache_stats_t* stats, const unsigned int* indices, long nindices, long nvertices);
+float vcache_acmr(const vcache_stats_t* stats);
+float vcache_atvr(const vcache_stats_t* stats);
+
+int vcache_optimize(unsigned int* indices, long nindices, long nvertices);
+long vcache_optimize_fetch(unsigned int* remap, unsigned int* indices, long nindices, long nvertices);
@@ -6,39 +6,133 @@
 #include "bbox.h"
 #include "game.h"
 #include "gl_defs.h"
+#include "hierarchy.h"
+#include "nodes.h"
+#include "bvh.h"
+#include "pvs.h"
+#include "frustum.h"
+#include "impostor.h"
+
+// checks the header of a world file of fsize bytes
+int world_check_header(const struct file_header_t* header, long fsize)
+{
+   if (memcmp(header->magic, "RNNRWRLD", sizeof(header->magic)) != 0)
+   {
+      LOGE("Invalid file signature: %.8s", header->magic);
+      return -1;
+   }
 
-struct file_header_t
+   if (header->version != WORLD_FILE_VERSION)
+   {
+      LOGE("Unsupported world version %ld, expected %d", header->version, WORLD_FILE_VERSION);
+      return -1;
+   }
+
+   if (header->data_offset < (long)sizeof(struct file_header_t) || header->data_size < (long)sizeof(world_t) || header->data_offset + header->data_size > fsize)
+   {
+      LOGE("Invalid file size [offset: %ld size: %ld filesize: %ld]", header->data_offset, header->data_size, fsize);
+      return -1;
+   }
+
+   return 0;
+}
+
+// reads the whole world file fname to an image of *psize bytes, which keeps
+// the data as the file stores it, for the tools that bake into worlds
+int world_read_image(char** pimage, long* psize, const char* fname)
 {
-   char magic[8];
-   long version;
-   long data_offset;
-   long data_size;
-};
+   long size = 0;
+   char* image = (char*)stream_read_file(fname, &size);
+   if (image == NULL)
+   {
+      LOGE("Unable to read '%s'", fname);
+      return -1;
+   }
 
-int world_load_from_file(world_t** pworld, const char* fname)
+   if (size < (long)sizeof(struct file_header_t))
+   {
+      LOGE("'%s' is not a world file", fname);
+      free(image);
+      return -1;
+   }
+
+   if (world_check_header((const struct file_header_t*)image, size) != 0)
+   {
+      free(image);
+      return -1;
+   }
+
+   (*pimage) = image;
+   (*psize) = size;
+   return 0;
+}
+
+// loads the world of an image from world_read_image, the image is left as is
+int world_load_from_image(world_t** pworld, const char* image)
 {
-   LOGI("Loading world from %s", fname);
+   const struct file_header_t* header = (const struct file_header_t*)image;
+   char* data = malloc(header->data_size);
+   memcpy(data, image + header->data_offset, header->data_size);
+   return world_init(pworld, data, header->data_size);
+}
 
+// appends size bytes of blob to the data of an image, 8 byte aligned within
+// the data as it is loaded to malloced memory, anything the file had after
+// its data is dropped, returns the offset of the blob from the data
+long world_append_blob(char** pimage, long* psize, const void* blob, long size)
+{
+   const struct file_header_t* header = (const struct file_header_t*)(*pimage);
+   long data_offset = header->data_offset;
+   long data_size = header->data_size;
+   long offset = (data_size + 7) & ~7;
+
+   char* image = (char*)realloc(*pimage, data_offset + offset + size);
+   memset(image + data_offset + data_size, 0, offset - data_size);
+   memcpy(image + data_offset + offset, blob, size);
+   ((struct file_header_t*)image)->data_size = offset + size;
+
+   (*pimage) = image;
+   (*psize) = data_offset + offset + size;
+   return offset;
+}
+
+// writes an image to fname, a short write fails
+int world_write_image(const char* image, long size, const char* fname)
+{
    stream_t* f = NULL;
-   if (stream_open_reader(&f, fname) != 0)
+   if (stream_open_writer(&f, fname) != 0)
    {
+      LOGE("Unable to open '%s'", fname);
       return -1;
    }
 
-   struct file_header_t header;
-   stream_read(f, &header, sizeof(header));
-   if (memcmp(header.magic, "RNNRWRLD", sizeof(header.magic)) != 0)
+   long written = stream_write(f, image, size);
+   stream_close(f);
+   if (written != size)
    {
-      LOGE("Invalid file signature: %s", header.magic);
-      stream_close(f);
+      LOGE("Unable to write '%s', wrote %ld of %ld bytes", fname, written, size);
       return -1;
    }
 
-   long fsize = stream_size(f);
+   LOGI("Wrote %ld bytes to '%s'", size, fname);
+   return 0;
+}
 
-   if (header.data_offset + header.data_size < fsize)
+int world_load_from_file(world_t** pworld, const char* fname)
+{
+   LOGI("Loading world from %s", fname);
+
+   stream_t* f = NULL;
+   if (stream_open_reader(&f, fname) != 0)
+   {
+      return -1;
+   }
+
+   struct file_header_t header;
+   memset(&header, 0, sizeof(header));
+   stream_read(f, &header, sizeof(header));
+   if (world_check_header(&header, stream_size(f)) != 0)
    {
-      LOGE("Invalid file size [offset: %ld size: %ld filesize: %ld]", header.data_offset, header.data_size, fsize);
       stream_close(f);
       return -1;
    }
@@ -50,10 +144,104 @@ int world_load_from_file(world_t** pworld, const char* fname)
    stream_read(f, data, header.data_size);
    stream_close(f);
 
-   return world_init(pworld, data);
+   return world_init(pworld, data, header.data_size);
+}
+
+// replaces a string table index read from the file by its atom
+static int remap_atom(atom_t* atom, const atom_t* atoms, unsigned long natoms)
+{
+   if ((*atom) >= natoms)
+   {
+      LOGE("Invalid string index %u [%lu strings]", (*atom), natoms);
+      return -1;
+   }
+   (*atom) = atoms[(*atom)];
+   return 0;
+}
+
+// every string of the table has to end before the end of the data
+static int world_intern_strings(world_t* world, const char* end)
+{
+   atom_t* atoms = (atom_t*)malloc((world->nstrings + 1) * sizeof(atom_t));
+
+   const char* str = world->strings;
+   long l = 0;
+   for (l = 0; l < world->nstrings; ++l)
+   {
+      const char* nul = (str >= (const char*)world && str < end) ? (const char*)memchr(str, '\0', end - str) : NULL;
+      if (nul == NULL)
+      {
+         LOGE("String table runs past the end of the data [%ld of %lu strings]", l, world->nstrings);
+         free(atoms);
+         return -1;
+      }
+      atoms[l] = atom_intern(str);
+      str = nul + 1;
+   }
+
+   int error = 0;
+   long k = 0;
+   unsigned long n = world->nstrings;
+
+   error |= remap_atom(&world->name, atoms, n);
+
+   for (l = 0; l < world->ncameras; ++l)
+   {
+      error |= remap_atom(&world->cameras[l].name, atoms, n);
+   }
+
+   for (l = 0; l < world->nmaterials; ++l)
+   {
+      error |= remap_atom(&world->materials[l].name, atoms, n);
+      error |= remap_atom(&world->materials[l].shader, atoms, n);
+      error |= remap_atom(&world->materials[l].texture, atoms, n);
+   }
+
+   for (l = 0; l < world->ntextures; ++l)
+   {
+      error |= remap_atom(&world->textures[l].name, atoms, n);
+      error |= remap_atom(&world->textures[l].path, atoms, n);
+   }
+
+   for (l = 0; l < world->nlamps; ++l)
+   {
+      error |= remap_atom(&world->lamps[l].name, atoms, n);
+   }
+
+   for (l = 0; l < world->nmeshes; ++l)
+   {
+      struct mesh_t* mesh = &world->meshes[l];
+      error |= remap_atom(&mesh->name, atoms, n);
+
+      for (k = 0; k < mesh->nsubmeshes; ++k)
+      {
+         error |= remap_atom(&mesh->submeshes[k].material, atoms, n);
+      }
+
+      for (k = 0; k < mesh->nuvmaps; ++k)
+      {
+         error |= remap_atom(&mesh->uvmaps[k].name, atoms, n);
+      }
+   }
+
+   for (l = 0; l < world->nscenes; ++l)
+   {
+      struct scene_t* scene = &world->scenes[l];
+      error |= remap_atom(&scene->name, atoms, n);
+      error |= remap_atom(&scene->camera, atoms, n);
+
+      for (k = 0; k < scene->nnodes; ++k)
+      {
+         error |= remap_atom(&scene->nodes[k].name, atoms, n);
+         error |= remap_atom(&scene->nodes[k].data, atoms, n);
+      }
+   }
+
+   free(atoms);
+   return (error == 0) ? 0 : -1;
 }
 
-int world_init(world_t** pworld, char* data)
+int world_init(world_t** pworld, char* data, long size)
 {
    world_t* world = (world_t*)data;
 
@@ -63,70 +251,119 @@ int world_init(world_t** pworld, char* data)
    world->meshes = (struct mesh_t*)(data + (long)world->meshes);
    world->lamps = (struct lamp_t*)(data + (long)world->lamps);
    world->scenes = (struct scene_t*)(data + (long)world->scenes);
+   world->strings = (char*)(data + (long)world->strings);
 
-   LOGI("World %s has %ld cameras %ld materials %ld textures %ld meshes %ld lamps %ld scenes",
-        world->name, world->ncameras, world->nmaterials, world->ntextures, world->nmeshes, world->nlamps, world->nscenes);
+   if (world->impostors != NULL)
+   {
+      world->impostors = (struct impostor_atlas_t*)(data + (long)world->impostors);
+      world->impostors->impostors = (struct impostor_t*)(data + (long)world->impostors->impostors);
+   }
 
    long l = 0;
    long k = 0;
 
+   struct mesh_t* mesh = &world->meshes[0];
+   for (l = 0; l < world->nmeshes; ++l, ++mesh)
+   {
+      mesh->submeshes = (struct submesh_t*)(data + (long)mesh->submeshes);
+      mesh->vertices = (void*)(data + (long)mesh->vertices);
+      mesh->uvmaps = (struct uvmap_t*)(data + (long)mesh->uvmaps);
+
+      struct submesh_t* submesh = &mesh->submeshes[0];
+      for (k = 0; k < mesh->nsubmeshes; ++k, ++submesh)
+      {
+         submesh->indices = (void*)(data + (long)submesh->indices);
+         submesh->clusters = (struct cluster_t*)(data + (long)submesh->clusters);
+         submesh->lods = (struct lod_t*)(data + (long)submesh->lods);
+      }
+
+      struct uvmap_t* uvmap = &mesh->uvmaps[0];
+      for (k = 0; k < mesh->nuvmaps; ++k, ++uvmap)
+      {
+         if (uvmap->uvs != NULL)
+         {
+            uvmap->uvs = (void*)(data + (long)uvmap->uvs);
+         }
+      }
+   }
+
+   struct scene_t* scene = &world->scenes[0];
+   for (l = 0; l < world->nscenes; ++l, ++scene)
+   {
+      scene->nodes = (struct node_t*)(data + (long)scene->nodes);
+
+      if (scene->pvs != NULL)
+      {
+         scene->pvs = (struct pvs_t*)(data + (long)scene->pvs);
+         scene->pvs->offsets = (unsigned long*)(data + (long)scene->pvs->offsets);
+         scene->pvs->data = (unsigned char*)(data + (long)scene->pvs->data);
+      }
+   }
+
+   if (world_intern_strings(world, data + size) != 0)
+   {
+      free(data);
+      return -1;
+   }
+
+   LOGI("World %s has %ld cameras %ld materials %ld textures %ld meshes %ld lamps %ld scenes %ld strings",
+        atom_name(world->name), world->ncameras, world->nmaterials, world->ntextures, world->nmeshes, world->nlamps, world->nscenes, world->nstrings);
+
    struct camera_t* camera = &world->cameras[0];
    for (l = 0; l < world->ncameras; ++l, ++camera)
    {
-      LOGI("Camera '%s' type %d [%.2f -> %.2f]", camera->name, camera->type, camera->znear, camera->zfar);
+      LOGI("Camera '%s' type %d [%.2f -> %.2f]", atom_name(camera->name), camera->type, camera->znear, camera->zfar);
    }
 
    struct material_t* material = &world->materials[0];
    for (l = 0; l < world->nmaterials; ++l, ++material)
    {
-      LOGI("Material '%s' has shader '%s' and texture '%s'", material->name, material->shader, material->texture);
+      LOGI("Material '%s' has shader '%s' and texture '%s'", atom_name(material->name), atom_name(material->shader), atom_name(material->texture));
    }
 
    struct texture_t* texture = &world->textures[0];
    for (l = 0; l < world->ntextures; ++l, ++texture)
    {
-      LOGI("Texture '%s' path '%s'", texture->name, texture->path);
+      LOGI("Texture '%s' path '%s'", atom_name(texture->name), atom_name(texture->path));
    }
 
    struct lamp_t* lamp = &world->lamps[0];
    for (l = 0; l < world->nlamps; ++l, ++lamp)
    {
-      LOGI("Lamp '%s' distance %.2f energy %.2f type %d falloff_type %d", lamp->name, lamp->distance, lamp->energy, lamp->type, lamp->falloff_type);
+      LOGI("Lamp '%s' distance %.2f energy %.2f type %d falloff_type %d", atom_name(lamp->name), lamp->distance, lamp->energy, lamp->type, lamp->falloff_type);
    }
 
-   struct mesh_t* mesh = &world->meshes[0];
+   mesh = &world->meshes[0];
    for (l = 0; l < world->nmeshes; ++l, ++mesh)
    {
-      LOGI("Mesh '%s' has %ld submeshes, %ld vertices and %ld uvmaps", mesh->name, mesh->nsubmeshes, mesh->nvertices, mesh->nuvmaps);
-      mesh->submeshes = (struct submesh_t*)(data + (long)mesh->submeshes);
-      mesh->vertices = (struct vertex_t*)(data + (long)mesh->vertices);
-      mesh->uvmaps = (struct uvmap_t*)(data + (long)mesh->uvmaps);
+      LOGI("Mesh '%s' has %ld submeshes, %ld %s vertices and %ld uvmaps", atom_name(mesh->name), mesh->nsubmeshes, mesh->nvertices, mesh->format == VERTEX_PACKED ? "packed" : "float", mesh->nuvmaps);
 
       struct submesh_t* submesh = &mesh->submeshes[0];
       for (k = 0; k < mesh->nsubmeshes; ++k, ++submesh)
       {
-         LOGI("\tSubmesh with material '%s' has %ld indices", submesh->material, submesh->nindices);
-         submesh->indices = (unsigned int*)(data + (long)submesh->indices);
+         LOGI("\tSubmesh with material '%s' has %ld %ld bit indices from vertex %ld in %ld clusters and %ld lods", atom_name(submesh->material), submesh->nindices, submesh->index_size * 8, submesh->base_vertex, submesh->nclusters, submesh->nlods);
       }
 
       struct uvmap_t* uvmap = &mesh->uvmaps[0];
       for (k = 0; k < mesh->nuvmaps; ++k, ++uvmap)
       {
-         LOGI("\tUVmap '%s' has %ld entries", uvmap->name, uvmap->nuvs);
-         uvmap->uvs = (vec2f_t*)(data + (long)uvmap->uvs);
+         LOGI("\tUVmap '%s' has %ld entries%s", atom_name(uvmap->name), uvmap->nuvs, (uvmap->uvs == NULL) ? " in the vertices" : "");
       }
    }
 
-   struct scene_t* scene = &world->scenes[0];
+   scene = &world->scenes[0];
    for (l = 0; l < world->nscenes; ++l, ++scene)
    {
-      LOGI("Scene '%s' has %ld root nodes and camera '%s'", scene->name, scene->nnodes, scene->camera);
-      scene->nodes = (struct node_t*)(data + (long)scene->nodes);
+      LOGI("Scene '%s' has %ld root nodes and camera '%s'", atom_name(scene->name), scene->nnodes, atom_name(scene->camera));
+      if (scene->pvs != NULL)
+      {
+         LOGI("\tPVS of %lux%lux%lu cells, %lu bytes", scene->pvs->ncells[0], scene->pvs->ncells[1], scene->pvs->ncells[2], scene->pvs->offsets[pvs_cell_count(scene->pvs)]);
+      }
 
       struct node_t* node = &scene->nodes[0];
       for (k = 0; k < scene->nnodes; ++k, ++node)
       {
-         LOGI("\tNode '%s' type %d parent '%s' and uses data '%s'", node->name, node->type, node->parent_index >= 0 ? scene->nodes[node->parent_index].name : "[null]", node->data);
+         LOGI("\tNode '%s' type %d parent '%s' and uses data '%s'", atom_name(node->name), node->type, node->parent_index >= 0 ? atom_name(scene->nodes[node->parent_index].name) : "[null]", atom_name(node->data));
          mat4_show(&node->transform);
       }
    }
@@ -140,88 +377,120 @@ void world_free(world_t* world)
    free(world);
 }
 
-camera_t* world_get_camera(const world_t* world, const char* name)
+camera_t* world_get_camera(const world_t* world, atom_t name)
 {
    long l = 0;
    for (; l < world->ncameras; ++l)
    {
-      if (strcmp(world->cameras[l].name, name) == 0)
+      if (world->cameras[l].name == name)
          return &world->cameras[l];
    }
    return NULL;
 }
 
-material_t* world_get_material(const world_t* world, const char* name)
+material_t* world_get_material(const world_t* world, atom_t name)
 {
    long l = 0;
    for (; l < world->nmaterials; ++l)
    {
-      if (strcmp(world->materials[l].name, name) == 0)
+      if (world->materials[l].name == name)
          return &world->materials[l];
    }
    return NULL;
 }
 
-texture_t* world_get_texture(const world_t* world, const char* name)
+texture_t* world_get_texture(const world_t* world, atom_t name)
 {
    long l = 0;
    for (; l < world->ntextures; ++l)
    {
-      if (strcmp(world->textures[l].name, name) == 0)
+      if (world->textures[l].name == name)
          return &world->textures[l];
    }
    return NULL;
 }
 
-mesh_t* world_get_mesh(const world_t* world, const char* name)
+mesh_t* world_get_mesh(const world_t* world, atom_t name)
 {
    long l = 0;
    for (; l < world->nmeshes; ++l)
    {
-      if (strcmp(world->meshes[l].name, name) == 0)
+      if (world->meshes[l].name == name)
          return &world->meshes[l];
    }
    return NULL;
 }
 
-lamp_t* world_get_lamp(const world_t* world, const char* name)
+lamp_t* world_get_lamp(const world_t* world, atom_t name)
 {
    long l = 0;
    for (; l < world->nlamps; ++l)
    {
-      if (strcmp(world->lamps[l].name, name) == 0)
+      if (world->lamps[l].name == name)
          return &world->lamps[l];
    }
    return NULL;
 }
 
-scene_t* world_get_scene(const world_t* world, const char* name)
+scene_t* world_get_scene(const world_t* world, atom_t name)
 {
    long l = 0;
    for (; l < world->nscenes; ++l)
    {
-      if (strcmp(world->scenes[l].name, name) == 0)
+      if (world->scenes[l].name == name)
          return &world->scenes[l];
    }
    return NULL;
 }
 
-node_t* scene_get_node(const scene_t* scene, const char* name)
+node_t* scene_get_node(const scene_t* scene, atom_t name)
 {
    long l = 0;
    for (; l < scene->nnodes; ++l)
    {
-      if (strcmp(scene->nodes[l].name, name) == 0)
+      if (scene->nodes[l].name == name)
          return &scene->nodes[l];
    }
    return NULL;
 }
 
-node_t* scene_pick_node(const world_t* world, const scene_t* scene, const vec2f_t* point)
+typedef struct pick_t
+{
+   const nodes_t* nodes;
+   vec3f_t from;
+   vec3f_t dir;
+
+   long picked;
+   float dist;
+} pick_t;
+
+// controls are picked by their boxes grown by one unit along the local y
+// axis, which grows the world box by the absolute second column of the node
+// transform
+static float pick_visit(long item, void* user_data)
 {
-   node_t* picked_node = NULL;
-   float pick_dist = 999999.0f;
+   pick_t* pick = (pick_t*)user_data;
+   const affine_t* m = &pick->nodes->hierarchy->world[item];
+
+   bbox_t b = pick->nodes->world_bounds[item];
+   b.min.x -= fabsf(m->m12); b.max.x += fabsf(m->m12);
+   b.min.y -= fabsf(m->m22); b.max.y += fabsf(m->m22);
+   b.min.z -= fabsf(m->m32); b.max.z += fabsf(m->m32);
+
+   float dist = 0.0f;
+   if (bbox_ray_intersection(&b, &pick->from, &pick->dir, &dist))
+   {
+      if (dist < pick->dist)
+      {
+         pick->picked = item;
+         pick->dist = dist;
+      }
+   }
+   return pick->dist;
+}
 
+node_t* scene_pick_node(const world_t* world, const scene_t* scene, const struct nodes_t* nodes, const vec2f_t* point)
+{
    camera_t* camera = world_get_camera(world, scene->camera);
 
    mat4f_t transform;
@@ -244,33 +513,253 @@ node_t* scene_pick_node(const world_t* world, const scene_t* scene, const vec2f_
    //LOGI("TO:   %.2f %.2f %.2f -> %.2f %.2f %.2f", to.x, to.y, to.z, to_global.x, to_global.y, to_global.z);
    //LOGI("DIR:  %.2f %.2f %.2f", dir.x, dir.y, dir.z);
 
+   pick_t pick;
+   pick.nodes = nodes;
+   pick.from = from_global;
+   pick.dir = dir;
+   pick.picked = -1;
+   pick.dist = 999999.0f;
+
+   bvh_raycast(nodes->bvh, &from_global, &dir, nodes->pick_margin, pick_visit, &pick);
+
+   // dynamic nodes are not in the bvh
    long l = 0;
-   struct node_t* node = &scene->nodes[0];
-   for (; l < scene->nnodes; ++l, ++node)
+   for (l = 0; l < nodes->ndynamic; ++l)
    {
-      bbox_t bbox = node->bbox;
-      bbox.min.y -= 1.0f;
-      bbox.max.y += 1.0f;
-      bbox_transform(&bbox, &node->transform);
+      pick_visit(nodes->dynamic[l], &pick);
+   }
 
-      float dist = 0.0f;
-      if (bbox_ray_intersection(&bbox, &from_global, &dir, &dist))
+   return (pick.picked >= 0) ? &scene->nodes[pick.picked] : NULL;
+}
+
+extern struct game_t* game;
+
+// a cluster is drawn if it is in the frustum and some of its faces may point
+// to the eye. With v from the eye to the center of its bounding sphere at
+// angle a to the cone axis, every face points away when cos(a + t) * |v| is
+// beyond the radius, t being the spread of the cone.
+static int world_cluster_visible(const cluster_t* cluster, const frustum_t* frustum, const vec3f_t* eye)
+{
+   if (frustum_intersect_aabb(frustum, &cluster->bounds) < 0)
+   {
+      return 0;
+   }
+
+   float cos_t = cluster->cone_cutoff;
+   if (cos_t <= 0.0f)
+   {
+      return 1;
+   }
+
+   vec3f_t center;
+   vec3f_t extent;
+   vec3_scale(&center, vec3_add(&center, &cluster->bounds.min, &cluster->bounds.max), 0.5f);
+   vec3_sub(&extent, &cluster->bounds.max, &center);
+   float radius = sqrtf(vec3_dot(&extent, &extent));
+
+   vec3f_t v;
+   vec3_sub(&v, &center, eye);
+   float d = sqrtf(vec3_dot(&v, &v));
+   if (d <= radius)
+   {
+      return 1;
+   }
+
+   float cos_a = vec3_dot(&v, &cluster->cone_axis) / d;
+   float sin_a = sqrtf(fmaxf(1.0f - cos_a * cos_a, 0.0f));
+   float sin_t = sqrtf(fmaxf(1.0f - cos_t * cos_t, 0.0f));
+   return (cos_a * cos_t - sin_a * sin_t) * d < radius;
+}
+
+static void world_draw_elements(const submesh_t* submesh, unsigned long first, unsigned long count)
+{
+   const char* indices = (const char*)submesh->indices + first * submesh->index_size;
+   glDrawElements(GL_TRIANGLES, count, (submesh->index_size == 2) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, indices);
+}
+
+// draws the visible clusters of a submesh, clusters are stored in index
+// order so runs of visible ones go in a single draw
+static void world_draw_clusters(const submesh_t* submesh, const frustum_t* frustum, const vec3f_t* eye)
+{
+   unsigned long first = 0;
+   unsigned long count = 0;
+
+   long l = 0;
+   const cluster_t* cluster = &submesh->clusters[0];
+   for (l = 0; l < submesh->nclusters; ++l, ++cluster)
+   {
+      if (!world_cluster_visible(cluster, frustum, eye))
+         continue;
+
+      if (count > 0 && first + count == cluster->first)
       {
-         //LOGI("INTERSECTION: %.2f", dist);
-         if (dist < pick_dist)
-         {
-            picked_node = node;
-            pick_dist = dist;
-         }
+         count += cluster->nindices;
+         continue;
+      }
+
+      if (count > 0)
+      {
+         world_draw_elements(submesh, first, count);
       }
+      first = cluster->first;
+      count = cluster->nindices;
    }
 
-   return picked_node;
+   if (count > 0)
+   {
+      world_draw_elements(submesh, first, count);
+   }
 }
 
-extern struct game_t* game;
+// returns the coarsest level of the mesh with an error up to max_error, zero
+// being the full mesh. Submeshes are simplified together and share errors.
+long mesh_select_lod(const mesh_t* mesh, float max_error)
+{
+   if (mesh->nsubmeshes == 0)
+   {
+      return 0;
+   }
+
+   const submesh_t* submesh = &mesh->submeshes[0];
+   long lod = 0;
+   while (lod < submesh->nlods && submesh->lods[lod].error <= max_error)
+   {
+      ++lod;
+   }
+   return lod;
+}
 
-void world_render_mesh(const world_t* world, const camera_t* camera, const mesh_t* mesh, const mat4f_t* transform)
+// transform from the stored points of the mesh to mesh space, GL already
+// normalizes packed coordinates to q / 65535
+void mesh_unpack_transform(affine_t* transform, const mesh_t* mesh)
+{
+   affine_set_identity(transform);
+   if (mesh->format == VERTEX_PACKED)
+   {
+      transform->m11 = mesh->scale.x;
+      transform->m22 = mesh->scale.y;
+      transform->m33 = mesh->scale.z;
+      transform->m14 = mesh->offset.x;
+      transform->m24 = mesh->offset.y;
+      transform->m34 = mesh->offset.z;
+   }
+}
+
+void mesh_get_point(const mesh_t* mesh, unsigned long index, vec3f_t* point)
+{
+   if (mesh->format == VERTEX_PACKED)
+   {
+      const unsigned short* q = ((const vertex_packed_t*)mesh->vertices)[index].point;
+      point->x = mesh->offset.x + mesh->scale.x * (q[0] / 65535.0f);
+      point->y = mesh->offset.y + mesh->scale.y * (q[1] / 65535.0f);
+      point->z = mesh->offset.z + mesh->scale.z * (q[2] / 65535.0f);
+   }
+   else
+   {
+      (*point) = ((const vertex_t*)mesh->vertices)[index].point;
+   }
+}
+
+// packed normals are not of unit length, the shaders normalize anyway
+void mesh_get_normal(const mesh_t* mesh, unsigned long index, vec3f_t* normal)
+{
+   if (mesh->format == VERTEX_PACKED)
+   {
+      const signed char* q = ((const vertex_packed_t*)mesh->vertices)[index].normal;
+      normal->x = q[0] / 127.0f;
+      normal->y = q[1] / 127.0f;
+      normal->z = q[2] / 127.0f;
+   }
+   else
+   {
+      (*normal) = ((const vertex_t*)mesh->vertices)[index].normal;
+   }
+}
+
+void mesh_get_uv(const mesh_t* mesh, const uvmap_t* uvmap, unsigned long index, vec2f_t* uv)
+{
+   if (mesh->format == VERTEX_PACKED)
+   {
+      const unsigned short* q = ((const vertex_packed_t*)mesh->vertices)[index].uv;
+      if (uvmap->uvs != NULL)
+      {
+         q = &((const unsigned short*)uvmap->uvs)[index * 2];
+      }
+      uv->x = uvmap->offset.x + uvmap->scale.x * (q[0] / 65535.0f);
+      uv->y = uvmap->offset.y + uvmap->scale.y * (q[1] / 65535.0f);
+   }
+   else if (uvmap->uvs != NULL)
+   {
+      (*uv) = ((const vec2f_t*)uvmap->uvs)[index];
+   }
+   else
+   {
+      (*uv) = ((const vertex_t*)mesh->vertices)[index].uv;
+   }
+}
+
+// vertex i of the mesh the i-th index of the submesh refers to
+unsigned long submesh_get_index(const submesh_t* submesh, unsigned long i)
+{
+   if (submesh->index_size == 2)
+   {
+      return submesh->base_vertex + ((const unsigned short*)submesh->indices)[i];
+   }
+   return submesh->base_vertex + ((const unsigned int*)submesh->indices)[i];
+}
+
+// points the attributes of the shader at the vertices of the mesh from
+// base_vertex on, and at its active uvmap scaled by uTexScale and
+// uTexOffset. Unless the gui switched the uvmap all of them come from the
+// one interleaved array.
+static void world_bind_vertices(shader_t* shader, const mesh_t* mesh, unsigned long base_vertex)
+{
+   vec3f_t tex_scale = { 1.0f, 1.0f, 0.0f };
+   vec3f_t tex_offset = { 0.0f, 0.0f, 0.0f };
+   const uvmap_t* uvmap = (mesh->nuvmaps > 0) ? &mesh->uvmaps[mesh->active_uvmap] : NULL;
+
+   if (mesh->format == VERTEX_PACKED)
+   {
+      const vertex_packed_t* vertices = (const vertex_packed_t*)mesh->vertices + base_vertex;
+      shader_set_attrib_vertices(shader, ATOM_aPos, 3, GL_UNSIGNED_SHORT, sizeof(vertex_packed_t), &vertices[0].point);
+      shader_set_attrib_vertices(shader, ATOM_aNormal, 3, GL_BYTE, sizeof(vertex_packed_t), &vertices[0].normal);
+      if (uvmap != NULL && uvmap->uvs != NULL)
+      {
+         shader_set_attrib_vertices(shader, ATOM_aTexCoord, 2, GL_UNSIGNED_SHORT, 2*sizeof(unsigned short), (const unsigned short*)uvmap->uvs + base_vertex * 2);
+      }
+      else
+      {
+         shader_set_attrib_vertices(shader, ATOM_aTexCoord, 2, GL_UNSIGNED_SHORT, sizeof(vertex_packed_t), &vertices[0].uv);
+      }
+
+      if (uvmap != NULL)
+      {
+         tex_scale.x = uvmap->scale.x;
+         tex_scale.y = uvmap->scale.y;
+         tex_offset.x = uvmap->offset.x;
+         tex_offset.y = uvmap->offset.y;
+      }
+   }
+   else
+   {
+      const vertex_t* vertices = (const vertex_t*)mesh->vertices + base_vertex;
+      shader_set_attrib_vertices(shader, ATOM_aPos, 3, GL_FLOAT, sizeof(vertex_t), &vertices[0].point);
+      shader_set_attrib_vertices(shader, ATOM_aNormal, 3, GL_FLOAT, sizeof(vertex_t), &vertices[0].normal);
+      if (uvmap != NULL && uvmap->uvs != NULL)
+      {
+         shader_set_attrib_vertices(shader, ATOM_aTexCoord, 2, GL_FLOAT, 2*sizeof(float), (const vec2f_t*)uvmap->uvs + base_vertex);
+      }
+      else
+      {
+         shader_set_attrib_vertices(shader, ATOM_aTexCoord, 2, GL_FLOAT, sizeof(vertex_t), &vertices[0].uv);
+      }
+   }
+
+   shader_set_uniform_vectors(shader, ATOM_uTexScale, 1, &tex_scale.x);
+   shader_set_uniform_vectors(shader, ATOM_uTexOffset, 1, &tex_offset.x);
+}
+
+void world_render_mesh(const world_t* world, const camera_t* camera, const mesh_t* mesh, const affine_t* transform, long lod)
 {
    long l = 0;
 
@@ -282,34 +771,71 @@ void world_render_mesh(const world_t* world, const camera_t* camera, const mesh_
    vec3f_t lightPos = globalLightPos;
    mat4_mult_vec3(&lightPos, &camera->view, &globalLightPos);
 
+   // the same for every submesh, node and view transforms are affine so the
+   // normal matrix only needs the inverse transpose of the 3x3 part
+   affine_t view;
+   affine_t mv;
+   affine_from_mat4(&view, &camera->view);
+   affine_mult(&mv, &view, transform);
+
+   mat3f_t normal;
+   affine_normal_matrix(&normal, &mv);
+
+   mat4f_t mv4;
+   mat4f_t mvi;
+   affine_to_mat4(&mv4, &mv);
+   mat4_from_mat3(&mvi, &normal);
+
+   // clusters are culled in the space of the mesh
+   frustum_t frustum;
+   frustum_set(&frustum, &camera->proj, &mv4);
+
+   // while the shaders get the stored points, the unpacking goes with the
+   // model view. The normal matrix stays, packed normals are not scaled.
+   affine_t unpack;
+   affine_t mvu;
+   mat4f_t mvu4;
+   mat4f_t mvp;
+   mesh_unpack_transform(&unpack, mesh);
+   affine_mult(&mvu, &mv, &unpack);
+   affine_to_mat4(&mvu4, &mvu);
+   mat4_mult_affine(&mvp, &camera->proj, &mvu);
+
+   affine_t vm;
+   const vec3f_t origin = { 0.0f, 0.0f, 0.0f };
+   vec3f_t eye;
+   affine_inverted(&vm, &mv);
+   affine_mult_vec3(&eye, &vm, &origin);
+
+   int cull_clusters = game_is_option_set(game, GAME_CULL_CLUSTERS);
+
    struct submesh_t* submesh = &mesh->submeshes[0];
    for (; l < mesh->nsubmeshes; ++l, ++submesh)
    {
       material_t* material = resman_get_material(game->resman, submesh->material);
       shader_t* shader = resman_get_shader(game->resman, material->shader);
 
-      mat4f_t mv;
-      mat4f_t mvp;
-      mat4_mult(&mv, &camera->view, transform);
-      mat4_mult(&mvp, &camera->proj, &mv);
-
-      mat4f_t mvi = *transform;
-      mat4_inverted(&mvi, &mv);
-      mat4_transpose(&mvi);
-      mvi.m41 = mvi.m42 = mvi.m43 = 0.0f;
-      mvi.m44 = 1.0f;
-
       material_bind(material, 0);
 
-      shader_set_uniform_matrices(shader, "uMVP", 1, mat4_data(&mvp));
-      shader_set_uniform_matrices(shader, "uMV", 1, mat4_data(&mv));
-      shader_set_uniform_matrices(shader, "uMVI", 1, mat4_data(&mvi));
-      shader_set_uniform_vectors(shader, "uLightPos", 1, &lightPos.x);
-      shader_set_attrib_vertices(shader, "aPos", 3, GL_FLOAT, sizeof(vertex_t), &mesh->vertices[0].point);
-      shader_set_attrib_vertices(shader, "aNormal", 3, GL_FLOAT, sizeof(vertex_t), &mesh->vertices[0].normal);
-      shader_set_attrib_vertices(shader, "aTexCoord", 2, GL_FLOAT, 2*sizeof(float), &mesh->uvmaps[mesh->active_uvmap].uvs[0]);
+      shader_set_uniform_matrices(shader, ATOM_uMVP, 1, mat4_data(&mvp));
+      shader_set_uniform_matrices(shader, ATOM_uMV, 1, mat4_data(&mvu4));
+      shader_set_uniform_matrices(shader, ATOM_uMVI, 1, mat4_data(&mvi));
+      shader_set_uniform_vectors(shader, ATOM_uLightPos, 1, &lightPos.x);
+      world_bind_vertices(shader, mesh, submesh->base_vertex);
 
-      glDrawElements(GL_TRIANGLES, submesh->nindices, GL_UNSIGNED_INT, submesh->indices);
+      if (lod > 0 && lod <= submesh->nlods)
+      {
+         const lod_t* level = &submesh->lods[lod - 1];
+         world_draw_elements(submesh, level->first, level->nindices);
+      }
+      else if (cull_clusters && submesh->nclusters > 1)
+      {
+         world_draw_clusters(submesh, &frustum, &eye);
+      }
+      else
+      {
+         world_draw_elements(submesh, 0, submesh->nindices);
+      }
 
       material_unbind(material);
 
@@ -319,14 +845,14 @@ void world_render_mesh(const world_t* world, const camera_t* camera, const mesh_
       for (; k < submesh->nvertices; ++k)
       {
          vec3f_t p;
-         mat4_mult_vec3(&p, transform, &submesh->vertices[k].point);
+         affine_mult_vec3(&p, transform, &submesh->vertices[k].point);
          bbox_inflate(&b, &p);
       }
       bbox_draw(&b, camera);*/
    }
 }
 
-void world_render_camera(const world_t* world, const camera_t* camera, const camera_t* cam, const mat4f_t* transform)
+void world_render_camera(const world_t* world, const camera_t* camera, const camera_t* cam, const affine_t* transform)
 {
    if (camera == cam)
    {
@@ -374,15 +900,15 @@ void diamond_render(float size, const vec3f_t* color, shader_t* shader)
       5, 2,
    };
 
-   shader_set_attrib_vertices(shader, "aPos", 3, GL_FLOAT, 0, &vertices[0]);
-   shader_set_attrib_vertices(shader, "aColor", 3, GL_FLOAT, 0, &colors[0]);
+   shader_set_attrib_vertices(shader, ATOM_aPos, 3, GL_FLOAT, 0, &vertices[0]);
+   shader_set_attrib_vertices(shader, ATOM_aColor, 3, GL_FLOAT, 0, &colors[0]);
    glDrawElements(GL_LINES, sizeof(indices)/sizeof(indices[0]), GL_UNSIGNED_INT, &indices[0]);
    checkGLError("glDrawElements");
 }
 
-void world_render_lamp(const world_t* world, const camera_t* camera, const lamp_t* lamp, const mat4f_t* transform)
+void world_render_lamp(const world_t* world, const camera_t* camera, const lamp_t* lamp, const affine_t* transform)
 {
-   material_t* material = resman_get_material(game->resman, "LampsMaterial");
+   material_t* material = resman_get_material(game->resman, ATOM_LampsMaterial);
    if (material == NULL)
       return;
 
@@ -390,13 +916,16 @@ void world_render_lamp(const world_t* world, const camera_t* camera, const lamp_
    if (shader == NULL)
       return;
 
-   mat4f_t mv;
+   affine_t view;
+   affine_t mv;
+   affine_from_mat4(&view, &camera->view);
+   affine_mult(&mv, &view, transform);
+
    mat4f_t mvp;
-   mat4_mult(&mv, &camera->view, transform);
-   mat4_mult(&mvp, &camera->proj, &mv);
+   mat4_mult_affine(&mvp, &camera->proj, &mv);
 
    shader_use(shader);
-   shader_set_uniform_matrices(shader, "uMVP", 1, mat4_data(&mvp));
+   shader_set_uniform_matrices(shader, ATOM_uMVP, 1, mat4_data(&mvp));
    diamond_render(0.25f, &lamp->color, shader);
    shader_unuse(shader);
 }
@@ -1,45 +1,128 @@
 #pragma once
 
 #include "mathlib.h"
+#include "atom.h"
 #include "material.h"
 #include "camera.h"
 #include "bbox.h"
 
+struct nodes_t;
+struct pvs_t;
+struct impostor_atlas_t;
+
+// written by tools/cooker after the dump of io_export_runner.py
+#define WORLD_FILE_VERSION 12
+
+// the world data follows at data_offset as a memory image, the bake tools
+// append to it and patch data_size
+struct file_header_t
+{
+   char magic[8];
+   long version;
+   long data_offset;
+   long data_size;
+};
+
+// the uv is the one of the default uvmap of the mesh, other uvmaps are
+// separate streams
 typedef struct vertex_t
 {
    vec3f_t point;
    vec3f_t normal;
+   vec2f_t uv;
 } vertex_t;
 
+// half the size of vertex_t, read by GL as normalized integers. Points span
+// the bounds of their mesh, see mesh_t, uvs the range of the default uvmap.
+// The w of the point only keeps the normal aligned.
+typedef struct vertex_packed_t
+{
+   unsigned short point[4];
+   signed char normal[4];
+   unsigned short uv[2];
+} vertex_packed_t;
+
 typedef struct uvmap_t
 {
-   char name[64];
+   atom_t name;
+
+   // packed uvs are offset + scale * uv / 65535
+   vec2f_t offset;
+   vec2f_t scale;
 
    unsigned long nuvs;
 
-   vec2f_t* uvs;
+   // vec2f_t or unsigned short[2], after the format of the mesh. NULL for
+   // the default uvmap, which is interleaved with the vertices.
+   void* uvs;
 } uvmap_t;
 
+// spatially coherent run of a few hundred triangles of a submesh, culled on
+// its own. Normals of its faces are within acos(cone_cutoff) of cone_axis,
+// a cutoff of zero or less means they spread too much for backface culling.
+typedef struct cluster_t
+{
+   bbox_t bounds;
+   vec3f_t cone_axis;
+   float cone_cutoff;
+
+   unsigned long first;
+   unsigned long nindices;
+} cluster_t;
+
+// simplified version of a submesh reusing the vertices of its mesh, its
+// indices follow the full ones. The error bounds how far the surface moved,
+// in mesh units, and grows from one level to the next.
+typedef struct lod_t
+{
+   float error;
+
+   unsigned long first;
+   unsigned long nindices;
+} lod_t;
+
+// indices are unsigned short or unsigned int after index_size and count
+// from base_vertex of the mesh. The cooker splits meshes so that every
+// submesh gets by with 16 bit indices, GLES2 only draws those everywhere.
 typedef struct submesh_t
 {
-   char material[64];
+   atom_t material;
+
+   unsigned long base_vertex;
+   unsigned long index_size;
 
    unsigned long nindices;
+   unsigned long nclusters;
+   unsigned long nlods;
 
-   unsigned int* indices;
+   void* indices;
+   struct cluster_t* clusters;
+   struct lod_t* lods;
 } submesh_t;
 
 typedef struct mesh_t
 {
-   char name[64];
+   atom_t name;
 
    unsigned long active_uvmap;
 
+   // picked per mesh by the cooker, meshes packed within its error budget
+   // store vertex_packed_t with points at offset + scale * point / 65535
+   enum
+   {
+      VERTEX_FLOAT = 0,
+      VERTEX_PACKED,
+   } format;
+
+   vec3f_t offset;
+   vec3f_t scale;
+
    unsigned long nvertices;
    unsigned long nuvmaps;
    unsigned long nsubmeshes;
 
-   struct vertex_t* vertices;
+   // vertex_t or vertex_packed_t, read them with mesh_get_point and friends
+   void* vertices;
    struct uvmap_t* uvmaps;
    struct submesh_t* submeshes;
 } mesh_t;
@@ -91,8 +174,8 @@ typedef struct phys_t
 
 typedef struct node_t
 {
-   char name[64];
-   char data[64];
+   atom_t name;
+   atom_t data;
 
    enum
    {
@@ -107,12 +190,19 @@ typedef struct node_t
    struct phys_t phys;
 
    long parent_index;
+
+   // set by the exporter for meshes hiding what is behind them, see
+   // occlusion.h
+   unsigned long occluder;
+
+   // nodes farther from the camera are not drawn, zero draws at any distance
+   float draw_distance;
 } node_t;
 
 typedef struct texture_t
 {
-   char name[64];
-   char path[64];
+   atom_t name;
+   atom_t path;
 
    unsigned long min_filter;
    unsigned long mag_filter;
@@ -122,7 +212,7 @@ typedef struct texture_t
 
 typedef struct lamp_t
 {
-   char name[64];
+   atom_t name;
 
    enum
    {
@@ -147,18 +237,21 @@ typedef struct lamp_t
 
 typedef struct scene_t
 {
-   char name[64];
-   char camera[64];
+   atom_t name;
+   atom_t camera;
 
    vec3f_t gravity;
 
    unsigned long nnodes;
    struct node_t* nodes;
+
+   // written by tools/pvs_bake, NULL for scenes that were not baked
+   struct pvs_t* pvs;
 } scene_t;
 
 typedef struct world_t
 {
-   char name[64];
+   atom_t name;
 
    unsigned long ncameras;
    unsigned long nmaterials;
@@ -166,6 +259,7 @@ typedef struct world_t
    unsigned long nmeshes;
    unsigned long nlamps;
    unsigned long nscenes;
+   unsigned long nstrings;
 
    struct camera_t* cameras;
    struct material_t* materials;
@@ -173,22 +267,41 @@ typedef struct world_t
    struct mesh_t* meshes;
    struct lamp_t* lamps;
    struct scene_t* scenes;
+
+   // nstrings NUL terminated names, every atom_t of the file is an index
+   // into them until world_init interns them
+   char* strings;
+
+   // written by tools/impostor_bake, NULL for worlds that were not baked
+   struct impostor_atlas_t* impostors;
 } world_t;
 
+int world_check_header(const struct file_header_t* header, long fsize);
+int world_read_image(char** pimage, long* psize, const char* fname);
+int world_load_from_image(world_t** pworld, const char* image);
+long world_append_blob(char** pimage, long* psize, const void* blob, long size);
+int world_write_image(const char* image, long size, const char* fname);
 int world_load_from_file(world_t** pworld, const char* fname);
-int world_init(world_t** pworld, char* data);
+int world_init(world_t** pworld, char* data, long size);
 void world_free(world_t* world);
 
-camera_t* world_get_camera(const world_t* world, const char* name);
-material_t* world_get_material(const world_t* world, const char* name);
-texture_t* world_get_texture(const world_t* world, const char* name);
-mesh_t* world_get_mesh(const world_t* world, const char* name);
-lamp_t* world_get_lamp(const world_t* world, const char* name);
-scene_t* world_get_scene(const world_t* world, const char* name);
-node_t* scene_get_node(const scene_t* scene, const char* name);
-node_t* scene_pick_node(const world_t* world, const scene_t* scene, const vec2f_t* point);
-
-void world_render_mesh(const world_t* world, const struct camera_t* camera, const mesh_t* mesh, const mat4f_t* transform);
-void world_render_camera(const world_t* world, const camera_t* camera, const camera_t* cam, const mat4f_t* transform);
-void world_render_lamp(const world_t* world, const camera_t* camera, const lamp_t* lamp, const mat4f_t* transform);
+camera_t* world_get_camera(const world_t* world, atom_t name);
+material_t* world_get_material(const world_t* world, atom_t name);
+texture_t* world_get_texture(const world_t* world, atom_t name);
+mesh_t* world_get_mesh(const world_t* world, atom_t name);
+lamp_t* world_get_lamp(const world_t* world, atom_t name);
+scene_t* world_get_scene(const world_t* world, atom_t name);
+node_t* scene_get_node(const scene_t* scene, atom_t name);
+node_t* scene_pick_node(const world_t* world, const scene_t* scene, const struct nodes_t* nodes, const vec2f_t* point);
+
+long mesh_select_lod(const mesh_t* mesh, float max_error);
+void mesh_unpack_transform(affine_t* transform, const mesh_t* mesh);
+void mesh_get_point(const mesh_t* mesh, unsigned long index, vec3f_t* point);
+void mesh_get_normal(const mesh_t* mesh, unsigned long index, vec3f_t* normal);
+void mesh_get_uv(const mesh_t* mesh, const uvmap_t* uvmap, unsigned long index, vec2f_t* uv);
+unsigned long submesh_get_index(const submesh_t* submesh, unsigned long i);
+
+void world_render_mesh(const world_t* world, const struct camera_t* camera, const mesh_t* mesh, const affine_t* transform, long lod);
+void world_render_camera(const world_t* world, const camera_t* camera, const camera_t* cam, const affine_t* transform);
+void world_render_lamp(const world_t* world, const camera_t* camera, const lamp_t* lamp, const affine_t* transform);
 
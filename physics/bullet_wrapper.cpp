@@ -1,5 +1,7 @@
 #include "physics.h"
+extern "C" {
 #include <world.h>
+}
 #include <logging.h>
 #include <btBulletDynamicsCommon.h>
 
@@ -8,6 +10,12 @@ static inline btVector3 vc(const vec3f_t* v)
    return btVector3(v->x, v->y, v->z);
 }
 
+static inline vec3f_t cv(const btVector3& v)
+{
+   vec3f_t r = { v[0], v[1], v[2] };
+   return r;
+}
+
 class MotionStateProxy : public btMotionState
 {
    motionstate_setter mSetter;
@@ -85,6 +93,163 @@ private:
    physics_debug_draw_line mDrawLine;
 };
 
+struct ContactPair
+{
+   const btCollisionObject* a;
+   const btCollisionObject* b;
+   void* user_data_a;
+   void* user_data_b;
+   float impulse;
+};
+
+struct ContactPairLess
+{
+   bool operator()(const ContactPair& lhs, const ContactPair& rhs) const
+   {
+      return (lhs.a != rhs.a) ? (lhs.a < rhs.a) : (lhs.b < rhs.b);
+   }
+};
+
+// Dynamics world which remembers the touching pairs of the previous step.
+// Pair tables and the event array grow to the high water mark and are then
+// reused, so steady state stepping does not allocate.
+class PhysicsWorld : public btDiscreteDynamicsWorld
+{
+   enum { INITIAL_CAPACITY = 1024 };
+
+   btAlignedObjectArray<ContactPair> mPairs[2];
+   int mCurrent;
+
+public:
+   btAlignedObjectArray<physics_contact_event_t> mEvents;
+
+public:
+   PhysicsWorld(btDispatcher* dispatcher, btBroadphaseInterface* pairCache, btConstraintSolver* constraintSolver, btCollisionConfiguration* collisionConfiguration)
+      : btDiscreteDynamicsWorld(dispatcher, pairCache, constraintSolver, collisionConfiguration)
+      , mCurrent (0)
+   {
+      mPairs[0].reserve(INITIAL_CAPACITY);
+      mPairs[1].reserve(INITIAL_CAPACITY);
+      mEvents.reserve(INITIAL_CAPACITY);
+   }
+
+   // the world is released without running its destructor (bodies may be
+   // gone already), so the tables have to be freed explicitly
+   void releaseContactEvents()
+   {
+      mPairs[0].clear();
+      mPairs[1].clear();
+      mEvents.clear();
+   }
+
+   void updateContactEvents()
+   {
+      const btAlignedObjectArray<ContactPair>& previous = mPairs[mCurrent];
+      mCurrent ^= 1;
+      btAlignedObjectArray<ContactPair>& current = mPairs[mCurrent];
+      current.resize(0);
+
+      btDispatcher* dispatcher = getDispatcher();
+      int nmanifolds = dispatcher->getNumManifolds();
+      int i = 0;
+      for (i = 0; i < nmanifolds; ++i)
+      {
+         const btPersistentManifold* manifold = dispatcher->getManifoldByIndexInternal(i);
+         int ncontacts = manifold->getNumContacts();
+         if (ncontacts == 0)
+            continue;
+
+         const btCollisionObject* a = (const btCollisionObject*)manifold->getBody0();
+         const btCollisionObject* b = (const btCollisionObject*)manifold->getBody1();
+         if (b < a)
+         {
+            btSwap(a, b);
+         }
+
+         ContactPair pair = { a, b, a->getUserPointer(), b->getUserPointer(), 0.0f };
+         int j = 0;
+         for (j = 0; j < ncontacts; ++j)
+         {
+            pair.impulse += manifold->getContactPoint(j).getAppliedImpulse();
+         }
+         current.push_back(pair);
+      }
+
+      current.quickSort(ContactPairLess());
+
+      // compound and concave shapes may produce several manifolds per pair
+      int npairs = 0;
+      for (i = 0; i < current.size(); ++i)
+      {
+         if (npairs > 0 && current[npairs - 1].a == current[i].a && current[npairs - 1].b == current[i].b)
+         {
+            current[npairs - 1].impulse += current[i].impulse;
+            continue;
+         }
+         current[npairs++] = current[i];
+      }
+      current.resize(npairs);
+
+      // both tables are sorted, so a single merge pass classifies every pair
+      mEvents.resize(0);
+      ContactPairLess less;
+      int p = 0;
+      int c = 0;
+      while (p < previous.size() || c < current.size())
+      {
+         physics_contact_event_t event;
+         const ContactPair* pair = NULL;
+
+         if (c == current.size() || (p < previous.size() && less(previous[p], current[c])))
+         {
+            pair = &previous[p++];
+            event.type = physics_contact_event_t::CONTACT_END;
+            event.impulse = 0.0f;
+         }
+         else
+         {
+            pair = &current[c];
+            if (p < previous.size() && !less(current[c], previous[p]))
+            {
+               event.type = physics_contact_event_t::CONTACT_PERSIST;
+               ++p;
+            }
+            else
+            {
+               event.type = physics_contact_event_t::CONTACT_BEGIN;
+            }
+            event.impulse = current[c++].impulse;
+         }
+
+         event.user_data_a = pair->user_data_a;
+         event.user_data_b = pair->user_data_b;
+         mEvents.push_back(event);
+      }
+   }
+};
+
+// The sweep and prune broadphase keeps a dynamic aabb tree of all proxies to
+// speed up ray tests, it is reused for frustum queries.
+class AxisSweep : public btAxisSweep3
+{
+public:
+   AxisSweep(const btVector3& worldAabbMin, const btVector3& worldAabbMax)
+      : btAxisSweep3(worldAabbMin, worldAabbMax)
+   { }
+
+   const btDbvtBroadphase* getAccelerator() const
+   {
+      return m_raycastAccelerator;
+   }
+};
+
+// replaces the allocator of bullet for the whole process, call it before
+// creating any world so that every block is freed by the hook that made it
+void physics_set_alloc_hooks(physics_alloc_func alloc, physics_free_func free)
+{
+   btAlignedAllocSetCustom(alloc, free);
+}
+
 int physics_world_create(struct physics_world_t** pworld, const vec3f_t* aabbMin, const vec3f_t* aabbMax, physics_debug_draw_line drawLine)
 {
    void* mem = btAlignedAlloc(sizeof(btDefaultCollisionConfiguration), 16);
@@ -93,14 +258,14 @@ int physics_world_create(struct physics_world_t** pworld, const vec3f_t* aabbMin
    mem = btAlignedAlloc(sizeof(btCollisionDispatcher), 16);
    btDispatcher* dispatcher = new (mem) btCollisionDispatcher(collisionConfiguration);
 
-   mem = btAlignedAlloc(sizeof(btAxisSweep3), 16);
-   btBroadphaseInterface* pairCache = new (mem) btAxisSweep3(vc(aabbMin), vc(aabbMax));
+   mem = btAlignedAlloc(sizeof(AxisSweep), 16);
+   btBroadphaseInterface* pairCache = new (mem) AxisSweep(vc(aabbMin), vc(aabbMax));
 
    mem = btAlignedAlloc(sizeof(btSequentialImpulseConstraintSolver), 16);
    btConstraintSolver* constraintSolver = new (mem) btSequentialImpulseConstraintSolver();
 
-   mem = btAlignedAlloc(sizeof(btDiscreteDynamicsWorld), 16);
-   btDiscreteDynamicsWorld* world = new (mem) btDiscreteDynamicsWorld(dispatcher, pairCache, constraintSolver, collisionConfiguration);
+   mem = btAlignedAlloc(sizeof(PhysicsWorld), 16);
+   PhysicsWorld* world = new (mem) PhysicsWorld(dispatcher, pairCache, constraintSolver, collisionConfiguration);
 
    world->setDebugDrawer(new DebugDrawer(drawLine));
 
@@ -110,6 +275,7 @@ int physics_world_create(struct physics_world_t** pworld, const vec3f_t* aabbMin
 
 void physics_world_delete(struct physics_world_t* world)
 {
+   ((PhysicsWorld*)world)->releaseContactEvents();
    btAlignedFree(world);
 }
 
@@ -125,7 +291,23 @@ void physics_world_remove_rigid_body(struct physics_world_t* world, struct physi
 
 void physics_world_step(struct physics_world_t* world, float timeStep, int maxSteps, float internalTimeStep)
 {
-   ((btDiscreteDynamicsWorld*)world)->stepSimulation(timeStep, maxSteps, internalTimeStep);
+   PhysicsWorld* w = (PhysicsWorld*)world;
+   if (w->stepSimulation(timeStep, maxSteps, internalTimeStep) > 0)
+   {
+      w->updateContactEvents();
+   }
+   else
+   {
+      // nothing was simulated, so there is nothing new to report
+      w->mEvents.resize(0);
+   }
+}
+
+long physics_world_get_contact_events(const struct physics_world_t* world, const struct physics_contact_event_t** events)
+{
+   const PhysicsWorld* w = (const PhysicsWorld*)world;
+   (*events) = (w->mEvents.size() > 0) ? &w->mEvents[0] : NULL;
+   return w->mEvents.size();
 }
 
 void physics_world_set_gravity(struct physics_world_t* world, const vec3f_t* gravity)
@@ -138,8 +320,258 @@ void physics_world_debug_draw(const struct physics_world_t* world)
    ((btDiscreteDynamicsWorld*)world)->debugDrawWorld();
 }
 
+void physics_world_get_stats(const struct physics_world_t* world, struct physics_stats_t* stats)
+{
+   btDiscreteDynamicsWorld* w = (btDiscreteDynamicsWorld*)world;
+   btDispatcher* dispatcher = w->getDispatcher();
+
+   stats->nbodies = w->getNumCollisionObjects();
+   stats->npairs = w->getBroadphase()->getOverlappingPairCache()->getNumOverlappingPairs();
+   stats->nmanifolds = dispatcher->getNumManifolds();
+   stats->ncontacts = 0;
+
+   int i = 0;
+   for (i = 0; i < stats->nmanifolds; ++i)
+   {
+      stats->ncontacts += dispatcher->getManifoldByIndexInternal(i)->getNumContacts();
+   }
+}
+
+static void collect_profile_zones(CProfileIterator* iterator, struct physics_profile_t* profile, int parent, int depth)
+{
+   int nchildren = 0;
+   for (iterator->First(); !iterator->Is_Done(); iterator->Next())
+   {
+      ++nchildren;
+   }
+
+   int i = 0;
+   for (i = 0; i < nchildren && profile->nzones < PHYSICS_MAX_PROFILE_ZONES; ++i)
+   {
+      iterator->Enter_Child(i);
+
+      int index = profile->nzones++;
+      physics_profile_zone_t* zone = &profile->zones[index];
+      zone->name = iterator->Get_Current_Parent_Name();
+      zone->parent = parent;
+      zone->depth = depth;
+      zone->calls = iterator->Get_Current_Parent_Total_Calls();
+      zone->time = iterator->Get_Current_Parent_Total_Time();
+
+      collect_profile_zones(iterator, profile, index, depth + 1);
+      iterator->Enter_Parent();
+   }
+}
+
+int physics_world_get_profile(const struct physics_world_t* world, struct physics_profile_t* profile)
+{
+   profile->step_time = 0.0f;
+   profile->nzones = 0;
+
+#ifdef BT_NO_PROFILE
+   return -1;
+#else
+   // Bullet keeps a single global profile tree which stepSimulation resets,
+   // so it always describes the most recent step of any world
+   CProfileIterator* iterator = CProfileManager::Get_Iterator();
+   collect_profile_zones(iterator, profile, -1, 0);
+   CProfileManager::Release_Iterator(iterator);
+
+   profile->step_time = CProfileManager::Get_Time_Since_Reset();
+   return 0;
+#endif
+}
+
+void physics_profile_show(const struct physics_profile_t* profile)
+{
+   static const char indent[] = "                                ";
+
+   LOGI("Physics profile: %.3f ms", profile->step_time);
+
+   int i = 0;
+   for (i = 0; i < profile->nzones; ++i)
+   {
+      const physics_profile_zone_t* zone = &profile->zones[i];
+      float parent_time = (zone->parent >= 0) ? profile->zones[zone->parent].time : profile->step_time;
+      float percent = (parent_time > 0.0f) ? zone->time * 100.0f / parent_time : 0.0f;
+      int spacing = (zone->depth < 15) ? zone->depth * 2 + 2 : 32;
+      LOGI("%s%s: %.3f ms (%.1f%%) %d calls", &indent[sizeof(indent) - 1 - spacing], zone->name, zone->time, percent, zone->calls);
+   }
+}
+
+static void reset_hit(struct physics_hit_t* hit, const btVector3& to)
+{
+   hit->user_data = NULL;
+   hit->point = cv(to);
+   hit->normal.x = hit->normal.y = hit->normal.z = 0.0f;
+   hit->fraction = 1.0f;
+}
+
+int physics_world_raycast(const struct physics_world_t* world, const vec3f_t* from, const vec3f_t* to, struct physics_hit_t* hit)
+{
+   btVector3 rayFrom = vc(from);
+   btVector3 rayTo = vc(to);
+
+   btCollisionWorld::ClosestRayResultCallback callback(rayFrom, rayTo);
+   ((const btDiscreteDynamicsWorld*)world)->rayTest(rayFrom, rayTo, callback);
+
+   reset_hit(hit, rayTo);
+   if (!callback.hasHit())
+   {
+      return 0;
+   }
+
+   hit->user_data = callback.m_collisionObject->getUserPointer();
+   hit->point = cv(callback.m_hitPointWorld);
+   hit->normal = cv(callback.m_hitNormalWorld.normalized());
+   hit->fraction = callback.m_closestHitFraction;
+   return 1;
+}
+
+long physics_world_raycast_batch(const struct physics_world_t* world, const vec3f_t* from, const vec3f_t* to, long nrays, struct physics_hit_t* hits)
+{
+   long nhits = 0;
+   long l = 0;
+   for (l = 0; l < nrays; ++l)
+   {
+      nhits += physics_world_raycast(world, &from[l], &to[l], &hits[l]);
+   }
+   return nhits;
+}
+
+int physics_world_convex_sweep(const struct physics_world_t* world, const struct physics_shape_t* shape, const mat4f_t* from, const mat4f_t* to, struct physics_hit_t* hit)
+{
+   const btCollisionShape* castShape = (const btCollisionShape*)shape;
+   if (!castShape->isConvex())
+   {
+      LOGE("Unable to sweep non-convex shape: %s", castShape->getName());
+      return 0;
+   }
+
+   btTransform sweepFrom;
+   btTransform sweepTo;
+   sweepFrom.setFromOpenGLMatrix(from->m);
+   sweepTo.setFromOpenGLMatrix(to->m);
+
+   btCollisionWorld::ClosestConvexResultCallback callback(sweepFrom.getOrigin(), sweepTo.getOrigin());
+   ((const btDiscreteDynamicsWorld*)world)->convexSweepTest((const btConvexShape*)castShape, sweepFrom, sweepTo, callback);
+
+   reset_hit(hit, sweepTo.getOrigin());
+   if (!callback.hasHit())
+   {
+      return 0;
+   }
+
+   hit->user_data = callback.m_hitCollisionObject->getUserPointer();
+   hit->point = cv(callback.m_hitPointWorld);
+   hit->normal = cv(callback.m_hitNormalWorld.normalized());
+   hit->fraction = callback.m_closestHitFraction;
+   return 1;
+}
+
+class OverlapCallback : public btBroadphaseAabbCallback
+{
+   void** mUserData;
+   long mMaxResults;
+
+public:
+   long mCount;
+
+public:
+   OverlapCallback(void** user_data, long max_results)
+      : mUserData (user_data)
+      , mMaxResults (max_results)
+      , mCount (0)
+   { }
+
+   // every overlap is counted, even past the room of user_data
+   virtual bool process(const btBroadphaseProxy* proxy)
+   {
+      if (mCount < mMaxResults)
+      {
+         const btCollisionObject* object = (const btCollisionObject*)proxy->m_clientObject;
+         mUserData[mCount] = object->getUserPointer();
+      }
+      ++mCount;
+      return true;
+   }
+};
+
+long physics_world_overlap_aabb(const struct physics_world_t* world, const vec3f_t* aabbMin, const vec3f_t* aabbMax, void** user_data, long max_results)
+{
+   OverlapCallback callback(user_data, max_results);
+   ((btDiscreteDynamicsWorld*)world)->getBroadphase()->aabbTest(vc(aabbMin), vc(aabbMax), callback);
+   return callback.mCount;
+}
+
+class CullCallback : public btDbvt::ICollide
+{
+   void** mUserData;
+   long mMaxResults;
+
+public:
+   long mCount;
+
+public:
+   CullCallback(void** user_data, long max_results)
+      : mUserData (user_data)
+      , mMaxResults (max_results)
+      , mCount (0)
+   { }
+
+   virtual void Process(const btDbvtNode* leaf)
+   {
+      const btBroadphaseProxy* proxy = (const btBroadphaseProxy*)leaf->data;
+      const btCollisionObject* object = (const btCollisionObject*)proxy->m_clientObject;
+      if (mCount < mMaxResults)
+      {
+         mUserData[mCount++] = object->getUserPointer();
+      }
+   }
+};
+
+// returns the bodies whose aabb is not fully outside one of the planes, static
+// and kinematic ones included, points with dot(plane.xyz, p) + plane.w >= 0
+// are inside like for frustum_t
+long physics_world_cull(const struct physics_world_t* world, const plane_t* planes, long nplanes, void** user_data, long max_results)
+{
+   const AxisSweep* broadphase = (const AxisSweep*)((const btDiscreteDynamicsWorld*)world)->getBroadphase();
+   const btDbvtBroadphase* accelerator = broadphase->getAccelerator();
+
+   // collideKDOP keeps the planes a subtree is inside of in a 32 bit mask
+   // and asserts there are fewer of them
+   if (accelerator == NULL || nplanes >= 32)
+   {
+      return -1;
+   }
+
+   btVector3 normals[32];
+   btScalar offsets[32];
+   long i = 0;
+   for (i = 0; i < nplanes; ++i)
+   {
+      normals[i] = btVector3(planes[i].x, planes[i].y, planes[i].z);
+      offsets[i] = planes[i].w;
+   }
+
+   // both sets of the tree are searched, like btDbvtBroadphase::aabbTest does
+   CullCallback callback(user_data, max_results);
+   for (i = 0; i < 2; ++i)
+   {
+      btDbvt::collideKDOP(accelerator->m_sets[i].m_root, normals, offsets, (int)nplanes, callback);
+   }
+   return callback.mCount;
+}
+
 void physics_rigid_body_delete(struct physics_rigid_body_t* body)
 {
+   if (body == NULL)
+   {
+      return;
+   }
+
+   // every body is created with a shape of its own
+   physics_shape_delete((physics_shape_t*)((btRigidBody*)body)->getCollisionShape());
    btAlignedFree(body);
 }
 
@@ -186,6 +618,26 @@ void physics_rigid_body_set_factors(struct physics_rigid_body_t* body, const str
    ((btRigidBody*)body)->setAngularFactor(vc(angular));
 }
 
+// bullet reads float points, the ones of packed meshes are unpacked to a
+// malloced array
+static struct vec3f_t* mesh_float_points(const struct mesh_t* mesh, long* pstride)
+{
+   if (mesh->format != mesh_t::VERTEX_PACKED)
+   {
+      (*pstride) = sizeof(vertex_t);
+      return &((struct vertex_t*)mesh->vertices)[0].point;
+   }
+
+   struct vec3f_t* points = (struct vec3f_t*)malloc(mesh->nvertices * sizeof(struct vec3f_t));
+   unsigned long l = 0;
+   for (l = 0; l < mesh->nvertices; ++l)
+   {
+      mesh_get_point(mesh, l, &points[l]);
+   }
+   (*pstride) = sizeof(struct vec3f_t);
+   return points;
+}
+
 int physics_rigid_body_create(struct physics_rigid_body_t** pbody, const struct phys_t* props, struct mesh_t* mesh, motionstate_setter setter, motionstate_getter getter, void* user_data)
 {
    if (props->type == phys_t::PHYS_NOCOLLISION)
@@ -193,8 +645,6 @@ int physics_rigid_body_create(struct physics_rigid_body_t** pbody, const struct
       return -1;
    }
 
-   unsigned long l = 0;
-
    const struct shape_t* sp = &props->shape;
    physics_shape_t* s = NULL;
    switch (sp->type)
@@ -204,7 +654,7 @@ int physics_rigid_body_create(struct physics_rigid_body_t** pbody, const struct
       break;
 
    case shape_t::SHAPE_CYLINDER:
-      LOGI("CYLINDER: %.2f %.2f", sp->radius, sp->extents.z);
+      LOGD("CYLINDER: %.2f %.2f", sp->radius, sp->extents.z);
       physics_shape_create_cylinder(&s, sp->radius, sp->extents.z / 2.0f);
       break;
 
@@ -213,19 +663,22 @@ int physics_rigid_body_create(struct physics_rigid_body_t** pbody, const struct
       break;
 
    case shape_t::SHAPE_CONVEX:
-      physics_shape_create_convex(&s, &mesh->vertices[0].point, mesh->nvertices, sizeof(vertex_t));
-      break;
-
-   case shape_t::SHAPE_CONCAVE:
    {
-      const struct submesh_t* submesh = &mesh->submeshes[0];
-      for (l = 0; l < mesh->nsubmeshes; ++l, ++submesh)
+      // the hull copies the points
+      long stride = 0;
+      struct vec3f_t* points = mesh_float_points(mesh, &stride);
+      physics_shape_create_convex(&s, points, mesh->nvertices, stride);
+      if (mesh->format == mesh_t::VERTEX_PACKED)
       {
-         physics_shape_create_concave(&s, &mesh->vertices[0].point, mesh->nvertices, sizeof(vertex_t), &submesh->indices[0], submesh->nindices, 3*sizeof(int));
+         free(points);
       }
       break;
    }
 
+   case shape_t::SHAPE_CONCAVE:
+      physics_shape_create_concave(&s, mesh);
+      break;
+
    default:
       LOGE("Unknown shape type: %d", sp->type);
       return -1;
@@ -240,12 +693,12 @@ int physics_rigid_body_create(struct physics_rigid_body_t** pbody, const struct
    physics_shape_set_margin(s, sp->margin);
 
    float mass = (props->type == phys_t::PHYS_RIGID) ? props->mass : 0.0f;
-   LOGI("MASS: %.2f INERTIA FACTOR: %.2f", mass, props->inertia_factor);
-   LOGI("SLEEPING THRESHOLDS: %.2f %.2f", props->linear_sleeping_threshold, props->angular_sleeping_threshold);
-   LOGI("FRICTION: %.2f RESTITUTION: %.2f", props->friction, props->restitution);
-   LOGI("FACTORS: %.2f %.2f", props->linear_factor, props->angular_factor);
-   LOGI("DAMPING: %.2f %.2f", props->linear_damping, props->angular_damping);
-   LOGI("MARGIN: %.2f", sp->margin);
+   LOGD("MASS: %.2f INERTIA FACTOR: %.2f", mass, props->inertia_factor);
+   LOGD("SLEEPING THRESHOLDS: %.2f %.2f", props->linear_sleeping_threshold, props->angular_sleeping_threshold);
+   LOGD("FRICTION: %.2f RESTITUTION: %.2f", props->friction, props->restitution);
+   LOGD("FACTORS: %.2f %.2f", props->linear_factor, props->angular_factor);
+   LOGD("DAMPING: %.2f %.2f", props->linear_damping, props->angular_damping);
+   LOGD("MARGIN: %.2f", sp->margin);
 
    btVector3 localInertia(0, 0, 0);
    if (mass)
@@ -316,24 +769,68 @@ int physics_shape_create_sphere(struct physics_shape_t** pshape, float radius)
    return 0;
 }
 
-int physics_shape_create_concave(struct physics_shape_t** pshape, const struct vec3f_t* vertices, long nvertices, long vertices_stride, const unsigned int* indices, long nindices, long indices_stride)
+// the triangle mesh keeps pointing at its vertex array and at the points, so
+// the shape owns both, together with the unpacked points of a packed mesh
+class ConcaveShape : public btBvhTriangleMeshShape
+{
+public:
+   btTriangleIndexVertexArray* mData;
+   struct vec3f_t* mPoints;
+
+public:
+   ConcaveShape(btTriangleIndexVertexArray* data, struct vec3f_t* points)
+      : btBvhTriangleMeshShape(data, true, true)
+      , mData (data)
+      , mPoints (points)
+   { }
+};
+
+// one triangle mesh with an indexed mesh per submesh, each indexing the points
+// from its base vertex on
+int physics_shape_create_concave(struct physics_shape_t** pshape, const struct mesh_t* mesh)
 {
-   btIndexedMesh mesh;
-   mesh.m_numTriangles = nindices / 3;
-   mesh.m_triangleIndexBase = (const unsigned char*)indices;
-   mesh.m_triangleIndexStride = indices_stride;
-   mesh.m_numVertices = nvertices;
-   mesh.m_vertexBase = (const unsigned char*)vertices;
-   mesh.m_vertexStride = vertices_stride;
-   mesh.m_indexType = PHY_INTEGER;
-   mesh.m_vertexType = PHY_FLOAT;
+   long stride = 0;
+   struct vec3f_t* points = mesh_float_points(mesh, &stride);
 
    void* mem = btAlignedAlloc(sizeof(btTriangleIndexVertexArray), 16);
    btTriangleIndexVertexArray* data = new (mem) btTriangleIndexVertexArray();
-   data->addIndexedMesh(mesh);
 
-   mem = btAlignedAlloc(sizeof(btBvhTriangleMeshShape), 16);
-   btBvhTriangleMeshShape* shape = new (mem) btBvhTriangleMeshShape(data, true, true);
+   long l = 0;
+   for (l = 0; l < (long)mesh->nsubmeshes; ++l)
+   {
+      const struct submesh_t* submesh = &mesh->submeshes[l];
+      if (submesh->nindices < 3)
+      {
+         continue;
+      }
+
+      btIndexedMesh part;
+      part.m_numTriangles = submesh->nindices / 3;
+      part.m_triangleIndexBase = (const unsigned char*)submesh->indices;
+      part.m_triangleIndexStride = 3 * submesh->index_size;
+      part.m_numVertices = mesh->nvertices - submesh->base_vertex;
+      part.m_vertexBase = (const unsigned char*)points + submesh->base_vertex * stride;
+      part.m_vertexStride = stride;
+      part.m_indexType = (submesh->index_size == 2) ? PHY_SHORT : PHY_INTEGER;
+      part.m_vertexType = PHY_FLOAT;
+      data->addIndexedMesh(part, part.m_indexType);
+   }
+
+   if (data->getNumSubParts() == 0)
+   {
+      LOGE("Mesh '%s' has no triangles to collide with", atom_name(mesh->name));
+      data->~btTriangleIndexVertexArray();
+      btAlignedFree(data);
+      if (mesh->format == mesh_t::VERTEX_PACKED)
+      {
+         free(points);
+      }
+      (*pshape) = NULL;
+      return -1;
+   }
+
+   mem = btAlignedAlloc(sizeof(ConcaveShape), 16);
+   ConcaveShape* shape = new (mem) ConcaveShape(data, (mesh->format == mesh_t::VERTEX_PACKED) ? points : NULL);
 
    (*pshape) = (physics_shape_t*)shape;
    return 0;
@@ -349,6 +846,15 @@ int physics_shape_create_convex(struct physics_shape_t** pshape, const struct ve
 
 void physics_shape_delete(struct physics_shape_t* shape)
 {
+   if (((btCollisionShape*)shape)->getShapeType() == TRIANGLE_MESH_SHAPE_PROXYTYPE)
+   {
+      ConcaveShape* concave = (ConcaveShape*)shape;
+      btTriangleIndexVertexArray* data = concave->mData;
+      free(concave->mPoints);
+      concave->~ConcaveShape();
+      data->~btTriangleIndexVertexArray();
+      btAlignedFree(data);
+   }
    btAlignedFree(shape);
 }
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stddef.h>
 #include <mathlib.h>
 
 struct physics_world_t;
@@ -9,14 +10,66 @@ struct physics_shape_t;
 struct phys_t;
 struct mesh_t;
 
+#define PHYSICS_MAX_PROFILE_ZONES 64
+
 #ifdef __cplusplus
 extern "C" { 
 #endif
 
    typedef void (*motionstate_getter)(const struct physics_rigid_body_t* body, mat4f_t* transform, void* user_data);
    typedef void (*motionstate_setter)(const struct physics_rigid_body_t* body, const mat4f_t* transform, void* user_data);
+   typedef void* (*physics_alloc_func)(size_t size);
+   typedef void (*physics_free_func)(void* ptr);
    typedef void (*physics_debug_draw_line)(const struct vec3f_t* from, const vec3f_t* to, const vec3f_t* color);
 
+   typedef struct physics_hit_t
+   {
+      void* user_data;
+      vec3f_t point;
+      vec3f_t normal;
+      float fraction;
+   } physics_hit_t;
+
+   typedef struct physics_contact_event_t
+   {
+      enum
+      {
+         CONTACT_BEGIN = 0,
+         CONTACT_PERSIST,
+         CONTACT_END,
+      } type;
+
+      void* user_data_a;
+      void* user_data_b;
+      float impulse;
+   } physics_contact_event_t;
+
+   typedef struct physics_stats_t
+   {
+      long nbodies;
+      long npairs;
+      long nmanifolds;
+      long ncontacts;
+   } physics_stats_t;
+
+   typedef struct physics_profile_zone_t
+   {
+      const char* name;
+      int parent;
+      int depth;
+      int calls;
+      float time;
+   } physics_profile_zone_t;
+
+   typedef struct physics_profile_t
+   {
+      float step_time;
+      int nzones;
+      physics_profile_zone_t zones[PHYSICS_MAX_PROFILE_ZONES];
+   } physics_profile_t;
+
+   void physics_set_alloc_hooks(physics_alloc_func alloc, physics_free_func free);
+
    int physics_world_create(struct physics_world_t** pworld, const vec3f_t* aabbMin, const vec3f_t* aabbMax, physics_debug_draw_line drawLine);
    void physics_world_delete(struct physics_world_t* world);
    void physics_world_add_rigid_body(struct physics_world_t* world, struct physics_rigid_body_t* body);
@@ -24,6 +77,18 @@ extern "C" {
    void physics_world_step(struct physics_world_t* world, float timeStep, int maxSteps, float internalTimeStep);
    void physics_world_set_gravity(struct physics_world_t* world, const vec3f_t* gravity);
    void physics_world_debug_draw(const struct physics_world_t* world);
+   void physics_world_get_stats(const struct physics_world_t* world, struct physics_stats_t* stats);
+   long physics_world_get_contact_events(const struct physics_world_t* world, const struct physics_contact_event_t** events);
+   int physics_world_get_profile(const struct physics_world_t* world, struct physics_profile_t* profile);
+   void physics_profile_show(const struct physics_profile_t* profile);
+   int physics_world_raycast(const struct physics_world_t* world, const vec3f_t* from, const vec3f_t* to, struct physics_hit_t* hit);
+   // one physics_world_raycast per ray, hits[i] is reset for rays that miss
+   long physics_world_raycast_batch(const struct physics_world_t* world, const vec3f_t* from, const vec3f_t* to, long nrays, struct physics_hit_t* hits);
+   int physics_world_convex_sweep(const struct physics_world_t* world, const struct physics_shape_t* shape, const mat4f_t* from, const mat4f_t* to, struct physics_hit_t* hit);
+   // returns the number of overlapping bodies, only the first max_results of
+   // them are written to user_data
+   long physics_world_overlap_aabb(const struct physics_world_t* world, const vec3f_t* aabbMin, const vec3f_t* aabbMax, void** user_data, long max_results);
+   long physics_world_cull(const struct physics_world_t* world, const plane_t* planes, long nplanes, void** user_data, long max_results);
 
    int physics_rigid_body_create(struct physics_rigid_body_t** pbody, const struct phys_t* props, struct mesh_t* mesh, motionstate_setter setter, motionstate_getter getter, void* user_data);
    void physics_rigid_body_delete(struct physics_rigid_body_t* body);
@@ -43,7 +108,7 @@ extern "C" {
    int physics_shape_create_sphere(struct physics_shape_t** pshape, float radius);
    int physics_shape_create_compound(struct physics_shape_t** pshape);
    int physics_shape_create_convex(struct physics_shape_t** pshape, const struct vec3f_t* vertices, int nvertices, long stride);
-   int physics_shape_create_concave(struct physics_shape_t** pshape, const struct vec3f_t* vertices, long nvertices, long vertices_stride, const unsigned int* indices, long nindices, long indices_stride);
+   int physics_shape_create_concave(struct physics_shape_t** pshape, const struct mesh_t* mesh);
    void physics_shape_delete(struct physics_shape_t* shape);
    int physics_shape_add(struct physics_shape_t* shape, struct physics_shape_t* child, const struct vec3f_t* position, const quat_t* orientation);
    void physics_shape_set_margin(struct physics_shape_t* shape, float margin);
@@ -1,4 +1,4 @@
-attribute vec3 aPos;attribute vec2 aTexCoord;uniform mat4 uMVP;varying vec2 vTexCoord;void main(){vTexCoord=aTexCoord;gl_Position=uMVP*vec4(aPos.xyz,1.0);}
+attribute vec3 aPos;attribute vec2 aTexCoord;uniform mat4 uMVP;uniform vec3 uTexScale;uniform vec3 uTexOffset;varying vec2 vTexCoord;void main(){vTexCoord=aTexCoord*uTexScale.xy+uTexOffset.xy;gl_Position=uMVP*vec4(aPos.xyz,1.0);}
 
 precision mediump float;varying vec2 vTexCoord;uniform sampler2D uTex;void main(){gl_FragColor=texture2D(uTex,vTexCoord);}
 
@@ -0,0 +1,6 @@
+attribute vec3 aPos;attribute vec2 aTexCoord;uniform mat4 uMVP;varying vec2 vTexCoord;void main(){vTexCoord=aTexCoord;gl_Position=uMVP*vec4(aPos.xyz,1.0);}
+
+precision mediump float;varying vec2 vTexCoord;uniform sampler2D uTex;void main(){vec4 color=texture2D(uTex,vTexCoord);if(color.a<0.5)discard;gl_FragColor=color;}
+
+
+
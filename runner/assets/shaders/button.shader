@@ -2,11 +2,13 @@
 attribute vec3 aPos;
 attribute vec2 aTexCoord;
 uniform mat4 uMVP;
+uniform vec3 uTexScale;
+uniform vec3 uTexOffset;
 varying vec2 vTexCoord;
 
 void main()
 {
-   vTexCoord = aTexCoord;
+   vTexCoord = aTexCoord * uTexScale.xy + uTexOffset.xy;
    gl_Position = uMVP * vec4(aPos.xyz, 1.0);
 }
 
@@ -3,6 +3,8 @@ attribute vec3 aPos;
 attribute vec3 aNormal;
 attribute vec2 aTexCoord;
 uniform mat4 uMVP;
+uniform vec3 uTexScale;
+uniform vec3 uTexOffset;
 uniform mat4 uMV;
 uniform mat4 uMVI;
 uniform vec3 uLightPos;
@@ -23,7 +25,7 @@ void main()
    E = normalize(-point);
    R = normalize(-reflect(L, N));
 
-   vTexCoord = aTexCoord;
+   vTexCoord = aTexCoord * uTexScale.xy + uTexOffset.xy;
    gl_Position = uMVP * vec4(aPos.xyz, 1.0);
 }
 
@@ -3,6 +3,8 @@ attribute vec3 aPos;
 attribute vec3 aNormal;
 attribute vec2 aTexCoord;
 uniform mat4 uMVP;
+uniform vec3 uTexScale;
+uniform vec3 uTexOffset;
 uniform mat4 uMV;
 uniform mat4 uMVI;
 uniform vec3 uLightPos;
@@ -19,7 +21,7 @@ void main()
    N = normalize(uMVI * vec4(aNormal.xyz, 0.0)).xyz;
    L = normalize(aux);
 
-   vTexCoord = aTexCoord;
+   vTexCoord = aTexCoord * uTexScale.xy + uTexOffset.xy;
    gl_Position = uMVP * vec4(aPos.xyz, 1.0);
 }
 
@@ -1,3 +1,4 @@
+#include <getopt.h>
 #include <GL/glew.h>
 #include <GL/glut.h>
 #include <runner.h>
@@ -143,8 +144,47 @@ int main(int argc, char** argv)
       return -1;
    }
 
+   static struct option long_options[] =
+   {
+      {"record",     required_argument, 0, 'r'},
+      {"replay",     required_argument, 0, 'p'},
+      {"fixed-dt",   required_argument, 0, 'd'},
+      {0, 0, 0, 0}
+   };
+
+   int option_index = 0;
+   int c = 0;
+
+   const char* record_file = NULL;
+   const char* replay_file = NULL;
+   float fixed_dt = 0.0f;
+   while ((c = getopt_long(argc, argv, "r:p:d:", long_options, &option_index)) != -1)
+   {
+      switch (c)
+      {
+         case 'r':
+            record_file = optarg;
+            break;
+         case 'p':
+            replay_file = optarg;
+            break;
+         case 'd':
+            fixed_dt = atof(optarg);
+            break;
+      }
+   }
+
    if (init(ASSETS_ROOT) == 0)
    {
+      if (replay_file != NULL)
+      {
+         replay_input(replay_file, fixed_dt);
+      }
+      else if (record_file != NULL)
+      {
+         record_input(record_file);
+      }
+
       glutDisplayFunc(display);
       glutReshapeFunc(reshape);
       glutMouseFunc(mouse);
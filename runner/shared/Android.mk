@@ -4,7 +4,7 @@ include $(CLEAR_VARS)
 
 LOCAL_MODULE		:= librunner
 LOCAL_CFLAGS		:= -Werror -O2
-LOCAL_SRC_FILES	:= runner.c
+LOCAL_SRC_FILES	:= runner.c recorder.c
 LOCAL_STATIC_LIBRARIES	:= engine
 LOCAL_EXPORT_C_INCLUDES := $(LOCAL_PATH)
 
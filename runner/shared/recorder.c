@@ -0,0 +1,102 @@
+#include "recorder.h"
+#include <common.h>
+#include <timestamp.h>
+
+struct file_header_t
+{
+   char magic[8];
+   unsigned int version;
+   unsigned int record_size;
+};
+
+struct recorder_t
+{
+   FILE* f;
+   timestamp_t start;
+};
+
+static int recorder_open(recorder_t** precorder, const char* fname, const char* mode)
+{
+   FILE* f = fopen(fname, mode);
+   if (f == NULL)
+   {
+      LOGE("Unable to open recording %s", fname);
+      return -1;
+   }
+
+   recorder_t* recorder = (recorder_t*)malloc(sizeof(recorder_t));
+   memset(recorder, 0, sizeof(recorder_t));
+   recorder->f = f;
+   timestamp_set(&recorder->start);
+
+   (*precorder) = recorder;
+   return 0;
+}
+
+int recorder_open_writer(recorder_t** precorder, const char* fname)
+{
+   LOGI("Recording input to %s", fname);
+
+   if (recorder_open(precorder, fname, "wb") != 0)
+   {
+      return -1;
+   }
+
+   struct file_header_t header = {{0}};
+   memcpy(header.magic, "RNNRINPT", sizeof(header.magic));
+   header.version = 1;
+   header.record_size = sizeof(record_t);
+   fwrite(&header, sizeof(header), 1, (*precorder)->f);
+   return 0;
+}
+
+int recorder_open_reader(recorder_t** precorder, const char* fname)
+{
+   LOGI("Replaying input from %s", fname);
+
+   if (recorder_open(precorder, fname, "rb") != 0)
+   {
+      return -1;
+   }
+
+   struct file_header_t header;
+   if (fread(&header, sizeof(header), 1, (*precorder)->f) != 1 ||
+         memcmp(header.magic, "RNNRINPT", sizeof(header.magic)) != 0 ||
+         header.record_size != sizeof(record_t))
+   {
+      LOGE("Invalid recording %s", fname);
+      recorder_close(*precorder);
+      (*precorder) = NULL;
+      return -1;
+   }
+   return 0;
+}
+
+void recorder_close(recorder_t* recorder)
+{
+   if (recorder != NULL)
+   {
+      fclose(recorder->f);
+      free(recorder);
+   }
+}
+
+void recorder_write(recorder_t* recorder, int type, int id, float x, float y)
+{
+   record_t record = {0};
+   record.type = (unsigned char)type;
+   record.id = (unsigned char)id;
+   record.time = (unsigned int)timestamp_elapsed(&recorder->start);
+   record.x = x;
+   record.y = y;
+   fwrite(&record, sizeof(record), 1, recorder->f);
+}
+
+int recorder_read(recorder_t* recorder, record_t* record)
+{
+   if (fread(record, sizeof(record_t), 1, recorder->f) != 1)
+   {
+      return -1;
+   }
+   return 0;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+typedef struct recorder_t recorder_t;
+
+typedef enum record_type_t
+{
+   RECORD_FRAME = 0,
+   RECORD_POINTER_DOWN,
+   RECORD_POINTER_UP,
+   RECORD_POINTER_MOVE,
+   RECORD_KEY_DOWN,
+   RECORD_KEY_UP,
+} record_type_t;
+
+typedef struct record_t
+{
+   unsigned char type;
+   unsigned char id;
+   unsigned short reserved;
+   unsigned int time;
+   float x;
+   float y;
+} record_t;
+
+int recorder_open_writer(recorder_t** precorder, const char* fname);
+int recorder_open_reader(recorder_t** precorder, const char* fname);
+void recorder_close(recorder_t* recorder);
+void recorder_write(recorder_t* recorder, int type, int id, float x, float y);
+int recorder_read(recorder_t* recorder, record_t* record);
@@ -9,10 +9,13 @@
 #include <resman.h>
 #include <game.h>
 #include <world.h>
+#include <hierarchy.h>
+#include <nodes.h>
 #include <material.h>
 #include <timestamp.h>
 #include <keys.h>
 #include <gl_defs.h>
+#include "recorder.h"
 
 typedef struct pointer_info_t
 {
@@ -101,6 +104,14 @@ static timestamp_t prev_time = {0};
 static timestamp_t fps_time = {0};
 static int done = 0;
 
+static recorder_t* recorder = NULL;
+static recorder_t* player = NULL;
+static float replay_dt = 0.0f;
+static long replay_frames = 0;
+static timestamp_t replay_time = {0};
+
+static float replay_frame(float dt);
+
 void update_control_state(int option, gui_t* gui, control_t* control)
 {
    if (control == NULL)
@@ -131,19 +142,19 @@ void update_control(int option, gui_t* gui, const char* name)
 
 int get_game_option(const control_t* control)
 {
-   if (strcmp(control->name, "GUI_BTN_DrawPhysics") == 0)
+   if (control->name == atom_find("GUI_BTN_DrawPhysics"))
    {
       return GAME_DRAW_PHYSICS;
    }
-   else if (strcmp(control->name, "GUI_BTN_DrawLamps") == 0)
+   else if (control->name == atom_find("GUI_BTN_DrawLamps"))
    {
       return GAME_DRAW_LAMPS;
    }
-   else if (strcmp(control->name, "GUI_BTN_DrawMeshes") == 0)
+   else if (control->name == atom_find("GUI_BTN_DrawMeshes"))
    {
       return GAME_DRAW_MESHES;
    }
-   else if (strcmp(control->name, "GUI_BTN_EnablePhysics") == 0)
+   else if (control->name == atom_find("GUI_BTN_EnablePhysics"))
    {
       return GAME_UPDATE_PHYSICS;
    }
@@ -254,6 +265,11 @@ void shutdown()
 {
    LOGI("shutdown");
 
+   recorder_close(recorder);
+   recorder = NULL;
+   recorder_close(player);
+   player = NULL;
+
    if (game != NULL)
    {
       game_free(game);
@@ -269,6 +285,7 @@ void resize(int width, int height)
    checkGLError("glViewport");
 
    game->camera->aspect = (float)width/(float)height;
+   game->viewport_height = height;
    glDepthRange(game->camera->znear, game->camera->zfar);
    checkGLError("glDepthRange");
 }
@@ -285,16 +302,16 @@ void deactivated()
 
 void skybox_render()
 {
-   material_t* mtl = resman_get_material(game->resman, "SkyboxMaterial");
+   material_t* mtl = resman_get_material(game->resman, ATOM_SkyboxMaterial);
    if (mtl == NULL)
       return;
 
    shader_t* shader = resman_get_shader(game->resman, mtl->shader);
 
    material_bind(mtl, 0);
-   shader_set_attrib_vertices(shader, "aPos", 3, GL_FLOAT, 0, skybox_vertices);
-   shader_set_attrib_vertices(shader, "aTexCoord", 2, GL_FLOAT, 0, skybox_tex_coords);
-   shader_set_attrib_vertices(shader, "aColor", 3, GL_FLOAT, 0, skybox_colors);
+   shader_set_attrib_vertices(shader, ATOM_aPos, 3, GL_FLOAT, 0, skybox_vertices);
+   shader_set_attrib_vertices(shader, ATOM_aTexCoord, 2, GL_FLOAT, 0, skybox_tex_coords);
+   shader_set_attrib_vertices(shader, ATOM_aColor, 3, GL_FLOAT, 0, skybox_colors);
 
    glCullFace(GL_BACK);
    glDepthFunc(GL_ALWAYS);
@@ -313,6 +330,18 @@ int update()
    }
 
    float dt = timers_update();
+   if (player != NULL)
+   {
+      dt = replay_frame(dt);
+      if (done)
+      {
+         return 1;
+      }
+   }
+   else if (recorder != NULL)
+   {
+      recorder_write(recorder, RECORD_FRAME, 0, dt, 0.0f);
+   }
 
    const float speed = 15.0f;
    camera_t* camera = game->camera;
@@ -366,7 +395,7 @@ int update()
    return 0;
 }
 
-void pointer_down(int pointerId, float x, float y)
+static void on_pointer_down(int pointerId, float x, float y)
 {
    LOGD("pointer #%d down: %.2f %.2f", pointerId, x, y);
 
@@ -385,7 +414,7 @@ void pointer_down(int pointerId, float x, float y)
    gui_dispatch_pointer_down(&game->gui, pointerId, &point);
 }
 
-void pointer_up(int pointerId, float x, float y)
+static void on_pointer_up(int pointerId, float x, float y)
 {
    LOGD("pointer #%d up: %.2f %.2f", pointerId, x, y);
 
@@ -403,7 +432,7 @@ void pointer_up(int pointerId, float x, float y)
    gui_dispatch_pointer_up(&game->gui, pointerId, &point);
 }
 
-void pointer_move(int pointerId, float x, float y)
+static void on_pointer_move(int pointerId, float x, float y)
 {
    LOGD("pointer #%d move: %.2f %.2f", pointerId, x, y);
 
@@ -479,7 +508,7 @@ void pointer_move(int pointerId, float x, float y)
    gui_dispatch_pointer_move(&game->gui, pointerId, &point);
 }
 
-void key_up(int key_code)
+static void on_key_up(int key_code)
 {
    LOGI("Key up: %d", key_code);
 
@@ -493,7 +522,7 @@ void key_up(int key_code)
    }
 }
 
-void key_down(int key_code)
+static void on_key_down(int key_code)
 {
    LOGI("Key down: %d", key_code);
 
@@ -502,3 +531,134 @@ void key_down(int key_code)
    key->state = KEY_INFO_DOWN;
 }
 
+void pointer_down(int pointerId, float x, float y)
+{
+   if (player != NULL)
+      return;
+
+   if (recorder != NULL)
+      recorder_write(recorder, RECORD_POINTER_DOWN, pointerId, x, y);
+
+   on_pointer_down(pointerId, x, y);
+}
+
+void pointer_up(int pointerId, float x, float y)
+{
+   if (player != NULL)
+      return;
+
+   if (recorder != NULL)
+      recorder_write(recorder, RECORD_POINTER_UP, pointerId, x, y);
+
+   on_pointer_up(pointerId, x, y);
+}
+
+void pointer_move(int pointerId, float x, float y)
+{
+   if (player != NULL)
+      return;
+
+   if (recorder != NULL)
+      recorder_write(recorder, RECORD_POINTER_MOVE, pointerId, x, y);
+
+   on_pointer_move(pointerId, x, y);
+}
+
+void key_up(int key_code)
+{
+   if (player != NULL)
+      return;
+
+   if (recorder != NULL)
+      recorder_write(recorder, RECORD_KEY_UP, key_code, 0.0f, 0.0f);
+
+   on_key_up(key_code);
+}
+
+void key_down(int key_code)
+{
+   if (player != NULL)
+      return;
+
+   if (recorder != NULL)
+      recorder_write(recorder, RECORD_KEY_DOWN, key_code, 0.0f, 0.0f);
+
+   on_key_down(key_code);
+}
+
+int record_input(const char* fname)
+{
+   recorder_close(recorder);
+   recorder = NULL;
+   return recorder_open_writer(&recorder, fname);
+}
+
+int replay_input(const char* fname, float fixed_dt)
+{
+   recorder_close(player);
+   player = NULL;
+   if (recorder_open_reader(&player, fname) != 0)
+   {
+      return -1;
+   }
+
+   replay_dt = fixed_dt;
+   replay_frames = 0;
+   timestamp_set(&replay_time);
+   return 0;
+}
+
+static unsigned long transforms_checksum(const hierarchy_t* hierarchy)
+{
+   // FNV-1a over the raw transform bits, so replays can be compared exactly
+   unsigned long hash = 2166136261UL;
+   long l = 0;
+   for (l = 0; l < hierarchy->nnodes; ++l)
+   {
+      const unsigned char* p = (const unsigned char*)&hierarchy->world[l];
+      long k = 0;
+      for (k = 0; k < sizeof(affine_t); ++k)
+      {
+         hash = ((hash ^ p[k]) * 16777619UL) & 0xffffffffUL;
+      }
+   }
+   return hash;
+}
+
+static float replay_frame(float dt)
+{
+   record_t record;
+   while (recorder_read(player, &record) == 0)
+   {
+      switch (record.type)
+      {
+      case RECORD_FRAME:
+         ++replay_frames;
+         return (replay_dt > 0.0f) ? replay_dt : record.x;
+      case RECORD_POINTER_DOWN:
+         on_pointer_down(record.id, record.x, record.y);
+         break;
+      case RECORD_POINTER_UP:
+         on_pointer_up(record.id, record.x, record.y);
+         break;
+      case RECORD_POINTER_MOVE:
+         on_pointer_move(record.id, record.x, record.y);
+         break;
+      case RECORD_KEY_DOWN:
+         on_key_down(record.id);
+         break;
+      case RECORD_KEY_UP:
+         on_key_up(record.id);
+         break;
+      default:
+         LOGE("Unknown record type: %d", record.type);
+         break;
+      }
+   }
+
+   LOGI("Replay finished: %ld frames in %ld ms, transforms checksum %08lx",
+        replay_frames, timestamp_elapsed(&replay_time), transforms_checksum(game->nodes->hierarchy));
+
+   done = 1;
+   return dt;
+}
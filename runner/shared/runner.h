@@ -12,4 +12,5 @@ void pointer_up(int pointerId, float x, float y);
 void pointer_move(int pointerId, float x, float y);
 void key_down(int key);
 void key_up(int key);
-
+int record_input(const char* fname);
+int replay_input(const char* fname, float fixed_dt);
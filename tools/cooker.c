@@ -0,0 +1,207 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <common.h>
+#include <world.h>
+#include <game.h>
+#include <stream.h>
+#include "cookers/mesh.h"
+#include "cookers/layout.h"
+
+game_t* game = NULL;
+
+// Cooks the dump of a level written by io_export_runner.py into a world
+// file. The dump holds the world data laid out as in the world file except
+// for the meshes, which come after it as raw triangles, see dump_mesh_t.
+// Corners are welded through a hash table and the meshes are split in
+// submeshes, clusters and levels and laid out after the rest of the data,
+// all in time linear in the size of the level but for the simplification.
+
+#define DUMP_FILE_VERSION 1
+
+struct dump_header_t
+{
+   char magic[8];
+   long version;
+   long world_offset;
+   long world_size;
+   long meshes_offset;
+   long nmeshes;
+};
+
+// names of the string table of the world data, atoms of the dump index them
+static const char** read_strings(const char* data, long size, long* pnstrings)
+{
+   const world_t* world = (const world_t*)data;
+   long nstrings = world->nstrings;
+   long offset = (long)world->strings;
+
+   const char** strings = (const char**)malloc((nstrings + 1) * sizeof(char*));
+   long l = 0;
+   for (l = 0; l < nstrings; ++l)
+   {
+      const char* end = (offset < size) ? memchr(data + offset, '\0', size - offset) : NULL;
+      if (end == NULL)
+      {
+         LOGE("String table of the world is truncated");
+         free(strings);
+         return NULL;
+      }
+      strings[l] = data + offset;
+      offset = end + 1 - data;
+   }
+
+   (*pnstrings) = nstrings;
+   return strings;
+}
+
+static int write_world(const char* output, const char* data, long size)
+{
+   stream_t* f = NULL;
+   if (stream_open_writer(&f, output) != 0)
+   {
+      LOGE("Unable to open '%s'", output);
+      return -1;
+   }
+
+   struct file_header_t header =
+   {
+      .magic = "RNNRWRLD",
+      .version = WORLD_FILE_VERSION,
+      .data_offset = sizeof(struct file_header_t),
+      .data_size = size,
+   };
+
+   stream_write(f, &header, sizeof(header));
+   stream_write(f, data, size);
+   stream_close(f);
+
+   LOGI("Wrote %ld bytes to '%s'", (long)sizeof(header) + size, output);
+   return 0;
+}
+
+static int cook_world(const char* input, const char* output)
+{
+   long fsize = 0;
+   char* file = (char*)stream_read_file(input, &fsize);
+   if (file == NULL)
+   {
+      LOGE("Unable to read '%s'", input);
+      return -1;
+   }
+
+   struct dump_header_t header;
+   if (fsize < (long)sizeof(header) || memcmp(file, "RNNRDUMP", sizeof(header.magic)) != 0)
+   {
+      LOGE("'%s' is not a level dump", input);
+      free(file);
+      return -1;
+   }
+   memcpy(&header, file, sizeof(header));
+
+   if (header.version != DUMP_FILE_VERSION)
+   {
+      LOGE("Unsupported dump version %ld, expected %d", header.version, DUMP_FILE_VERSION);
+      free(file);
+      return -1;
+   }
+
+   if (header.world_size < (long)sizeof(world_t) || header.world_offset + header.world_size > fsize || header.meshes_offset > fsize)
+   {
+      LOGE("Invalid dump size [world offset: %ld size: %ld meshes offset: %ld filesize: %ld]", header.world_offset, header.world_size, header.meshes_offset, fsize);
+      free(file);
+      return -1;
+   }
+
+   long size = header.world_size;
+   char* data = (char*)malloc(size);
+   memcpy(data, file + header.world_offset, size);
+
+   long nstrings = 0;
+   const char** strings = read_strings(data, size, &nstrings);
+   if (strings == NULL)
+   {
+      free(data);
+      free(file);
+      return -1;
+   }
+
+   cook_mesh_t** meshes = (cook_mesh_t**)calloc(header.nmeshes + 1, sizeof(cook_mesh_t*));
+   const char* dump = file + header.meshes_offset;
+   const char* end = file + fsize;
+   int res = 0;
+
+   long l = 0;
+   for (l = 0; l < header.nmeshes && res == 0; ++l)
+   {
+      long used = 0;
+      res = cook_mesh_create(&meshes[l], dump, end - dump, &used, strings, nstrings);
+      dump += used;
+   }
+
+   // the names point into the data the meshes are appended to
+   free(strings);
+
+   if (res == 0)
+   {
+      long pmeshes = 0;
+      layout_meshes(&data, &size, &pmeshes, meshes, header.nmeshes);
+
+      world_t* world = (world_t*)data;
+      world->nmeshes = header.nmeshes;
+      world->meshes = (struct mesh_t*)pmeshes;
+
+      res = write_world(output, data, size);
+   }
+
+   for (l = 0; l < header.nmeshes; ++l)
+   {
+      if (meshes[l] != NULL)
+      {
+         cook_mesh_free(meshes[l]);
+      }
+   }
+   free(meshes);
+   free(data);
+   free(file);
+   return res;
+}
+
+int main(int argc, char** argv)
+{
+   static struct option long_options[] =
+   {
+      {"output", required_argument, 0, 'o'},
+      {0, 0, 0, 0}
+   };
+
+   int option_index = 0;
+   int c = 0;
+
+   const char* output = NULL;
+
+   while (1)
+   {
+      c = getopt_long (argc, argv, "o:", long_options, &option_index);
+      if (c == -1)
+      {
+         break;
+      }
+
+      switch (c)
+      {
+         case 'o':
+            output = optarg;
+            break;
+      }
+   }
+
+   if (optind >= argc || output == NULL)
+   {
+      LOGE("Usage: cooker -o world dump");
+      return -1;
+   }
+
+   stream_init("");
+
+   return cook_world(argv[optind], output) == 0 ? 0 : -1;
+}
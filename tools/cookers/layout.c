@@ -0,0 +1,260 @@
+#include "layout.h"
+#include "mesh.h"
+#include <common.h>
+#include <math.h>
+
+// the data of a world file as it grows, structs refer to each other by their
+// offset from the start of it until world_init relocates them
+typedef struct layout_t
+{
+   char* data;
+   long size;
+   long capacity;
+} layout_t;
+
+// zeroed room for size bytes at an offset aligned to align
+static long layout_alloc(layout_t* layout, long size, long align)
+{
+   long offset = (layout->size + align - 1) / align * align;
+   if (offset + size > layout->capacity)
+   {
+      while (offset + size > layout->capacity)
+      {
+         layout->capacity = (layout->capacity > 0) ? layout->capacity * 2 : 4096;
+      }
+      layout->data = (char*)realloc(layout->data, layout->capacity);
+   }
+
+   memset(layout->data + layout->size, 0, offset + size - layout->size);
+   layout->size = offset + size;
+   return offset;
+}
+
+static void* layout_at(const layout_t* layout, long offset)
+{
+   return layout->data + offset;
+}
+
+static void get_range(float* offset, float* scale, const float* items, long nitems, long stride)
+{
+   long k = 0;
+   for (k = 0; k < stride; ++k)
+   {
+      float lo = 0.0f;
+      float hi = 0.0f;
+      long l = 0;
+      for (l = 0; l < nitems; ++l)
+      {
+         float f = items[l * stride + k];
+         lo = (l == 0 || f < lo) ? f : lo;
+         hi = (l == 0 || f > hi) ? f : hi;
+      }
+      offset[k] = lo;
+      scale[k] = hi - lo;
+   }
+}
+
+static unsigned short quantize(float value, float offset, float scale)
+{
+   if (scale <= 0.0f)
+   {
+      return 0;
+   }
+   double q = floor((value - offset) / (double)scale * 65535.0 + 0.5);
+   return (unsigned short)((q < 0.0) ? 0.0 : (q > 65535.0) ? 65535.0 : q);
+}
+
+static signed char quantize_normal(float value)
+{
+   double q = floor(value * 127.0 + 0.5);
+   return (signed char)((q < -127.0) ? -127.0 : (q > 127.0) ? 127.0 : q);
+}
+
+// uvs of the default uvmap are interleaved with the points and normals, all
+// zero for meshes without uvmaps
+static void layout_vertices(layout_t* layout, long moffset, const cook_mesh_t* mesh)
+{
+   const int packed = (mesh->format == VERTEX_PACKED);
+   const vec2f_t* uvs = (mesh->nuvmaps > 0) ? &mesh->uvs[mesh->default_uvmap * mesh->nvertices] : NULL;
+   long vertex_size = packed ? sizeof(vertex_packed_t) : sizeof(vertex_t);
+   long pvertices = layout_alloc(layout, mesh->nvertices * vertex_size, 4);
+
+   mesh_t* m = (mesh_t*)layout_at(layout, moffset);
+   m->vertices = (void*)pvertices;
+   if (!packed)
+   {
+      m->scale.x = m->scale.y = m->scale.z = 1.0f;
+
+      vertex_t* vertices = (vertex_t*)layout_at(layout, pvertices);
+      long l = 0;
+      for (l = 0; l < mesh->nvertices; ++l)
+      {
+         vertices[l].point = mesh->points[l];
+         vertices[l].normal = mesh->normals[l];
+         if (uvs != NULL)
+         {
+            vertices[l].uv = uvs[l];
+         }
+      }
+      return;
+   }
+
+   float offset[3];
+   float scale[3];
+   get_range(offset, scale, &mesh->points[0].x, mesh->nvertices, 3);
+   m->offset.x = offset[0];
+   m->offset.y = offset[1];
+   m->offset.z = offset[2];
+   m->scale.x = scale[0];
+   m->scale.y = scale[1];
+   m->scale.z = scale[2];
+
+   float uv_offset[2] = { 0.0f, 0.0f };
+   float uv_scale[2] = { 0.0f, 0.0f };
+   if (uvs != NULL)
+   {
+      get_range(uv_offset, uv_scale, &uvs[0].x, mesh->nvertices, 2);
+   }
+
+   vertex_packed_t* vertices = (vertex_packed_t*)layout_at(layout, pvertices);
+   long l = 0;
+   for (l = 0; l < mesh->nvertices; ++l)
+   {
+      const vec3f_t* p = &mesh->points[l];
+      const vec3f_t* n = &mesh->normals[l];
+      vertices[l].point[0] = quantize(p->x, offset[0], scale[0]);
+      vertices[l].point[1] = quantize(p->y, offset[1], scale[1]);
+      vertices[l].point[2] = quantize(p->z, offset[2], scale[2]);
+      vertices[l].normal[0] = quantize_normal(n->x);
+      vertices[l].normal[1] = quantize_normal(n->y);
+      vertices[l].normal[2] = quantize_normal(n->z);
+      if (uvs != NULL)
+      {
+         vertices[l].uv[0] = quantize(uvs[l].x, uv_offset[0], uv_scale[0]);
+         vertices[l].uv[1] = quantize(uvs[l].y, uv_offset[1], uv_scale[1]);
+      }
+   }
+}
+
+static void layout_uvmaps(layout_t* layout, long moffset, const cook_mesh_t* mesh)
+{
+   const int packed = (mesh->format == VERTEX_PACKED);
+   long puvmaps = layout_alloc(layout, mesh->nuvmaps * sizeof(uvmap_t), 8);
+   ((mesh_t*)layout_at(layout, moffset))->uvmaps = (uvmap_t*)puvmaps;
+
+   long l = 0;
+   for (l = 0; l < mesh->nuvmaps; ++l)
+   {
+      const vec2f_t* uvs = &mesh->uvs[l * mesh->nvertices];
+      float offset[2] = { 0.0f, 0.0f };
+      float scale[2] = { 1.0f, 1.0f };
+      if (packed)
+      {
+         get_range(offset, scale, &uvs[0].x, mesh->nvertices, 2);
+      }
+
+      long puvs = 0;
+      if (l != (long)mesh->default_uvmap)
+      {
+         long uv_size = packed ? 2 * sizeof(unsigned short) : sizeof(vec2f_t);
+         puvs = layout_alloc(layout, mesh->nvertices * uv_size, 4);
+         if (packed)
+         {
+            unsigned short* data = (unsigned short*)layout_at(layout, puvs);
+            long k = 0;
+            for (k = 0; k < mesh->nvertices; ++k)
+            {
+               data[k * 2 + 0] = quantize(uvs[k].x, offset[0], scale[0]);
+               data[k * 2 + 1] = quantize(uvs[k].y, offset[1], scale[1]);
+            }
+         }
+         else
+         {
+            memcpy(layout_at(layout, puvs), uvs, mesh->nvertices * sizeof(vec2f_t));
+         }
+      }
+
+      uvmap_t* uvmap = (uvmap_t*)layout_at(layout, puvmaps) + l;
+      uvmap->name = mesh->uvmap_names[l];
+      uvmap->offset.x = offset[0];
+      uvmap->offset.y = offset[1];
+      uvmap->scale.x = scale[0];
+      uvmap->scale.y = scale[1];
+      uvmap->nuvs = mesh->nvertices;
+      uvmap->uvs = (void*)puvs;
+   }
+}
+
+static void layout_submeshes(layout_t* layout, long moffset, const cook_mesh_t* mesh)
+{
+   long psubmeshes = layout_alloc(layout, mesh->nsubmeshes * sizeof(submesh_t), 8);
+   ((mesh_t*)layout_at(layout, moffset))->submeshes = (submesh_t*)psubmeshes;
+
+   long l = 0;
+   for (l = 0; l < mesh->nsubmeshes; ++l)
+   {
+      const cook_submesh_t* submesh = &mesh->submeshes[l];
+
+      long pindices = layout_alloc(layout, submesh->ntotal * sizeof(unsigned short), 4);
+      unsigned short* indices = (unsigned short*)layout_at(layout, pindices);
+      long k = 0;
+      for (k = 0; k < submesh->ntotal; ++k)
+      {
+         indices[k] = (unsigned short)submesh->indices[k];
+      }
+
+      long pclusters = layout_alloc(layout, submesh->nclusters * sizeof(cluster_t), 8);
+      memcpy(layout_at(layout, pclusters), submesh->clusters, submesh->nclusters * sizeof(cluster_t));
+
+      long plods = layout_alloc(layout, submesh->nlods * sizeof(lod_t), 8);
+      memcpy(layout_at(layout, plods), submesh->lods, submesh->nlods * sizeof(lod_t));
+
+      submesh_t* s = (submesh_t*)layout_at(layout, psubmeshes) + l;
+      s->material = submesh->material;
+      s->base_vertex = submesh->base_vertex;
+      s->index_size = sizeof(unsigned short);
+      s->nindices = submesh->nindices;
+      s->nclusters = submesh->nclusters;
+      s->nlods = submesh->nlods;
+      s->indices = (void*)pindices;
+      s->clusters = (cluster_t*)pclusters;
+      s->lods = (lod_t*)plods;
+   }
+}
+
+// appends the meshes to the world data of psize bytes at pdata, poffset gets
+// the offset of their array. Every window of a cooked mesh fits 16 bit
+// indices.
+int layout_meshes(char** pdata, long* psize, long* poffset, cook_mesh_t* const* meshes, long nmeshes)
+{
+   layout_t layout;
+   layout.data = (*pdata);
+   layout.size = (*psize);
+   layout.capacity = (*psize);
+
+   long pmeshes = layout_alloc(&layout, nmeshes * sizeof(mesh_t), 8);
+
+   long l = 0;
+   for (l = 0; l < nmeshes; ++l)
+   {
+      const cook_mesh_t* mesh = meshes[l];
+      long moffset = pmeshes + l * sizeof(mesh_t);
+
+      mesh_t* m = (mesh_t*)layout_at(&layout, moffset);
+      m->name = mesh->name;
+      m->active_uvmap = mesh->default_uvmap;
+      m->format = mesh->format;
+      m->nvertices = mesh->nvertices;
+      m->nuvmaps = mesh->nuvmaps;
+      m->nsubmeshes = mesh->nsubmeshes;
+
+      layout_vertices(&layout, moffset, mesh);
+      layout_uvmaps(&layout, moffset, mesh);
+      layout_submeshes(&layout, moffset, mesh);
+   }
+
+   (*pdata) = layout.data;
+   (*psize) = layout.size;
+   (*poffset) = pmeshes;
+   return 0;
+}
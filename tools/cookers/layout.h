@@ -0,0 +1,5 @@
+#pragma once
+
+struct cook_mesh_t;
+
+int layout_meshes(char** pdata, long* psize, long* poffset, struct cook_mesh_t* const* meshes, long nmeshes);
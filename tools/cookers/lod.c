@@ -0,0 +1,641 @@
+#include "lod.h"
+#include "weld.h"
+#include <common.h>
+#include <math.h>
+
+// open edges keep their place through a plane across the face, weighted
+// over the planes of the faces
+#define LOD_BOUNDARY_WEIGHT 10.0
+
+// collapse of vertex a into vertex b, stale once either changed version
+typedef struct lod_edge_t
+{
+   double cost;
+   long a;
+   long b;
+   long va;
+   long vb;
+} lod_edge_t;
+
+// triangles using a vertex, without duplicates
+typedef struct lod_list_t
+{
+   long n;
+   long capacity;
+   long* items;
+} lod_list_t;
+
+// undirected edge between welded vertices a < b, the normal of the face is
+// kept for edges with a single one
+typedef struct lod_edge_faces_t
+{
+   long a;
+   long b;
+   long nfaces;
+   double normal[3];
+} lod_edge_faces_t;
+
+typedef struct lod_builder_t
+{
+   const vec3f_t* normals;
+   const vec2f_t* uvs;
+   const unsigned int* corners;
+   const unsigned int* materials;
+   long ntriangles;
+
+   // vertices split along uv or normal seams are welded by position
+   long npoints;
+   double* points;
+   unsigned int* welded;
+   long* first_member;
+   long* members;
+
+   long* tris;
+   double* quadrics;
+   lod_list_t* vertex_tris;
+   unsigned char* alive;
+   long nalive;
+   long* collapsed;
+   long* versions;
+
+   lod_edge_t* heap;
+   long nheap;
+   long heap_capacity;
+
+   // stamps of the neighbours already seen by push_edges
+   long* marks;
+   long mark;
+} lod_builder_t;
+
+static void vec_sub(double* r, const double* a, const double* b)
+{
+   r[0] = a[0] - b[0];
+   r[1] = a[1] - b[1];
+   r[2] = a[2] - b[2];
+}
+
+static void vec_cross(double* r, const double* a, const double* b)
+{
+   r[0] = a[1] * b[2] - a[2] * b[1];
+   r[1] = a[2] * b[0] - a[0] * b[2];
+   r[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static double vec_dot(const double* a, const double* b)
+{
+   return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void face_normal(double* n, const lod_builder_t* builder, const long* tri)
+{
+   double u[3];
+   double v[3];
+   vec_sub(u, &builder->points[tri[1] * 3], &builder->points[tri[0] * 3]);
+   vec_sub(v, &builder->points[tri[2] * 3], &builder->points[tri[0] * 3]);
+   vec_cross(n, u, v);
+}
+
+static int normalize(double* v)
+{
+   double length = sqrt(vec_dot(v, v));
+   if (length < 1e-12)
+   {
+      return 0;
+   }
+   v[0] /= length;
+   v[1] /= length;
+   v[2] /= length;
+   return 1;
+}
+
+static void quadric_add_plane(double* q, const double* n, double d, double weight)
+{
+   double a = n[0];
+   double b = n[1];
+   double c = n[2];
+   q[0] += weight * a * a;
+   q[1] += weight * a * b;
+   q[2] += weight * a * c;
+   q[3] += weight * a * d;
+   q[4] += weight * b * b;
+   q[5] += weight * b * c;
+   q[6] += weight * b * d;
+   q[7] += weight * c * c;
+   q[8] += weight * c * d;
+   q[9] += weight * d * d;
+}
+
+static double quadric_error(const double* q, const double* p)
+{
+   double x = p[0];
+   double y = p[1];
+   double z = p[2];
+   return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x +
+          q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y +
+          q[7] * z * z + 2 * q[8] * z + q[9];
+}
+
+static void list_add(lod_list_t* list, long item)
+{
+   long l = 0;
+   for (l = 0; l < list->n; ++l)
+   {
+      if (list->items[l] == item)
+      {
+         return;
+      }
+   }
+
+   if (list->n == list->capacity)
+   {
+      list->capacity = (list->capacity > 0) ? list->capacity * 2 : 8;
+      list->items = (long*)realloc(list->items, list->capacity * sizeof(long));
+   }
+   list->items[list->n++] = item;
+}
+
+static void list_remove(lod_list_t* list, long item)
+{
+   long l = 0;
+   for (l = 0; l < list->n; ++l)
+   {
+      if (list->items[l] == item)
+      {
+         list->items[l] = list->items[--list->n];
+         return;
+      }
+   }
+}
+
+static int edge_less(const lod_edge_t* e, const lod_edge_t* f)
+{
+   if (e->cost != f->cost)
+      return e->cost < f->cost;
+   if (e->a != f->a)
+      return e->a < f->a;
+   if (e->b != f->b)
+      return e->b < f->b;
+   if (e->va != f->va)
+      return e->va < f->va;
+   return e->vb < f->vb;
+}
+
+static void heap_push(lod_builder_t* builder, const lod_edge_t* edge)
+{
+   if (builder->nheap == builder->heap_capacity)
+   {
+      builder->heap_capacity = (builder->heap_capacity > 0) ? builder->heap_capacity * 2 : 1024;
+      builder->heap = (lod_edge_t*)realloc(builder->heap, builder->heap_capacity * sizeof(lod_edge_t));
+   }
+
+   lod_edge_t* heap = builder->heap;
+   long i = builder->nheap++;
+   while (i > 0 && edge_less(edge, &heap[(i - 1) / 2]))
+   {
+      heap[i] = heap[(i - 1) / 2];
+      i = (i - 1) / 2;
+   }
+   heap[i] = (*edge);
+}
+
+static void heap_pop(lod_builder_t* builder, lod_edge_t* edge)
+{
+   lod_edge_t* heap = builder->heap;
+   (*edge) = heap[0];
+
+   lod_edge_t last = heap[--builder->nheap];
+   long n = builder->nheap;
+   long i = 0;
+   while (1)
+   {
+      long child = i * 2 + 1;
+      if (child >= n)
+         break;
+      if (child + 1 < n && edge_less(&heap[child + 1], &heap[child]))
+         ++child;
+      if (!edge_less(&heap[child], &last))
+         break;
+      heap[i] = heap[child];
+      i = child;
+   }
+   if (n > 0)
+   {
+      heap[i] = last;
+   }
+}
+
+static void push_edges(lod_builder_t* builder, long v)
+{
+   ++builder->mark;
+
+   const lod_list_t* list = &builder->vertex_tris[v];
+   long l = 0;
+   for (l = 0; l < list->n; ++l)
+   {
+      const long* tri = &builder->tris[list->items[l] * 3];
+      int k = 0;
+      for (k = 0; k < 3; ++k)
+      {
+         long u = tri[k];
+         if (u == v || builder->marks[u] == builder->mark)
+            continue;
+         builder->marks[u] = builder->mark;
+
+         double q[10];
+         int i = 0;
+         for (i = 0; i < 10; ++i)
+         {
+            q[i] = builder->quadrics[v * 10 + i] + builder->quadrics[u * 10 + i];
+         }
+
+         lod_edge_t edge = { fmax(quadric_error(q, &builder->points[u * 3]), 0.0), v, u, builder->versions[v], builder->versions[u] };
+         heap_push(builder, &edge);
+
+         lod_edge_t back = { fmax(quadric_error(q, &builder->points[v * 3]), 0.0), u, v, builder->versions[u], builder->versions[v] };
+         heap_push(builder, &back);
+      }
+   }
+}
+
+// moving a onto b turns some face of a over
+static int collapse_flips(const lod_builder_t* builder, long a, long b)
+{
+   const lod_list_t* list = &builder->vertex_tris[a];
+   long l = 0;
+   for (l = 0; l < list->n; ++l)
+   {
+      long t = list->items[l];
+      const long* tri = &builder->tris[t * 3];
+      if (!builder->alive[t] || tri[0] == b || tri[1] == b || tri[2] == b)
+         continue;
+
+      long moved[3];
+      int k = 0;
+      for (k = 0; k < 3; ++k)
+      {
+         moved[k] = (tri[k] == a) ? b : tri[k];
+      }
+
+      double n0[3];
+      double n1[3];
+      face_normal(n0, builder, tri);
+      face_normal(n1, builder, moved);
+      if (vec_dot(n0, n1) <= 0.0)
+      {
+         return 1;
+      }
+   }
+   return 0;
+}
+
+static void collapse(lod_builder_t* builder, long a, long b)
+{
+   builder->collapsed[a] = b;
+
+   // removing a triangle from the lists of its vertices changes the one of a
+   lod_list_t* list = &builder->vertex_tris[a];
+   long* items = (long*)malloc((list->n + 1) * sizeof(long));
+   long n = list->n;
+   memcpy(items, list->items, n * sizeof(long));
+
+   long l = 0;
+   for (l = 0; l < n; ++l)
+   {
+      long t = items[l];
+      long* tri = &builder->tris[t * 3];
+      int k = 0;
+      if (tri[0] == b || tri[1] == b || tri[2] == b)
+      {
+         if (builder->alive[t])
+         {
+            builder->alive[t] = 0;
+            --builder->nalive;
+         }
+         for (k = 0; k < 3; ++k)
+         {
+            list_remove(&builder->vertex_tris[tri[k]], t);
+         }
+         continue;
+      }
+
+      for (k = 0; k < 3; ++k)
+      {
+         tri[k] = (tri[k] == a) ? b : tri[k];
+      }
+      list_add(&builder->vertex_tris[b], t);
+   }
+   builder->vertex_tris[a].n = 0;
+   free(items);
+
+   int i = 0;
+   for (i = 0; i < 10; ++i)
+   {
+      builder->quadrics[b * 10 + i] += builder->quadrics[a * 10 + i];
+   }
+   ++builder->versions[b];
+   push_edges(builder, b);
+}
+
+static float attribute_distance(const lod_builder_t* builder, long i, long j)
+{
+   const vec3f_t* n0 = &builder->normals[i];
+   const vec3f_t* n1 = &builder->normals[j];
+   float dx = n0->x - n1->x;
+   float dy = n0->y - n1->y;
+   float dz = n0->z - n1->z;
+   float d = dx * dx + dy * dy + dz * dz;
+   if (builder->uvs != NULL)
+   {
+      float du = builder->uvs[i].x - builder->uvs[j].x;
+      float dv = builder->uvs[i].y - builder->uvs[j].y;
+      d += du * du + dv * dv;
+   }
+   return d;
+}
+
+// corners of the triangles left pick the vertex welded into theirs closest
+// in normal and uv to the one they had
+static void snapshot(const lod_builder_t* builder, lod_level_t* level)
+{
+   level->ntriangles = builder->nalive;
+   level->indices = (unsigned int*)malloc((builder->nalive * 3 + 1) * sizeof(unsigned int));
+   level->materials = (unsigned int*)malloc((builder->nalive + 1) * sizeof(unsigned int));
+
+   long n = 0;
+   long t = 0;
+   for (t = 0; t < builder->ntriangles; ++t)
+   {
+      if (!builder->alive[t])
+         continue;
+
+      int k = 0;
+      for (k = 0; k < 3; ++k)
+      {
+         long i = builder->corners[t * 3 + k];
+         long v = builder->tris[t * 3 + k];
+
+         long best = builder->members[builder->first_member[v]];
+         float best_distance = attribute_distance(builder, i, best);
+         long m = 0;
+         for (m = builder->first_member[v] + 1; m < builder->first_member[v + 1]; ++m)
+         {
+            float distance = attribute_distance(builder, i, builder->members[m]);
+            if (distance < best_distance)
+            {
+               best_distance = distance;
+               best = builder->members[m];
+            }
+         }
+         level->indices[n * 3 + k] = best;
+      }
+      level->materials[n] = builder->materials[t];
+      ++n;
+   }
+}
+
+static void weld_points(lod_builder_t* builder, const vec3f_t* points, long nvertices)
+{
+   builder->welded = (unsigned int*)malloc((nvertices + 1) * sizeof(unsigned int));
+   builder->npoints = weld(builder->welded, &points[0].x, nvertices, 3);
+
+   builder->points = (double*)malloc((builder->npoints * 3 + 1) * sizeof(double));
+   builder->first_member = (long*)calloc(builder->npoints + 1, sizeof(long));
+   builder->members = (long*)malloc((nvertices + 1) * sizeof(long));
+
+   long l = 0;
+   for (l = 0; l < nvertices; ++l)
+   {
+      long p = builder->welded[l];
+      builder->points[p * 3 + 0] = points[l].x;
+      builder->points[p * 3 + 1] = points[l].y;
+      builder->points[p * 3 + 2] = points[l].z;
+      ++builder->first_member[p + 1];
+   }
+   for (l = 0; l < builder->npoints; ++l)
+   {
+      builder->first_member[l + 1] += builder->first_member[l];
+   }
+
+   // members of every point in the order of the vertices
+   long* fill = (long*)malloc((builder->npoints + 1) * sizeof(long));
+   memcpy(fill, builder->first_member, builder->npoints * sizeof(long));
+   for (l = 0; l < nvertices; ++l)
+   {
+      builder->members[fill[builder->welded[l]]++] = l;
+   }
+   free(fill);
+}
+
+static lod_edge_faces_t* find_edge(lod_edge_faces_t* edges, long* nedges, long* table, unsigned long size, long a, long b)
+{
+   if (a > b)
+   {
+      long tmp = a;
+      a = b;
+      b = tmp;
+   }
+
+   unsigned long slot = ((unsigned long)a * 73856093ul ^ (unsigned long)b * 19349663ul) & (size - 1);
+   while (table[slot] >= 0)
+   {
+      lod_edge_faces_t* edge = &edges[table[slot]];
+      if (edge->a == a && edge->b == b)
+      {
+         return edge;
+      }
+      slot = (slot + 1) & (size - 1);
+   }
+
+   table[slot] = (*nedges)++;
+   lod_edge_faces_t* edge = &edges[table[slot]];
+   memset(edge, 0, sizeof(lod_edge_faces_t));
+   edge->a = a;
+   edge->b = b;
+   return edge;
+}
+
+// quadrics of the planes of the faces around every point, and of planes
+// across the open edges
+static void build_quadrics(lod_builder_t* builder)
+{
+   long ntriangles = builder->ntriangles;
+   builder->quadrics = (double*)calloc(builder->npoints * 10 + 1, sizeof(double));
+
+   unsigned long size = 16;
+   while (size < 6 * (unsigned long)ntriangles)
+   {
+      size *= 2;
+   }
+   long* table = (long*)malloc(size * sizeof(long));
+   unsigned long s = 0;
+   for (s = 0; s < size; ++s)
+   {
+      table[s] = -1;
+   }
+   lod_edge_faces_t* edges = (lod_edge_faces_t*)malloc((ntriangles * 3 + 1) * sizeof(lod_edge_faces_t));
+   long nedges = 0;
+
+   long t = 0;
+   for (t = 0; t < ntriangles; ++t)
+   {
+      const long* tri = &builder->tris[t * 3];
+      double n[3];
+      face_normal(n, builder, tri);
+      if (!normalize(n))
+         continue;
+
+      int k = 0;
+      for (k = 0; k < 3; ++k)
+      {
+         quadric_add_plane(&builder->quadrics[tri[k] * 10], n, -vec_dot(n, &builder->points[tri[0] * 3]), 1.0);
+      }
+      for (k = 0; k < 3; ++k)
+      {
+         lod_edge_faces_t* edge = find_edge(edges, &nedges, table, size, tri[k], tri[(k + 1) % 3]);
+         if (edge->nfaces++ == 0)
+         {
+            memcpy(edge->normal, n, sizeof(n));
+         }
+      }
+   }
+
+   long l = 0;
+   for (l = 0; l < nedges; ++l)
+   {
+      const lod_edge_faces_t* edge = &edges[l];
+      if (edge->nfaces != 1)
+         continue;
+
+      const double* a = &builder->points[edge->a * 3];
+      double e[3];
+      double p[3];
+      vec_sub(e, &builder->points[edge->b * 3], a);
+      vec_cross(p, e, edge->normal);
+      if (!normalize(p))
+         continue;
+
+      quadric_add_plane(&builder->quadrics[edge->a * 10], p, -vec_dot(p, a), LOD_BOUNDARY_WEIGHT);
+      quadric_add_plane(&builder->quadrics[edge->b * 10], p, -vec_dot(p, a), LOD_BOUNDARY_WEIGHT);
+   }
+
+   free(table);
+   free(edges);
+}
+
+// simplifies a mesh by half edge collapses ordered by quadric error, so every
+// level reuses the vertices of the mesh. Vertices split along uv or normal
+// seams are welded by position for the collapses and corners pick the split
+// vertex closest in attributes afterwards. uvs may be NULL. Returns the
+// number of levels.
+long lod_build(lod_level_t* levels, const vec3f_t* points, const vec3f_t* normals, const vec2f_t* uvs, long nvertices, const unsigned int* indices, const unsigned int* materials, long ntriangles)
+{
+   if (ntriangles < LOD_MIN_TRIANGLES || ntriangles > LOD_MAX_TRIANGLES)
+   {
+      return 0;
+   }
+
+   lod_builder_t builder;
+   memset(&builder, 0, sizeof(builder));
+   builder.normals = normals;
+   builder.uvs = uvs;
+   builder.corners = indices;
+   builder.materials = materials;
+   builder.ntriangles = ntriangles;
+
+   weld_points(&builder, points, nvertices);
+
+   builder.tris = (long*)malloc(ntriangles * 3 * sizeof(long));
+   long l = 0;
+   for (l = 0; l < ntriangles * 3; ++l)
+   {
+      builder.tris[l] = builder.welded[indices[l]];
+   }
+
+   build_quadrics(&builder);
+
+   builder.vertex_tris = (lod_list_t*)calloc(builder.npoints + 1, sizeof(lod_list_t));
+   builder.alive = (unsigned char*)malloc(ntriangles);
+   for (l = 0; l < ntriangles; ++l)
+   {
+      const long* tri = &builder.tris[l * 3];
+      int k = 0;
+      for (k = 0; k < 3; ++k)
+      {
+         list_add(&builder.vertex_tris[tri[k]], l);
+      }
+      builder.alive[l] = (tri[0] != tri[1] && tri[1] != tri[2] && tri[0] != tri[2]);
+      builder.nalive += builder.alive[l];
+   }
+
+   builder.collapsed = (long*)malloc((builder.npoints + 1) * sizeof(long));
+   builder.versions = (long*)calloc(builder.npoints + 1, sizeof(long));
+   builder.marks = (long*)calloc(builder.npoints + 1, sizeof(long));
+   for (l = 0; l < builder.npoints; ++l)
+   {
+      builder.collapsed[l] = l;
+   }
+   for (l = 0; l < builder.npoints; ++l)
+   {
+      push_edges(&builder, l);
+   }
+
+   long nlevels = 0;
+   long target = builder.nalive / 2;
+   double max_error = 0.0;
+   while (nlevels < LOD_LEVELS && builder.nheap > 0)
+   {
+      lod_edge_t edge;
+      heap_pop(&builder, &edge);
+
+      long a = edge.a;
+      long b = edge.b;
+      if (builder.versions[a] != edge.va || builder.versions[b] != edge.vb || builder.collapsed[a] != a || builder.collapsed[b] != b)
+         continue;
+      if (collapse_flips(&builder, a, b))
+         continue;
+
+      max_error = fmax(max_error, edge.cost);
+      collapse(&builder, a, b);
+
+      if (builder.nalive <= target)
+      {
+         // quadrics sum squared distances to the planes of the faces merged
+         // into a vertex, the root bounds the distance to any of them
+         levels[nlevels].error = (float)sqrt(max_error);
+         snapshot(&builder, &levels[nlevels]);
+         ++nlevels;
+
+         target = builder.nalive / 2;
+         if (target < 8)
+            break;
+      }
+   }
+
+   for (l = 0; l < builder.npoints; ++l)
+   {
+      free(builder.vertex_tris[l].items);
+   }
+   free(builder.points);
+   free(builder.welded);
+   free(builder.first_member);
+   free(builder.members);
+   free(builder.tris);
+   free(builder.quadrics);
+   free(builder.vertex_tris);
+   free(builder.alive);
+   free(builder.collapsed);
+   free(builder.versions);
+   free(builder.heap);
+   free(builder.marks);
+   return nlevels;
+}
+
+void lod_free(lod_level_t* levels, long nlevels)
+{
+   long l = 0;
+   for (l = 0; l < nlevels; ++l)
+   {
+      free(levels[l].indices);
+      free(levels[l].materials);
+   }
+}
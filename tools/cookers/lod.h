@@ -0,0 +1,24 @@
+#pragma once
+
+#include <mathlib.h>
+
+// meshes get up to LOD_LEVELS simplified versions, each with about half the
+// triangles of the previous one. Small meshes gain nothing and huge ones are
+// split in clusters instead.
+#define LOD_LEVELS 3
+#define LOD_MIN_TRIANGLES 64
+#define LOD_MAX_TRIANGLES 20000
+
+// error is the largest distance the surface moved, in mesh units. Every
+// triangle has three indices into the vertices of the mesh and a material.
+typedef struct lod_level_t
+{
+   float error;
+
+   long ntriangles;
+   unsigned int* indices;
+   unsigned int* materials;
+} lod_level_t;
+
+long lod_build(lod_level_t* levels, const vec3f_t* points, const vec3f_t* normals, const vec2f_t* uvs, long nvertices, const unsigned int* indices, const unsigned int* materials, long ntriangles);
+void lod_free(lod_level_t* levels, long nlevels);
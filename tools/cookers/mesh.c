@@ -0,0 +1,717 @@
+#include "mesh.h"
+#include "weld.h"
+#include <common.h>
+#include <math.h>
+#include <vcache.h>
+
+// large submeshes are split in clusters of at most this many triangles the
+// engine culls one by one
+#define CLUSTER_TRIANGLES 256
+
+// submeshes are drawn with 16 bit indices counted from a base vertex. Meshes
+// with more vertices than fit are split in windows of up to INDEX_WINDOW
+// vertices, filled cluster by cluster and copying the vertices two windows
+// share. Those meshes are above LOD_MAX_TRIANGLES, no simplified level has to
+// index across windows.
+#define INDEX_WINDOW 65536
+
+// meshes are packed to 16 bit points and uvs and 8 bit normals when that
+// moves points by at most VERTEX_ERROR mesh units and uvs by at most UV_ERROR,
+// a quarter of a texel of a 2048 texture. Zero in the dump keeps it float.
+#define VERTEX_ERROR 0.0005f
+#define UV_ERROR (1.0f / 8192.0f)
+
+// the triangles of the dump, welded
+typedef struct cook_builder_t
+{
+   cook_mesh_t* mesh;
+   const char* name;
+
+   long nmaterials;
+   const atom_t* materials;
+
+   long ntriangles;
+   unsigned int* indices;
+   unsigned int* triangle_materials;
+
+   float vertex_error;
+   float uv_error;
+
+   long nlevels;
+   lod_level_t levels[LOD_LEVELS];
+} cook_builder_t;
+
+typedef struct cluster_key_t
+{
+   double key;
+   long index;
+} cluster_key_t;
+
+static int compare_keys(const void* a, const void* b)
+{
+   const cluster_key_t* k0 = (const cluster_key_t*)a;
+   const cluster_key_t* k1 = (const cluster_key_t*)b;
+   if (k0->key != k1->key)
+   {
+      return (k0->key < k1->key) ? -1 : 1;
+   }
+   return (k0->index < k1->index) ? -1 : (k0->index > k1->index);
+}
+
+// halves triangles at the median of their centroids along the longest axis
+// until they fit in a cluster, which keeps every cluster spatially coherent.
+// The triangles are reordered in place and the size of every cluster goes
+// to sizes.
+static void split_clusters(const vec3f_t* points, unsigned int* tris, long ntris, long** psizes, long* pnsizes)
+{
+   if (ntris <= CLUSTER_TRIANGLES)
+   {
+      (*psizes) = (long*)realloc(*psizes, ((*pnsizes) + 1) * sizeof(long));
+      (*psizes)[(*pnsizes)++] = ntris;
+      return;
+   }
+
+   double* centroids = (double*)malloc(ntris * 3 * sizeof(double));
+   double lo[3] = { 0.0, 0.0, 0.0 };
+   double hi[3] = { 0.0, 0.0, 0.0 };
+   long l = 0;
+   for (l = 0; l < ntris; ++l)
+   {
+      const vec3f_t* a = &points[tris[l * 3 + 0]];
+      const vec3f_t* b = &points[tris[l * 3 + 1]];
+      const vec3f_t* c = &points[tris[l * 3 + 2]];
+      double* centroid = &centroids[l * 3];
+      centroid[0] = ((double)a->x + b->x + c->x) / 3.0;
+      centroid[1] = ((double)a->y + b->y + c->y) / 3.0;
+      centroid[2] = ((double)a->z + b->z + c->z) / 3.0;
+
+      int k = 0;
+      for (k = 0; k < 3; ++k)
+      {
+         lo[k] = (l == 0 || centroid[k] < lo[k]) ? centroid[k] : lo[k];
+         hi[k] = (l == 0 || centroid[k] > hi[k]) ? centroid[k] : hi[k];
+      }
+   }
+
+   int axis = 0;
+   int k = 0;
+   for (k = 1; k < 3; ++k)
+   {
+      axis = (hi[k] - lo[k] > hi[axis] - lo[axis]) ? k : axis;
+   }
+
+   cluster_key_t* keys = (cluster_key_t*)malloc(ntris * sizeof(cluster_key_t));
+   for (l = 0; l < ntris; ++l)
+   {
+      keys[l].key = centroids[l * 3 + axis];
+      keys[l].index = l;
+   }
+   qsort(keys, ntris, sizeof(cluster_key_t), compare_keys);
+
+   unsigned int* copy = (unsigned int*)malloc(ntris * 3 * sizeof(unsigned int));
+   memcpy(copy, tris, ntris * 3 * sizeof(unsigned int));
+   for (l = 0; l < ntris; ++l)
+   {
+      memcpy(&tris[l * 3], &copy[keys[l].index * 3], 3 * sizeof(unsigned int));
+   }
+
+   free(copy);
+   free(keys);
+   free(centroids);
+
+   long half = ntris / 2;
+   split_clusters(points, tris, half, psizes, pnsizes);
+   split_clusters(points, &tris[half * 3], ntris - half, psizes, pnsizes);
+}
+
+static void fill_cluster(cluster_t* cluster, const vec3f_t* points, const unsigned int* tris, long ntris, long first)
+{
+   memset(cluster, 0, sizeof(cluster_t));
+   cluster->first = first;
+   cluster->nindices = ntris * 3;
+   cluster->bounds.min = points[tris[0]];
+   cluster->bounds.max = points[tris[0]];
+
+   double axis[3] = { 0.0, 0.0, 0.0 };
+   long l = 0;
+   for (l = 0; l < ntris * 3; ++l)
+   {
+      const vec3f_t* p = &points[tris[l]];
+      bbox_t* b = &cluster->bounds;
+      b->min.x = (p->x < b->min.x) ? p->x : b->min.x;
+      b->min.y = (p->y < b->min.y) ? p->y : b->min.y;
+      b->min.z = (p->z < b->min.z) ? p->z : b->min.z;
+      b->max.x = (p->x > b->max.x) ? p->x : b->max.x;
+      b->max.y = (p->y > b->max.y) ? p->y : b->max.y;
+      b->max.z = (p->z > b->max.z) ? p->z : b->max.z;
+   }
+
+   // unit normals of the faces, zero for degenerate ones
+   double* normals = (double*)calloc(ntris * 3 + 1, sizeof(double));
+   for (l = 0; l < ntris; ++l)
+   {
+      const vec3f_t* a = &points[tris[l * 3 + 0]];
+      const vec3f_t* b = &points[tris[l * 3 + 1]];
+      const vec3f_t* c = &points[tris[l * 3 + 2]];
+      double u[3] = { (double)b->x - a->x, (double)b->y - a->y, (double)b->z - a->z };
+      double v[3] = { (double)c->x - a->x, (double)c->y - a->y, (double)c->z - a->z };
+      double* n = &normals[l * 3];
+      n[0] = u[1] * v[2] - u[2] * v[1];
+      n[1] = u[2] * v[0] - u[0] * v[2];
+      n[2] = u[0] * v[1] - u[1] * v[0];
+
+      double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      if (length < 1e-12)
+      {
+         n[0] = n[1] = n[2] = 0.0;
+         continue;
+      }
+      n[0] /= length;
+      n[1] /= length;
+      n[2] /= length;
+      axis[0] += n[0];
+      axis[1] += n[1];
+      axis[2] += n[2];
+   }
+
+   double length = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+   if (length > 1e-6)
+   {
+      double cutoff = 1.0;
+      for (l = 0; l < ntris; ++l)
+      {
+         const double* n = &normals[l * 3];
+         if (n[0] == 0.0 && n[1] == 0.0 && n[2] == 0.0)
+            continue;
+         double d = (n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2]) / length;
+         cutoff = (d < cutoff) ? d : cutoff;
+      }
+      cluster->cone_axis.x = axis[0] / length;
+      cluster->cone_axis.y = axis[1] / length;
+      cluster->cone_axis.z = axis[2] / length;
+      cluster->cone_cutoff = cutoff;
+   }
+   else
+   {
+      cluster->cone_cutoff = -1.0f;
+   }
+
+   free(normals);
+}
+
+// indices go cluster by cluster so each one is a contiguous range
+static void build_clusters(const cook_mesh_t* mesh, cook_submesh_t* submesh)
+{
+   const vec3f_t* points = &mesh->points[submesh->base_vertex];
+   long* sizes = NULL;
+   long nsizes = 0;
+   split_clusters(points, submesh->indices, submesh->nindices / 3, &sizes, &nsizes);
+
+   submesh->nclusters = nsizes;
+   submesh->clusters = (cluster_t*)malloc((nsizes + 1) * sizeof(cluster_t));
+
+   long first = 0;
+   long l = 0;
+   for (l = 0; l < nsizes; ++l)
+   {
+      fill_cluster(&submesh->clusters[l], points, &submesh->indices[first], sizes[l], first);
+      first += sizes[l] * 3;
+   }
+   free(sizes);
+}
+
+static cook_submesh_t* add_submesh(cook_mesh_t* mesh, atom_t material, unsigned long base_vertex, long nwindow, const unsigned int* indices, long nindices)
+{
+   mesh->submeshes = (cook_submesh_t*)realloc(mesh->submeshes, (mesh->nsubmeshes + 1) * sizeof(cook_submesh_t));
+   cook_submesh_t* submesh = &mesh->submeshes[mesh->nsubmeshes++];
+   memset(submesh, 0, sizeof(cook_submesh_t));
+
+   submesh->material = material;
+   submesh->base_vertex = base_vertex;
+   submesh->nwindow = nwindow;
+   submesh->nindices = nindices;
+   submesh->ntotal = nindices;
+   submesh->indices = (unsigned int*)malloc((nindices + 1) * sizeof(unsigned int));
+   memcpy(submesh->indices, indices, nindices * sizeof(unsigned int));
+   return submesh;
+}
+
+// simplified levels follow the full one in the same index array
+static void append_lods(const cook_builder_t* builder, cook_submesh_t* submesh, unsigned int material_index)
+{
+   long l = 0;
+   for (l = 0; l < builder->nlevels; ++l)
+   {
+      const lod_level_t* level = &builder->levels[l];
+      submesh->indices = (unsigned int*)realloc(submesh->indices, (submesh->ntotal + level->ntriangles * 3 + 1) * sizeof(unsigned int));
+
+      lod_t* lod = &submesh->lods[submesh->nlods++];
+      lod->error = level->error;
+      lod->first = submesh->ntotal;
+
+      long t = 0;
+      for (t = 0; t < level->ntriangles; ++t)
+      {
+         if (level->materials[t] == material_index)
+         {
+            memcpy(&submesh->indices[submesh->ntotal], &level->indices[t * 3], 3 * sizeof(unsigned int));
+            submesh->ntotal += 3;
+         }
+      }
+      lod->nindices = submesh->ntotal - lod->first;
+   }
+}
+
+// triangles of a material in their dump order, returns their count
+static long gather_triangles(const cook_builder_t* builder, unsigned int* tris, unsigned int material_index)
+{
+   long n = 0;
+   long t = 0;
+   for (t = 0; t < builder->ntriangles; ++t)
+   {
+      if (builder->triangle_materials[t] == material_index)
+      {
+         memcpy(&tris[n * 3], &builder->indices[t * 3], 3 * sizeof(unsigned int));
+         ++n;
+      }
+   }
+   return n;
+}
+
+static void gather_vertices(cook_mesh_t* mesh, const unsigned int* sources, long nsources)
+{
+   vec3f_t* points = (vec3f_t*)malloc((nsources + 1) * sizeof(vec3f_t));
+   vec3f_t* normals = (vec3f_t*)malloc((nsources + 1) * sizeof(vec3f_t));
+   vec2f_t* uvs = (vec2f_t*)malloc((mesh->nuvmaps * nsources + 1) * sizeof(vec2f_t));
+
+   long l = 0;
+   for (l = 0; l < nsources; ++l)
+   {
+      points[l] = mesh->points[sources[l]];
+      normals[l] = mesh->normals[sources[l]];
+
+      long m = 0;
+      for (m = 0; m < mesh->nuvmaps; ++m)
+      {
+         uvs[m * nsources + l] = mesh->uvs[m * mesh->nvertices + sources[l]];
+      }
+   }
+
+   free(mesh->points);
+   free(mesh->normals);
+   free(mesh->uvs);
+   mesh->points = points;
+   mesh->normals = normals;
+   mesh->uvs = uvs;
+   mesh->nvertices = nsources;
+}
+
+// one submesh per material, or several for meshes with too many vertices,
+// each with the vertices it uses copied to its own window
+static void build_windows(cook_builder_t* builder)
+{
+   cook_mesh_t* mesh = builder->mesh;
+   unsigned int* tris = (unsigned int*)malloc((builder->ntriangles * 3 + 1) * sizeof(unsigned int));
+
+   long m = 0;
+   if (mesh->nvertices <= INDEX_WINDOW)
+   {
+      for (m = 0; m < builder->nmaterials; ++m)
+      {
+         long ntris = gather_triangles(builder, tris, m);
+         if (ntris > 0)
+         {
+            cook_submesh_t* submesh = add_submesh(mesh, builder->materials[m], 0, mesh->nvertices, tris, ntris * 3);
+            append_lods(builder, submesh, m);
+         }
+      }
+      free(tris);
+      return;
+   }
+
+   // vertices of the windows by their index in the mesh, and the index of
+   // every mesh vertex in the current window
+   unsigned int* sources = NULL;
+   long nsources = 0;
+   long* local = (long*)malloc(mesh->nvertices * sizeof(long));
+   long* marks = (long*)malloc(mesh->nvertices * sizeof(long));
+   unsigned int* window = (unsigned int*)malloc((builder->ntriangles * 3 + 1) * sizeof(unsigned int));
+   long l = 0;
+   for (l = 0; l < mesh->nvertices; ++l)
+   {
+      local[l] = -1;
+      marks[l] = -1;
+   }
+
+   long ncluster = 0;
+   for (m = 0; m < builder->nmaterials; ++m)
+   {
+      long ntris = gather_triangles(builder, tris, m);
+      long* sizes = NULL;
+      long nsizes = 0;
+      if (ntris > 0)
+      {
+         split_clusters(mesh->points, tris, ntris, &sizes, &nsizes);
+      }
+
+      long nlocal = 0;
+      long n = 0;
+      long first = 0;
+      long c = 0;
+      for (c = 0; c < nsizes; ++c, ++ncluster)
+      {
+         const unsigned int* cluster = &tris[first * 3];
+         long nindices = sizes[c] * 3;
+         first += sizes[c];
+
+         long added = 0;
+         for (l = 0; l < nindices; ++l)
+         {
+            unsigned int v = cluster[l];
+            if (local[v] < 0 && marks[v] != ncluster)
+            {
+               marks[v] = ncluster;
+               ++added;
+            }
+         }
+
+         if (nlocal + added > INDEX_WINDOW)
+         {
+            add_submesh(mesh, builder->materials[m], nsources - nlocal, nlocal, window, n);
+            for (l = nsources - nlocal; l < nsources; ++l)
+            {
+               local[sources[l]] = -1;
+            }
+            nlocal = 0;
+            n = 0;
+         }
+
+         sources = (unsigned int*)realloc(sources, (nsources + nindices + 1) * sizeof(unsigned int));
+         for (l = 0; l < nindices; ++l)
+         {
+            unsigned int v = cluster[l];
+            if (local[v] < 0)
+            {
+               local[v] = nlocal++;
+               sources[nsources++] = v;
+            }
+            window[n++] = local[v];
+         }
+      }
+
+      if (n > 0)
+      {
+         add_submesh(mesh, builder->materials[m], nsources - nlocal, nlocal, window, n);
+      }
+      for (l = nsources - nlocal; l < nsources; ++l)
+      {
+         local[sources[l]] = -1;
+      }
+      free(sizes);
+   }
+
+   LOGI("Split %ld vertices in %ld windows of %ld vertices", mesh->nvertices, mesh->nsubmeshes, nsources);
+   gather_vertices(mesh, sources, nsources);
+
+   free(sources);
+   free(local);
+   free(marks);
+   free(window);
+   free(tris);
+}
+
+static void permute(void* items, const unsigned int* remap, long nitems, long size)
+{
+   char* copy = (char*)malloc(nitems * size + 1);
+   memcpy(copy, items, nitems * size);
+
+   long l = 0;
+   for (l = 0; l < nitems; ++l)
+   {
+      memcpy((char*)items + remap[l] * size, copy + l * size, size);
+   }
+   free(copy);
+}
+
+// triangles are reordered within their cluster and their level for the post
+// transform cache, then the vertices of every window in the order the
+// indices first use them
+static void optimize_vertex_cache(cook_mesh_t* mesh)
+{
+   long l = 0;
+   for (l = 0; l < mesh->nsubmeshes; ++l)
+   {
+      cook_submesh_t* submesh = &mesh->submeshes[l];
+      long k = 0;
+      for (k = 0; k < submesh->nclusters; ++k)
+      {
+         const cluster_t* cluster = &submesh->clusters[k];
+         vcache_optimize(&submesh->indices[cluster->first], cluster->nindices, submesh->nwindow);
+      }
+      for (k = 0; k < submesh->nlods; ++k)
+      {
+         const lod_t* lod = &submesh->lods[k];
+         vcache_optimize(&submesh->indices[lod->first], lod->nindices, submesh->nwindow);
+      }
+   }
+
+   for (l = 0; l < mesh->nsubmeshes; ++l)
+   {
+      const cook_submesh_t* window = &mesh->submeshes[l];
+      long ntotal = 0;
+      int first = 1;
+      long k = 0;
+      for (k = 0; k < mesh->nsubmeshes; ++k)
+      {
+         const cook_submesh_t* submesh = &mesh->submeshes[k];
+         if (submesh->base_vertex == window->base_vertex)
+         {
+            first &= (k >= l);
+            ntotal += submesh->ntotal;
+         }
+      }
+      if (!first)
+         continue;
+
+      unsigned int* all = (unsigned int*)malloc((ntotal + 1) * sizeof(unsigned int));
+      unsigned int* remap = (unsigned int*)malloc((window->nwindow + 1) * sizeof(unsigned int));
+
+      long n = 0;
+      for (k = l; k < mesh->nsubmeshes; ++k)
+      {
+         const cook_submesh_t* submesh = &mesh->submeshes[k];
+         if (submesh->base_vertex == window->base_vertex)
+         {
+            memcpy(&all[n], submesh->indices, submesh->ntotal * sizeof(unsigned int));
+            n += submesh->ntotal;
+         }
+      }
+
+      vcache_optimize_fetch(remap, all, ntotal, window->nwindow);
+
+      n = 0;
+      for (k = l; k < mesh->nsubmeshes; ++k)
+      {
+         cook_submesh_t* submesh = &mesh->submeshes[k];
+         if (submesh->base_vertex == window->base_vertex)
+         {
+            memcpy(submesh->indices, &all[n], submesh->ntotal * sizeof(unsigned int));
+            n += submesh->ntotal;
+         }
+      }
+
+      unsigned long base = window->base_vertex;
+      permute(&mesh->points[base], remap, window->nwindow, sizeof(vec3f_t));
+      permute(&mesh->normals[base], remap, window->nwindow, sizeof(vec3f_t));
+      for (k = 0; k < mesh->nuvmaps; ++k)
+      {
+         permute(&mesh->uvs[k * mesh->nvertices + base], remap, window->nwindow, sizeof(vec2f_t));
+      }
+
+      free(all);
+      free(remap);
+   }
+}
+
+// rounding moves a coordinate by half a step of its range
+static float range_error(const float* items, long nitems, long stride)
+{
+   float error = 0.0f;
+   long k = 0;
+   for (k = 0; k < stride; ++k)
+   {
+      float lo = 0.0f;
+      float hi = 0.0f;
+      long l = 0;
+      for (l = 0; l < nitems; ++l)
+      {
+         float f = items[l * stride + k];
+         lo = (l == 0 || f < lo) ? f : lo;
+         hi = (l == 0 || f > hi) ? f : hi;
+      }
+
+      float e = (hi - lo) / 65535.0f * 0.5f;
+      error = (e > error) ? e : error;
+   }
+   return error;
+}
+
+static int get_vertex_format(const cook_builder_t* builder)
+{
+   const cook_mesh_t* mesh = builder->mesh;
+   float vertex_error = (builder->vertex_error < 0.0f) ? VERTEX_ERROR : builder->vertex_error;
+   float uv_error = (builder->uv_error < 0.0f) ? UV_ERROR : builder->uv_error;
+   if (mesh->nvertices == 0 || vertex_error <= 0.0f || uv_error <= 0.0f)
+   {
+      return VERTEX_FLOAT;
+   }
+
+   float error = range_error(&mesh->points[0].x, mesh->nvertices, 3);
+   if (error > vertex_error)
+   {
+      LOGI("Points of '%s' would move by %f, keeping floats", builder->name, error);
+      return VERTEX_FLOAT;
+   }
+
+   long l = 0;
+   for (l = 0; l < mesh->nuvmaps; ++l)
+   {
+      error = range_error(&mesh->uvs[l * mesh->nvertices].x, mesh->nvertices, 2);
+      if (error > uv_error)
+      {
+         LOGI("UVs %ld of '%s' would move by %f, keeping floats", l, builder->name, error);
+         return VERTEX_FLOAT;
+      }
+   }
+
+   return VERTEX_PACKED;
+}
+
+// welds the corners of the dump bit for bit, points, normals and uvs of a
+// vertex are the ones of its first corner
+static int read_dump(cook_builder_t* builder, const char* data, long size, long* pused)
+{
+   if (size < (long)sizeof(dump_mesh_t))
+   {
+      LOGE("Truncated mesh dump");
+      return -1;
+   }
+
+   const dump_mesh_t* dump = (const dump_mesh_t*)data;
+   long nuvmaps = dump->nuvmaps;
+   long stride = 6 + 2 * nuvmaps;
+   long ncorners = dump->ntriangles * 3;
+   long used = sizeof(dump_mesh_t) + (nuvmaps + dump->nmaterials) * sizeof(atom_t) + dump->ntriangles * sizeof(unsigned int) + ncorners * stride * sizeof(float);
+   if (used > size)
+   {
+      LOGE("Truncated mesh dump, %ld bytes of %ld", size, used);
+      return -1;
+   }
+
+   const atom_t* uvmap_names = (const atom_t*)(data + sizeof(dump_mesh_t));
+   builder->materials = uvmap_names + nuvmaps;
+   builder->nmaterials = dump->nmaterials;
+   const unsigned int* triangle_materials = (const unsigned int*)(builder->materials + dump->nmaterials);
+   const float* corners = (const float*)(triangle_materials + dump->ntriangles);
+
+   builder->ntriangles = dump->ntriangles;
+   builder->vertex_error = dump->vertex_error;
+   builder->uv_error = dump->uv_error;
+   builder->triangle_materials = (unsigned int*)malloc((dump->ntriangles + 1) * sizeof(unsigned int));
+   memcpy(builder->triangle_materials, triangle_materials, dump->ntriangles * sizeof(unsigned int));
+
+   cook_mesh_t* mesh = builder->mesh;
+   mesh->name = dump->name;
+   mesh->default_uvmap = (nuvmaps > 0 && dump->default_uvmap < (unsigned long)nuvmaps) ? dump->default_uvmap : 0;
+   mesh->nuvmaps = nuvmaps;
+   mesh->uvmap_names = (atom_t*)malloc((nuvmaps + 1) * sizeof(atom_t));
+   memcpy(mesh->uvmap_names, uvmap_names, nuvmaps * sizeof(atom_t));
+
+   builder->indices = (unsigned int*)malloc((ncorners + 1) * sizeof(unsigned int));
+   mesh->nvertices = weld(builder->indices, corners, ncorners, stride);
+
+   mesh->points = (vec3f_t*)malloc((mesh->nvertices + 1) * sizeof(vec3f_t));
+   mesh->normals = (vec3f_t*)malloc((mesh->nvertices + 1) * sizeof(vec3f_t));
+   mesh->uvs = (vec2f_t*)malloc((nuvmaps * mesh->nvertices + 1) * sizeof(vec2f_t));
+
+   // vertices are numbered in the order their first corner comes
+   long nvertices = 0;
+   long l = 0;
+   for (l = 0; l < ncorners; ++l)
+   {
+      if (builder->indices[l] != nvertices)
+         continue;
+
+      const float* corner = &corners[l * stride];
+      memcpy(&mesh->points[nvertices], &corner[0], sizeof(vec3f_t));
+      memcpy(&mesh->normals[nvertices], &corner[3], sizeof(vec3f_t));
+
+      long m = 0;
+      for (m = 0; m < nuvmaps; ++m)
+      {
+         memcpy(&mesh->uvs[m * mesh->nvertices + nvertices], &corner[6 + m * 2], sizeof(vec2f_t));
+      }
+      ++nvertices;
+   }
+
+   (*pused) = used;
+   return 0;
+}
+
+// reads a mesh of the dump at data and cooks it, pused gets the size of its
+// dump. strings are the names of the world the atoms of the dump index.
+int cook_mesh_create(cook_mesh_t** pmesh, const char* data, long size, long* pused, const char* const* strings, long nstrings)
+{
+   cook_builder_t builder;
+   memset(&builder, 0, sizeof(builder));
+   builder.mesh = (cook_mesh_t*)malloc(sizeof(cook_mesh_t));
+   memset(builder.mesh, 0, sizeof(cook_mesh_t));
+
+   if (read_dump(&builder, data, size, pused) != 0)
+   {
+      cook_mesh_free(builder.mesh);
+      return -1;
+   }
+
+   cook_mesh_t* mesh = builder.mesh;
+   builder.name = (mesh->name < (atom_t)nstrings) ? strings[mesh->name] : "";
+
+   const vec2f_t* uvs = (mesh->nuvmaps > 0) ? mesh->uvs : NULL;
+   builder.nlevels = lod_build(builder.levels, mesh->points, mesh->normals, uvs, mesh->nvertices, builder.indices, builder.triangle_materials, builder.ntriangles);
+
+   long l = 0;
+   for (l = 0; l < builder.nlevels; ++l)
+   {
+      LOGI("Mesh '%s' lod %ld has %ld triangles error %f", builder.name, l, builder.levels[l].ntriangles, builder.levels[l].error);
+   }
+
+   build_windows(&builder);
+   for (l = 0; l < mesh->nsubmeshes; ++l)
+   {
+      build_clusters(mesh, &mesh->submeshes[l]);
+   }
+
+   optimize_vertex_cache(mesh);
+   mesh->format = get_vertex_format(&builder);
+
+   vcache_stats_t stats;
+   memset(&stats, 0, sizeof(stats));
+   long nclusters = 0;
+   for (l = 0; l < mesh->nsubmeshes; ++l)
+   {
+      const cook_submesh_t* submesh = &mesh->submeshes[l];
+      vcache_stats_t s;
+      vcache_analyze(&s, submesh->indices, submesh->nindices, submesh->nwindow);
+      stats.ntriangles += s.ntriangles;
+      stats.nvertices += s.nvertices;
+      stats.misses += s.misses;
+      nclusters += submesh->nclusters;
+   }
+
+   LOGI("Mesh '%s': %ld triangles, %ld corners welded to %ld vertices, %ld submeshes, %ld clusters, %ld lods, %s, ACMR %.3f ATVR %.3f",
+        builder.name, builder.ntriangles, builder.ntriangles * 3, mesh->nvertices, mesh->nsubmeshes, nclusters, builder.nlevels,
+        (mesh->format == VERTEX_PACKED) ? "packed" : "float", vcache_acmr(&stats), vcache_atvr(&stats));
+
+   lod_free(builder.levels, builder.nlevels);
+   free(builder.indices);
+   free(builder.triangle_materials);
+
+   (*pmesh) = mesh;
+   return 0;
+}
+
+void cook_mesh_free(cook_mesh_t* mesh)
+{
+   long l = 0;
+   for (l = 0; l < mesh->nsubmeshes; ++l)
+   {
+      free(mesh->submeshes[l].indices);
+      free(mesh->submeshes[l].clusters);
+   }
+   free(mesh->submeshes);
+   free(mesh->points);
+   free(mesh->normals);
+   free(mesh->uvs);
+   free(mesh->uvmap_names);
+   free(mesh);
+}
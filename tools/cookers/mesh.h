@@ -0,0 +1,67 @@
+#pragma once
+
+#include <world.h>
+#include "lod.h"
+
+// Mesh as dumped by io_export_runner.py. It is followed by the atoms of the
+// names of its uvmaps and materials, the material index of every triangle as
+// an unsigned int and the three corners of every triangle, a corner being
+// its point, its normal and its uv in every uvmap as floats.
+typedef struct dump_mesh_t
+{
+   atom_t name;
+
+   unsigned long default_uvmap;
+   unsigned long nuvmaps;
+   unsigned long nmaterials;
+   unsigned long ntriangles;
+
+   // the 'vertex_error' and 'uv_error' properties of the mesh, below zero
+   // when it has none
+   float vertex_error;
+   float uv_error;
+} dump_mesh_t;
+
+// indices count from base_vertex and go cluster by cluster, the simplified
+// levels follow them
+typedef struct cook_submesh_t
+{
+   atom_t material;
+
+   // the submeshes of a window share its vertices
+   unsigned long base_vertex;
+   long nwindow;
+
+   long nindices;
+   long ntotal;
+   unsigned int* indices;
+
+   long nclusters;
+   cluster_t* clusters;
+
+   long nlods;
+   lod_t lods[LOD_LEVELS];
+} cook_submesh_t;
+
+typedef struct cook_mesh_t
+{
+   atom_t name;
+
+   unsigned long default_uvmap;
+   int format;
+
+   long nvertices;
+   vec3f_t* points;
+   vec3f_t* normals;
+
+   // nvertices uvs of every uvmap one after the other
+   long nuvmaps;
+   atom_t* uvmap_names;
+   vec2f_t* uvs;
+
+   long nsubmeshes;
+   cook_submesh_t* submeshes;
+} cook_mesh_t;
+
+int cook_mesh_create(cook_mesh_t** pmesh, const char* data, long size, long* pused, const char* const* strings, long nstrings);
+void cook_mesh_free(cook_mesh_t* mesh);
@@ -0,0 +1,83 @@
+#include "weld.h"
+#include <common.h>
+
+// FNV-1a over the bits of the floats of an item, -0 hashes as 0 so that
+// items equal as floats land in the same bucket
+static unsigned int weld_hash(const float* item, long stride)
+{
+   unsigned int h = 2166136261u;
+   long l = 0;
+   for (l = 0; l < stride; ++l)
+   {
+      float f = (item[l] == 0.0f) ? 0.0f : item[l];
+      unsigned int bits = 0;
+      memcpy(&bits, &f, sizeof(bits));
+
+      int k = 0;
+      for (k = 0; k < 4; ++k)
+      {
+         h ^= (bits >> (k * 8)) & 0xff;
+         h *= 16777619u;
+      }
+   }
+   return h;
+}
+
+static int weld_equal(const float* a, const float* b, long stride)
+{
+   long l = 0;
+   for (l = 0; l < stride; ++l)
+   {
+      if (a[l] != b[l])
+      {
+         return 0;
+      }
+   }
+   return 1;
+}
+
+// merges equal items of stride floats each in one pass over an open
+// addressing hash table. remap gets the index of every item among the unique
+// ones, numbered in the order they first appear. Returns the number of
+// unique items.
+long weld(unsigned int* remap, const float* items, long nitems, long stride)
+{
+   unsigned long size = 16;
+   while (size < 2 * (unsigned long)nitems)
+   {
+      size *= 2;
+   }
+
+   // index of the first item of every unique one, -1 for empty slots
+   long* table = (long*)malloc(size * sizeof(long));
+   unsigned long l = 0;
+   for (l = 0; l < size; ++l)
+   {
+      table[l] = -1;
+   }
+
+   long nunique = 0;
+   long i = 0;
+   for (i = 0; i < nitems; ++i)
+   {
+      const float* item = &items[i * stride];
+      unsigned long slot = weld_hash(item, stride) & (size - 1);
+      while (table[slot] >= 0 && !weld_equal(item, &items[table[slot] * stride], stride))
+      {
+         slot = (slot + 1) & (size - 1);
+      }
+
+      if (table[slot] < 0)
+      {
+         table[slot] = i;
+         remap[i] = nunique++;
+      }
+      else
+      {
+         remap[i] = remap[table[slot]];
+      }
+   }
+
+   free(table);
+   return nunique;
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+long weld(unsigned int* remap, const float* items, long nitems, long stride);
@@ -0,0 +1,562 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <common.h>
+#include <world.h>
+#include <game.h>
+#include <stream.h>
+#include <image.h>
+#include <impostor.h>
+
+game_t* game = NULL;
+
+// Bakes impostors of the props of a world. Meshes used by enough mesh nodes
+// are rasterized on the cpu from nviews directions around their z axis, so
+// no gl context is needed, into a row of tiles each of an RGBA atlas saved as
+// a raw image. Pixels are shaded with the diffuse color of the material, its
+// png texture when the source is at hand and a light from the viewer. The
+// table of impostors is appended to the data of the world file.
+
+#define IMPOSTOR_MAX_ATLAS 2048
+
+typedef struct view_t
+{
+   int size;
+   float* depth;
+   unsigned char* color;
+} view_t;
+
+typedef struct source_t
+{
+   const mesh_t* mesh;
+   long ninstances;
+} source_t;
+
+static long next_pow2(long n)
+{
+   long r = 1;
+   while (r < n)
+   {
+      r <<= 1;
+   }
+   return r;
+}
+
+static void sample_texture(float* rgb, const image_t* image, float u, float v)
+{
+   if (image == NULL)
+   {
+      rgb[0] = rgb[1] = rgb[2] = 1.0f;
+      return;
+   }
+
+   const mipmap_t* mipmap = &image->mipmaps[0];
+   long bytes = image->bpp / 8;
+   long x = (long)((u - floorf(u)) * mipmap->width) % mipmap->width;
+   long y = (long)((v - floorf(v)) * mipmap->height) % mipmap->height;
+   const unsigned char* texel = (const unsigned char*)mipmap->data + (y * mipmap->width + x) * bytes;
+
+   int i = 0;
+   for (i = 0; i < 3; ++i)
+   {
+      rgb[i] = texel[i] / 255.0f;
+   }
+}
+
+// textures of the materials of a mesh when their png sources can be read,
+// compressed ones only live on the gpu
+static image_t* load_texture(const world_t* world, const submesh_t* submesh)
+{
+   const material_t* material = world_get_material(world, submesh->material);
+   const texture_t* texture = (material != NULL) ? world_get_texture(world, material->texture) : NULL;
+   if (texture == NULL)
+   {
+      return NULL;
+   }
+
+   image_t* image = NULL;
+   if (image_load_from_png(&image, atom_name(texture->path)) != 0)
+   {
+      LOGE("Unable to read texture '%s', using material color", atom_name(texture->path));
+      return NULL;
+   }
+
+   if (image->format != IMAGE_RAW || image->bpp < 24)
+   {
+      image_free(image);
+      return NULL;
+   }
+   return image;
+}
+
+static void draw_triangle(view_t* view, const world_t* world, const mesh_t* mesh, const submesh_t* submesh, const image_t* image,
+                          const unsigned long* tri, const vec3f_t* points, const vec3f_t* light)
+{
+   const float* p0 = &points[0].x;
+   const float* p1 = &points[1].x;
+   const float* p2 = &points[2].x;
+
+   float area = (p1[0] - p0[0]) * (p2[1] - p0[1]) - (p2[0] - p0[0]) * (p1[1] - p0[1]);
+   if (fabsf(area) < 1e-12f)
+   {
+      return;
+   }
+
+   int minx = (int)fmaxf(floorf(fminf(p0[0], fminf(p1[0], p2[0]))), 0.0f);
+   int maxx = (int)fminf(ceilf(fmaxf(p0[0], fmaxf(p1[0], p2[0]))), view->size - 1);
+   int miny = (int)fmaxf(floorf(fminf(p0[1], fminf(p1[1], p2[1]))), 0.0f);
+   int maxy = (int)fminf(ceilf(fmaxf(p0[1], fmaxf(p1[1], p2[1]))), view->size - 1);
+
+   const material_t* material = world_get_material(world, submesh->material);
+   const uvmap_t* uvmap = (mesh->nuvmaps > 0) ? &mesh->uvmaps[mesh->active_uvmap] : NULL;
+
+   int y = 0;
+   for (y = miny; y <= maxy; ++y)
+   {
+      int x = 0;
+      for (x = minx; x <= maxx; ++x)
+      {
+         float px = x + 0.5f;
+         float py = y + 0.5f;
+
+         // barycentrics, either winding as the mesh is seen from all sides
+         float b0 = ((p1[0] - px) * (p2[1] - py) - (p2[0] - px) * (p1[1] - py)) / area;
+         float b1 = ((p2[0] - px) * (p0[1] - py) - (p0[0] - px) * (p2[1] - py)) / area;
+         float b2 = 1.0f - b0 - b1;
+         if (b0 < 0.0f || b1 < 0.0f || b2 < 0.0f)
+            continue;
+
+         float depth = b0 * p0[2] + b1 * p1[2] + b2 * p2[2];
+         long pixel = y * view->size + x;
+         if (depth <= view->depth[pixel])
+            continue;
+         view->depth[pixel] = depth;
+
+         vec3f_t normal = { 0.0f, 0.0f, 0.0f };
+         vec2f_t uv = { 0.0f, 0.0f };
+         int k = 0;
+         for (k = 0; k < 3; ++k)
+         {
+            float b = (k == 0) ? b0 : (k == 1) ? b1 : b2;
+            vec3f_t n;
+            mesh_get_normal(mesh, tri[k], &n);
+            normal.x += n.x * b;
+            normal.y += n.y * b;
+            normal.z += n.z * b;
+            if (uvmap != NULL)
+            {
+               vec2f_t t;
+               mesh_get_uv(mesh, uvmap, tri[k], &t);
+               uv.x += t.x * b;
+               uv.y += t.y * b;
+            }
+         }
+         vec3_normalize(&normal);
+
+         // same terms as the level shaders, lambert plus a constant half
+         float diffuse = fminf(fmaxf(vec3_dot(&normal, light), 0.0f) + 0.5f, 1.0f);
+
+         float rgb[3];
+         sample_texture(rgb, image, uv.x, uv.y);
+         const float* color = (material != NULL) ? &material->diffuse.x : NULL;
+
+         unsigned char* out = &view->color[pixel * 4];
+         for (k = 0; k < 3; ++k)
+         {
+            float c = rgb[k] * diffuse * ((color != NULL) ? color[k] : 1.0f);
+            out[k] = (unsigned char)(fminf(fmaxf(c, 0.0f), 1.0f) * 255.0f + 0.5f);
+         }
+         out[3] = 255;
+      }
+   }
+}
+
+// clear pixels take the color of a covered neighbour, so filtering at the
+// edges of the prop does not bleed in black
+static void dilate(view_t* view)
+{
+   int size = view->size;
+   int pass = 0;
+   for (pass = 0; pass < 2; ++pass)
+   {
+      int y = 0;
+      for (y = 0; y < size; ++y)
+      {
+         int x = 0;
+         for (x = 0; x < size; ++x)
+         {
+            unsigned char* out = &view->color[(y * size + x) * 4];
+            if (out[3] != 0 || (out[0] | out[1] | out[2]) != 0)
+               continue;
+
+            int d = 0;
+            for (d = 0; d < 4; ++d)
+            {
+               int nx = x + ((d == 0) ? -1 : (d == 1) ? 1 : 0);
+               int ny = y + ((d == 2) ? -1 : (d == 3) ? 1 : 0);
+               if (nx < 0 || ny < 0 || nx >= size || ny >= size)
+                  continue;
+
+               const unsigned char* in = &view->color[(ny * size + nx) * 4];
+               if (in[3] != 0)
+               {
+                  out[0] = in[0];
+                  out[1] = in[1];
+                  out[2] = in[2];
+                  break;
+               }
+            }
+         }
+      }
+   }
+}
+
+static void bake_view(view_t* view, const world_t* world, const mesh_t* mesh, image_t** images, const impostor_t* impostor, float azimuth)
+{
+   // looking at the center from the azimuth, x of the image along the right
+   // of the viewer, y along z and depth growing towards the viewer
+   vec3f_t dir = { cosf(azimuth), sinf(azimuth), 0.0f };
+   vec3f_t right = { -dir.y, dir.x, 0.0f };
+   vec3f_t up = { 0.0f, 0.0f, 1.0f };
+   vec3f_t light;
+   vec3_normalize(vec3_add(&light, &dir, &up));
+
+   long npixels = view->size * view->size;
+   long l = 0;
+   for (l = 0; l < npixels; ++l)
+   {
+      view->depth[l] = -INFINITY;
+   }
+   memset(view->color, 0, npixels * 4);
+
+   float scale = view->size * 0.5f / impostor->radius;
+
+   const submesh_t* submesh = &mesh->submeshes[0];
+   long k = 0;
+   for (k = 0; k < mesh->nsubmeshes; ++k, ++submesh)
+   {
+      for (l = 0; l + 2 < submesh->nindices; l += 3)
+      {
+         unsigned long tri[3];
+         vec3f_t points[3];
+         int i = 0;
+         for (i = 0; i < 3; ++i)
+         {
+            tri[i] = submesh_get_index(submesh, l + i);
+
+            vec3f_t p;
+            mesh_get_point(mesh, tri[i], &p);
+            vec3_sub(&p, &p, &impostor->center);
+            points[i].x = vec3_dot(&p, &right) * scale + view->size * 0.5f;
+            points[i].y = vec3_dot(&p, &up) * scale + view->size * 0.5f;
+            points[i].z = vec3_dot(&p, &dir);
+         }
+         draw_triangle(view, world, mesh, submesh, images[k], tri, points, &light);
+      }
+   }
+
+   dilate(view);
+}
+
+static int compare_sources(const void* a, const void* b)
+{
+   const source_t* sa = (const source_t*)a;
+   const source_t* sb = (const source_t*)b;
+   return (sb->ninstances > sa->ninstances) - (sb->ninstances < sa->ninstances);
+}
+
+// meshes of mesh nodes used at least min_instances times, most used first
+static long find_sources(source_t* sources, const world_t* world, long min_instances)
+{
+   long l = 0;
+   for (l = 0; l < world->nmeshes; ++l)
+   {
+      sources[l].mesh = &world->meshes[l];
+      sources[l].ninstances = 0;
+   }
+
+   const scene_t* scene = &world->scenes[0];
+   for (l = 0; l < world->nscenes; ++l, ++scene)
+   {
+      long k = 0;
+      for (k = 0; k < scene->nnodes; ++k)
+      {
+         const node_t* node = &scene->nodes[k];
+         const mesh_t* mesh = (node->type == NODE_MESH) ? world_get_mesh(world, node->data) : NULL;
+         if (mesh != NULL && !node->occluder)
+         {
+            ++sources[mesh - world->meshes].ninstances;
+         }
+      }
+   }
+
+   qsort(sources, world->nmeshes, sizeof(source_t), compare_sources);
+
+   long n = 0;
+   while (n < world->nmeshes && sources[n].ninstances >= min_instances && sources[n].mesh->nvertices > 0)
+   {
+      ++n;
+   }
+   return n;
+}
+
+typedef struct options_t
+{
+   const char* output;
+   const char* atlas;
+   long nviews;
+   long tile;
+   long min_instances;
+   float distance;
+} options_t;
+
+static char* bake_atlas(long* psize, const world_t* world, const options_t* options)
+{
+   source_t* sources = (source_t*)malloc((world->nmeshes + 1) * sizeof(source_t));
+   long nsources = find_sources(sources, world, options->min_instances);
+
+   long width = next_pow2(options->nviews * options->tile);
+   long max_rows = IMPOSTOR_MAX_ATLAS / options->tile;
+   if (width > IMPOSTOR_MAX_ATLAS || max_rows == 0)
+   {
+      LOGE("%ld views of %ld pixels do not fit in a %d atlas", options->nviews, options->tile, IMPOSTOR_MAX_ATLAS);
+      free(sources);
+      return NULL;
+   }
+   if (nsources > max_rows)
+   {
+      LOGI("Only the %ld most used of %ld meshes fit in the atlas", max_rows, nsources);
+      nsources = max_rows;
+   }
+   if (nsources == 0)
+   {
+      LOGE("No mesh is used by %ld nodes", options->min_instances);
+      free(sources);
+      return NULL;
+   }
+   long height = next_pow2(nsources * options->tile);
+
+   // the table as it goes to the file, offsets relative to its start
+   long header_size = (sizeof(impostor_atlas_t) + 7) & ~7;
+   long size = header_size + nsources * sizeof(impostor_t);
+   char* blob = (char*)malloc(size);
+   memset(blob, 0, size);
+   impostor_atlas_t* atlas = (impostor_atlas_t*)blob;
+   impostor_t* impostors = (impostor_t*)(blob + header_size);
+   strncpy(atlas->path, options->atlas, IMPOSTOR_PATH_SIZE - 1);
+   atlas->distance = options->distance;
+   atlas->nviews = options->nviews;
+   atlas->tile_u = (float)options->tile / width;
+   atlas->nimpostors = nsources;
+   atlas->impostors = (impostor_t*)header_size;
+
+   image_t image;
+   mipmap_t mipmap;
+   image.format = IMAGE_RAW;
+   image.bpp = 32;
+   image.nmipmaps = 1;
+   image.mipmaps = &mipmap;
+   mipmap.width = width;
+   mipmap.height = height;
+   mipmap.size = width * height * 4;
+   mipmap.data = calloc(mipmap.size, 1);
+   unsigned char* pixels = (unsigned char*)mipmap.data;
+
+   view_t view;
+   view.size = options->tile;
+   view.depth = (float*)malloc(view.size * view.size * sizeof(float));
+   view.color = (unsigned char*)malloc(view.size * view.size * 4);
+
+   long l = 0;
+   for (l = 0; l < nsources; ++l)
+   {
+      const mesh_t* mesh = sources[l].mesh;
+      impostor_t* impostor = &impostors[l];
+      impostor->mesh = mesh - world->meshes;
+      impostor->v0 = (float)(l * options->tile) / height;
+      impostor->v1 = (float)((l + 1) * options->tile) / height;
+
+      bbox_t bounds;
+      bbox_reset(&bounds);
+      long k = 0;
+      for (k = 0; k < mesh->nvertices; ++k)
+      {
+         vec3f_t p;
+         mesh_get_point(mesh, k, &p);
+         bbox_inflate(&bounds, &p);
+      }
+      vec3_scale(&impostor->center, vec3_add(&impostor->center, &bounds.min, &bounds.max), 0.5f);
+
+      impostor->radius = 1e-6f;
+      for (k = 0; k < mesh->nvertices; ++k)
+      {
+         vec3f_t d;
+         mesh_get_point(mesh, k, &d);
+         vec3_sub(&d, &d, &impostor->center);
+         impostor->radius = fmaxf(impostor->radius, sqrtf(vec3_dot(&d, &d)));
+      }
+
+      image_t** images = (image_t**)malloc((mesh->nsubmeshes + 1) * sizeof(image_t*));
+      for (k = 0; k < mesh->nsubmeshes; ++k)
+      {
+         images[k] = load_texture(world, &mesh->submeshes[k]);
+      }
+
+      LOGI("Mesh '%s' used by %ld nodes, radius %.2f", atom_name(mesh->name), sources[l].ninstances, impostor->radius);
+
+      long v = 0;
+      for (v = 0; v < options->nviews; ++v)
+      {
+         bake_view(&view, world, mesh, images, impostor, 2.0f * M_PI * v / options->nviews);
+
+         long y = 0;
+         for (y = 0; y < view.size; ++y)
+         {
+            unsigned char* row = &pixels[((l * options->tile + y) * width + v * options->tile) * 4];
+            memcpy(row, &view.color[y * view.size * 4], view.size * 4);
+         }
+      }
+
+      for (k = 0; k < mesh->nsubmeshes; ++k)
+      {
+         if (images[k] != NULL)
+         {
+            image_free(images[k]);
+         }
+      }
+      free(images);
+   }
+
+   if (image_save(&image, options->atlas) != 0)
+   {
+      LOGE("Unable to write atlas '%s'", options->atlas);
+      free(blob);
+      blob = NULL;
+   }
+   else
+   {
+      LOGI("Wrote %ldx%ld atlas of %ld meshes to '%s'", width, height, nsources, options->atlas);
+   }
+
+   free(mipmap.data);
+   free(view.depth);
+   free(view.color);
+   free(sources);
+
+   *psize = size;
+   return blob;
+}
+
+static int bake_world(const char* input, const options_t* options)
+{
+   char* image = NULL;
+   long image_size = 0;
+   if (world_read_image(&image, &image_size, input) != 0)
+   {
+      return -1;
+   }
+
+   world_t* world = NULL;
+   if (world_load_from_image(&world, image) != 0)
+   {
+      free(image);
+      return -1;
+   }
+
+   long size = 0;
+   char* blob = bake_atlas(&size, world, options);
+   world_free(world);
+   if (blob == NULL)
+   {
+      free(image);
+      return -1;
+   }
+
+   long offset = world_append_blob(&image, &image_size, blob, size);
+   free(blob);
+
+   // a world baked before keeps its old table in the file unreferenced
+   long data_offset = ((const struct file_header_t*)image)->data_offset;
+   world_t* raw = (world_t*)(image + data_offset);
+   raw->impostors = (struct impostor_atlas_t*)offset;
+
+   int ret = world_write_image(image, image_size, options->output);
+   free(image);
+   return ret;
+}
+
+int main(int argc, char** argv)
+{
+   static struct option long_options[] =
+   {
+      {"output",    required_argument, 0, 'o'},
+      {"views",     required_argument, 0, 'v'},
+      {"tile",      required_argument, 0, 't'},
+      {"instances", required_argument, 0, 'n'},
+      {"distance",  required_argument, 0, 'd'},
+      {0, 0, 0, 0}
+   };
+
+   int option_index = 0;
+   int c = 0;
+
+   options_t options;
+   options.output = NULL;
+   options.atlas = NULL;
+   options.nviews = 8;
+   options.tile = 64;
+   options.min_instances = 4;
+   options.distance = 40.0f;
+
+   while (1)
+   {
+      c = getopt_long (argc, argv, "o:v:t:n:d:", long_options, &option_index);
+      if (c == -1)
+      {
+         break;
+      }
+
+      switch (c)
+      {
+         case 'o':
+            options.output = optarg;
+            break;
+         case 'v':
+            options.nviews = strtol(optarg, NULL, 10);
+            break;
+         case 't':
+            options.tile = strtol(optarg, NULL, 10);
+            break;
+         case 'n':
+            options.min_instances = strtol(optarg, NULL, 10);
+            break;
+         case 'd':
+            options.distance = strtof(optarg, NULL);
+            break;
+      }
+   }
+
+   if (optind + 2 > argc)
+   {
+      LOGE("Usage: impostor_bake [-o output] [-v views] [-t tile size] [-n min instances] [-d distance] world atlas");
+      return -1;
+   }
+
+   if (options.nviews <= 0 || options.tile <= 0 || options.min_instances <= 0 || options.distance <= 0.0f)
+   {
+      LOGE("You should specify positive views, tile size, instances and distance");
+      return -1;
+   }
+
+   const char* input = argv[optind];
+   options.atlas = argv[optind + 1];
+   options.output = (options.output != NULL) ? options.output : input;
+   if (strlen(options.atlas) >= IMPOSTOR_PATH_SIZE)
+   {
+      LOGE("Atlas path '%s' is longer than %d characters", options.atlas, IMPOSTOR_PATH_SIZE - 1);
+      return -1;
+   }
+
+   stream_init("");
+
+   return bake_world(input, &options) == 0 ? 0 : -1;
+}
@@ -2,38 +2,54 @@ import os
 import sys
 import struct
 import bpy
-import math
+import array
 from bpy.props import StringProperty
 
 bl_info = {
-    "name": "Runner Scenes Format (.runner)",
+    "name": "Runner Scenes Dump (.rdump)",
     "author": "asqz",
     "version": (0, 1),
     "blender": (2, 5, 8),
     "api": 36302,
-    "location": "File > Export > Runner (.runner)",
-    "description": "Export Runner Scene Format (.runner)",
+    "location": "File > Export > Runner (.rdump)",
+    "description": "Export Runner Scenes for tools/cooker (.rdump)",
     "warning": "",
     "category": "Import-Export"}
 
-header_t = struct.Struct("<8s3L")
-texcoord_t = struct.Struct("<2f")
+dump_header_t = struct.Struct("<8s5L")
+dump_mesh_t = struct.Struct("<I4L2f")
 vec3f_t = struct.Struct("<3f")
 bbox_t = struct.Struct("<12s12s")
 mat4f_t = struct.Struct("<16f")
-vertex_t = struct.Struct("<12s12s")
-camera_t = struct.Struct("<64sL5f64s64s")
-material_t = struct.Struct("<64s64s64s12s12sf")
-texture_t = struct.Struct("<64s64s4L")
-mesh_t = struct.Struct("<64s7L")
-submesh_t = struct.Struct("<64s2L")
-uvmap_t = struct.Struct("<64s2L")
-lamp_t = struct.Struct("<64s2L4f12s")
-node_t = struct.Struct("<64s64sL64s24s84sl")
+camera_t = struct.Struct("<IL5f64s64s")
+material_t = struct.Struct("<3I12s12sf")
+texture_t = struct.Struct("<2I4L")
+lamp_t = struct.Struct("<I2L4f12s")
+node_t = struct.Struct("<2IL64s24s84slLf")
 shape_t = struct.Struct("<L2f12s")
 phys_t = struct.Struct("<L8f12s12s24s")
-scene_t = struct.Struct("<64s64s12s2L")
-world_t = struct.Struct("<64s12L")
+scene_t = struct.Struct("<2I12s3L")
+world_t = struct.Struct("<I15L")
+
+# every name is written once to the string table at the end of the world,
+# structs refer to it by index and the engine interns it at load time
+strings = []
+string_indices = {}
+
+def reset_strings():
+   del strings[:]
+   string_indices.clear()
+   add_string("")
+
+def add_string(name):
+   if name not in string_indices:
+      string_indices[name] = len(strings)
+      strings.append(name)
+   return string_indices[name]
+
+def pack_strings():
+   data = b''.join([name.encode('utf-8') + b'\0' for name in strings])
+   return (data, len(strings))
 
 def convert_path (path):
    root = os.path.dirname(os.path.join(bpy.data.filepath))
@@ -43,9 +59,6 @@ def convert_path (path):
    return filepath
 
 
-def pack_uv(uv):
-   return texcoord_t.pack(uv[0], uv[1])
-
 def pack_vector(vec):
    return vec3f_t.pack(vec[0], vec[1], vec[2])
 
@@ -63,207 +76,53 @@ def pack_matrix(mat):
       mat[2][0],  mat[2][1],  mat[2][2],  mat[2][3],
       mat[3][0],  mat[3][1],  mat[3][2],  mat[3][3])
 
-def pack_vertex(v):
-   (point, normal) = v
-   return vertex_t.pack(pack_vector(point), pack_vector(normal))
-
-def arr_equal(v1, v2):
-   if len(v1) != len(v2):
-      return False
-
-   for i in range(0, len(v1)):
-      diff = v1[i] - v2[i]
-      if math.fabs(diff) > 0.0001:
-         return False
-   return True
-
-def vertices_equal(v1, v2):
-   (p1, n1, uv1) = v1
-   (p2, n2, uv2) = v2
-   return arr_equal(p1, p2) and arr_equal(n1, n2) and arr_equal(uv1, uv2)
-
-def add_vertex(vertices, uvs, mesh, index, face, uv):
-   v = mesh.vertices[index]
-
-   if face.use_smooth:
-      normal = v.normal
-   else:
-      normal = face.normal
-
-   vert = (v.co, normal)
-
-   for i in range(0, len(vertices)):
-      if vertices_equal(vert, vertices[i]) and arr_equal(uv, uvs[i]):
-         #print("Using vertex: #%d"%i)
-         return i
-
-   #print("point: " + str(point) + " norm: "+ str(normal))
-   vertices.append(vert)
-   uvs.append(uv)
-   return len(vertices) - 1
-
-def pack_submesh(material, submesh_indices, offset):
-   nindices = len(submesh_indices)
-   print("Submesh: %s %d indices"%(material.name, nindices))
-
-   indices = bytes()
-   for i in submesh_indices:
-      indices += struct.pack('<I', i)
-
-   pindices = offset
-   header = submesh_t.pack(material.name.encode('utf-8'), nindices, pindices)
-   return (header, indices)
-
-def pack_submeshes(mesh, indices, offset):
-   submeshes = []
-   for i in range(0, len(mesh.materials)):
-      submesh_indices = [index for (material_index, index) in indices if material_index == i]
-      if len(submesh_indices) > 0:
-         submeshes.append((submesh_indices, mesh.materials[i]))
-
-   print("Submeshes count: %d total indices %d"%(len(submeshes), len(indices)))
-
-   offset += len(submeshes) * submesh_t.size
-
-   header = bytes()
-   data = bytes()
-   for (submesh_indices, material) in submeshes:
-      (h, d) = pack_submesh(material, submesh_indices, offset)
-      header += h
-      data += d
-      offset += len(d)
-
-   return (header + data, len(submeshes))
-
-def pack_vertices(vertices, offset):
-   print("%d vertices"%len(vertices))
-   data = bytes()
-   for vert in vertices:
-      data += pack_vertex(vert)
-
-   return (data, len(vertices))
-
-def pack_uvmap(uvmap, offset):
-   (name, data) = uvmap
-   print("uvmap %s with %d items"%(name, len(data)))
-
-   nuvs = len(data)
-   puvs = offset
-
-   uvs = bytes()
-   for uv in data:
-      print("UV: ", uv[0], uv[1])
-      uvs += pack_uv(uv)
-
-   header = uvmap_t.pack(name.encode('utf-8'), nuvs, puvs)
-
-   return (header, uvs)
-
-def pack_uvmaps(uvmaps, offset):
-   print("%d uvmaps"%len(uvmaps))
-   offset += len(uvmaps) * uvmap_t.size
-
-   header = bytes()
-   data = bytes()
-   for uvmap in uvmaps:
-      (h, d) = pack_uvmap(uvmap, offset)
-      header += h
-      data += d
-      offset += len(d)
-
-   return (header + data, len(uvmaps))
-
-def uvs_equal(uvs1, uvs2):
-   for i in range(0, len(uvs1)):
-      if not arr_equal(uvs1[i], uvs2[i]):
-         return False
-   return True
-
-def vert_equal(v1, v2):
-   (p1, n1, uvs1) = v1
-   (p2, n2, uvs2) = v2
-   return arr_equal(p1, p2) and arr_equal(n1, n2) and uvs_equal(uvs1, uvs2)
-
-def build_vert(mesh, face, uvs, i):
-   v = mesh.vertices[face.vertices[i]]
-   if face.use_smooth:
-      normal = v.normal
-   else:
-      normal = face.normal
-
-   texcoords = []
-   for uv in uvs:
-      texcoords.append(uv[i])
-
-   return (v.co, normal, texcoords)
-
-def add_vert(verts, mesh, face, uvs, i):
-   v = build_vert(mesh, face, uvs, i)
-   for index, vert in enumerate(verts):
-      if vert_equal(v, vert):
-         return index
-
-   index = len(verts)
-   verts.append(v)
-   return index
-
-def build_vertices_uvmaps(mesh):
-   verts = []
-   mesh_indices = []
-   for index, face in enumerate(mesh.faces):
-      uvs = []
-      for uvmap in mesh.uv_textures:
-         uvs.append(uvmap.data[index].uv)
-
-      i0 = add_vert(verts, mesh, face, uvs, 0);
-      i1 = add_vert(verts, mesh, face, uvs, 1);
-      for i in range(2, len(face.vertices)):
-         i2 = add_vert(verts, mesh, face, uvs, i);
-
-         mesh_indices.append((face.material_index, i0))
-         mesh_indices.append((face.material_index, i1))
-         mesh_indices.append((face.material_index, i2))
-
-         i1 = i2
-
-   mesh_vertices = [(point, normal) for (point, normal, uvs) in verts]
-
-   mesh_uvmaps = []
-   for (index, uvmap) in enumerate(mesh.uv_textures):
-      m = [uvs[index] for (point, normal, uvs) in verts]
-      mesh_uvmaps.append((uvmap.name, m))
-
-   return (mesh_vertices, mesh_uvmaps, mesh_indices)
-
-def pack_mesh(mesh, offset):
+# meshes are dumped as raw triangles, tools/cooker welds their corners and
+# builds the submeshes, clusters, levels and vertex format. A corner is its
+# point, its normal and its uv in every uvmap, faces are fans around their
+# first corner.
+def dump_mesh(mesh):
    print("Mesh: " + mesh.name)
 
-   (mesh_vertices, mesh_uvmaps, mesh_indices) = build_vertices_uvmaps(mesh)
-
-   pvertices = offset
-   (vertices, nvertices) = pack_vertices(mesh_vertices, pvertices)
-
-   puvmaps = pvertices + len(vertices)
-   (uvmaps, nuvmaps) = pack_uvmaps(mesh_uvmaps, puvmaps)
-
-   psubmeshes = puvmaps + len(uvmaps)
-   (submeshes, nsubmeshes) = pack_submeshes(mesh, mesh_indices, psubmeshes)
-
-   header = mesh_t.pack(mesh.name.encode('utf-8'), mesh.uv_textures.active_index, nvertices, nuvmaps, nsubmeshes, pvertices, puvmaps, psubmeshes)
-   return (header, vertices + uvmaps + submeshes)
-
-def pack_meshes(meshes, offset):
-   offset += len(meshes) * mesh_t.size
-
-   header = bytes()
-   data = bytes()
-   for mesh in meshes:
-      (h, d) = pack_mesh(mesh, offset)
-      header += h
-      data += d
-      offset += len(d)
-
-   return (header + data, len(meshes))
+   uv_data = [uvmap.data for uvmap in mesh.uv_textures]
+   corners = array.array('f')
+   triangle_materials = array.array('I')
+   for (index, face) in enumerate(mesh.faces):
+      face_corners = []
+      for (k, i) in enumerate(face.vertices):
+         v = mesh.vertices[i]
+         normal = v.normal if face.use_smooth else face.normal
+         corner = [v.co[0], v.co[1], v.co[2], normal[0], normal[1], normal[2]]
+         for data in uv_data:
+            uv = data[index].uv[k]
+            corner.extend((uv[0], uv[1]))
+         face_corners.append(corner)
+
+      for k in range(2, len(face_corners)):
+         corners.extend(face_corners[0])
+         corners.extend(face_corners[k - 1])
+         corners.extend(face_corners[k])
+         triangle_materials.append(face.material_index)
+
+   uvmap_names = array.array('I', [add_string(uvmap.name) for uvmap in mesh.uv_textures])
+   material_names = array.array('I', [add_string(material.name if material != None else "") for material in mesh.materials])
+   if sys.byteorder == 'big':
+      for a in [corners, triangle_materials, uvmap_names, material_names]:
+         a.byteswap()
+
+   # the uvmap active in blender is the one drawn until the gui switches,
+   # the cooker has defaults for errors below zero
+   header = dump_mesh_t.pack(
+         add_string(mesh.name),
+         max(mesh.uv_textures.active_index, 0),
+         len(uvmap_names), len(material_names), len(triangle_materials),
+         float(mesh.get('vertex_error', -1.0)),
+         float(mesh.get('uv_error', -1.0)))
+
+   print("%d triangles"%len(triangle_materials))
+   return b''.join([header, uvmap_names.tobytes(), material_names.tobytes(), triangle_materials.tobytes(), corners.tobytes()])
+
+def dump_meshes(meshes):
+   return (b''.join([dump_mesh(mesh) for mesh in meshes]), len(meshes))
 
 def get_camera_type(typename):
    if (typename == 'PERSP'):
@@ -316,12 +175,10 @@ def pack_camera(camera):
    zfar = camera.clip_end
    identity = [[1.0, 0.0, 0.0, 0.0], [0.0, 1.0, 0.0, 0.0], [0.0, 0.0, 1.0, 0.0], [0.0, 0.0, 0.0, 1.0]]
 
-   return camera_t.pack(camera.name.encode('utf-8'), type, fovx, fovy, aspect, znear, zfar, pack_matrix(identity), pack_matrix(identity))
+   return camera_t.pack(add_string(camera.name), type, fovx, fovy, aspect, znear, zfar, pack_matrix(identity), pack_matrix(identity))
 
 def pack_cameras(cameras, offset):
-   data = bytes()
-   for camera in cameras:
-      data += pack_camera(camera)
+   data = b''.join([pack_camera(camera) for camera in cameras])
 
    return (data, len(cameras))
 
@@ -334,17 +191,15 @@ def pack_material(material):
    texture_slot = material.texture_slots[0]
    texturename = texture_slot.texture.name if texture_slot != None else ""
    return material_t.pack(
-         material.name.encode('utf-8'),
-         shader.encode('utf-8'),
-         texturename.encode('utf-8'),
+         add_string(material.name),
+         add_string(shader),
+         add_string(texturename),
          pack_color_scaled(material.diffuse_color, material.diffuse_intensity),
          pack_color_scaled(material.specular_color, material.specular_intensity),
          material.specular_hardness)
 
 def pack_materials(materials, offset):
-   data = bytes()
-   for material in materials:
-      data += pack_material(material)
+   data = b''.join([pack_material(material) for material in materials])
 
    return (data, len(materials))
 
@@ -389,15 +244,13 @@ def pack_texture(texture):
       wrap_t = GL_CLAMP_TO_EDGE
 
    return texture_t.pack(
-         texture.name.encode('utf-8'),
-         convert_path(texture.image.filepath).encode('utf-8'),
+         add_string(texture.name),
+         add_string(convert_path(texture.image.filepath)),
          min_filter, mag_filter,
          wrap_s, wrap_t)
 
 def pack_textures(textures, offset):
-   data = bytes()
-   for texture in textures:
-      data += pack_texture(texture)
+   data = b''.join([pack_texture(texture) for texture in textures])
 
    return (data, len(textures))
 
@@ -431,16 +284,14 @@ def pack_lamp(lamp):
       spot_blend = 0.0
 
    return lamp_t.pack(
-         lamp.name.encode('utf-8'),
+         add_string(lamp.name),
          type, falloff_type,
          lamp.energy, lamp.distance,
          spot_size, spot_blend,
          pack_color(lamp.color))
 
 def pack_lamps(lamps, offset):
-   data = bytes()
-   for lamp in lamps:
-      data += pack_lamp(lamp)
+   data = b''.join([pack_lamp(lamp) for lamp in lamps])
 
    return (data, len(lamps))
 
@@ -458,16 +309,38 @@ def get_bbox(node):
    print("Bbox: " + str(bbox_min) + ": "+ str(bbox_max))
    return (bbox_min, bbox_max)
 
+# walls and terrain are marked with an 'occluder' game property
+def is_occluder(node):
+   if node.type == 'MESH' and 'occluder' in node.game.properties:
+      return 1
+   return 0
+
+# the node property wins over the materials, a mesh only gets the distance of
+# its materials when all of them have one
+def get_draw_distance(node):
+   if 'draw_distance' in node.game.properties:
+      return float(node.game.properties['draw_distance'].value)
+
+   if node.type != 'MESH' or len(node.data.materials) == 0:
+      return 0.0
+
+   distances = [material.get('draw_distance') for material in node.data.materials if material != None]
+   if len(distances) == 0 or None in distances:
+      return 0.0
+   return float(max(distances))
+
 def pack_scene_node(node, parent_index):
    bbox = get_bbox(node)
    return node_t.pack(
-         node.name.encode('utf-8'),
-         node.data.name.encode('utf-8'),
+         add_string(node.name),
+         add_string(node.data.name),
          get_node_type(node.type),
          pack_matrix(node.matrix_local),
          pack_bbox(bbox),
          pack_phys(node.game, bbox),
-         parent_index)
+         parent_index,
+         is_occluder(node),
+         get_draw_distance(node))
 
 def build_nodes_list(root_nodes, offset):
    if len(root_nodes) == 0:
@@ -489,12 +362,12 @@ def pack_scene_nodes(nodes, offset):
 
    print("Nodes count: %d"%(len(sorted_nodes)))
 
-   data = bytes()
+   data = []
    for (parent_index, node) in sorted_nodes:
       print("Node %s parent %d"%(node.name, parent_index))
-      data += pack_scene_node(node, parent_index)
+      data.append(pack_scene_node(node, parent_index))
 
-   return (data, len(sorted_nodes))
+   return (b''.join(data), len(sorted_nodes))
 
 def pack_scene(scene, offset):
    print("Scene: " + scene.name)
@@ -502,21 +375,22 @@ def pack_scene(scene, offset):
    pnodes = offset
    (data, nnodes) = pack_scene_nodes(scene.objects, pnodes)
 
-   header = scene_t.pack(scene.name.encode('utf-8'), scene.camera.name.encode('utf-8'), pack_vector(scene.gravity), nnodes, pnodes)
+   # potentially visible sets are added later by pvs_bake
+   header = scene_t.pack(add_string(scene.name), add_string(scene.camera.name), pack_vector(scene.gravity), nnodes, pnodes, 0)
    return (header, data)
 
 def pack_scenes(scenes, offset):
    offset += len(scenes) * scene_t.size
 
-   header = bytes()
-   data = bytes()
+   header = []
+   data = []
    for scene in scenes:
       (h, d) = pack_scene(scene, offset)
-      header += h
-      data += d
+      header.append(h)
+      data.append(d)
       offset += len(d)
 
-   return (header + data, len(scenes))
+   return (b''.join(header + data), len(scenes))
 
 def pack_shape(shape):
    (type, margin, radius, extents) = shape
@@ -549,9 +423,15 @@ def pack_phys(phys, bbox):
          pack_vector(angular_factor),
          pack_shape((get_shape_type(phys.collision_bounds_type), phys.collision_margin, phys.radius, extents)))
 
+# the world data as the cooker writes it but without meshes, which follow as
+# a dump. Their names go to the string table like the others.
 def pack_world(name, world):
    print("World: " + name)
 
+   reset_strings()
+
+   (meshes, nmeshes) = dump_meshes(world.meshes)
+
    pcameras = world_t.size
    (cameras, ncameras) = pack_cameras(world.cameras, pcameras)
 
@@ -561,35 +441,43 @@ def pack_world(name, world):
    ptextures = pmaterials + len(materials)
    (textures, ntextures) = pack_textures(world.textures, ptextures)
 
-   pmeshes = ptextures + len(textures)
-   (meshes, nmeshes)  = pack_meshes(world.meshes, pmeshes)
+   # meshes are laid out by the cooker
+   pmeshes = 0
 
-   plamps = pmeshes + len(meshes)
+   plamps = ptextures + len(textures)
    (lamps, nlamps) = pack_lamps(world.lamps, plamps)
 
    pscenes = plamps + len(lamps)
    (scenes, nscenes) = pack_scenes(world.scenes, pscenes)
 
+   pstrings = pscenes + len(scenes)
+   wname = add_string(name)
+   (string_data, nstrings) = pack_strings()
+   print("%d strings"%nstrings)
+
    header = world_t.pack(
-      name.encode('utf-8'),
-      ncameras, nmaterials, ntextures, nmeshes, nlamps, nscenes,
-      pcameras, pmaterials, ptextures, pmeshes, plamps, pscenes)
+      wname,
+      ncameras, nmaterials, ntextures, nmeshes, nlamps, nscenes, nstrings,
+      pcameras, pmaterials, ptextures, pmeshes, plamps, pscenes, pstrings,
+      # impostors are added later by impostor_bake
+      0)
 
-   return header + cameras + materials + textures + meshes + lamps + scenes
+   return (b''.join([header, cameras, materials, textures, lamps, scenes, string_data]), meshes, nmeshes)
 
 def export_runner_world(context, filepath):
    print("EXPORT RUNNER WORLD TO: " + filepath)
 
    world_name = bpy.path.display_name_from_filepath(filepath)
 
-   data = pack_world(world_name, bpy.data)
-   print("World size: %d"%len(data))
+   (data, meshes, nmeshes) = pack_world(world_name, bpy.data)
+   print("World size: %d, %d meshes in %d bytes"%(len(data), nmeshes, len(meshes)))
 
-   header = header_t.pack("RNNRWRLD".encode('utf-8'), 1, header_t.size, len(data))
+   header = dump_header_t.pack("RNNRDUMP".encode('utf-8'), 1, dump_header_t.size, len(data), dump_header_t.size + len(data), nmeshes)
 
    f = open(filepath, 'wb')
    f.write(header)
    f.write(data)
+   f.write(meshes)
    f.close()
 
    return {"FINISHED"}
@@ -597,16 +485,16 @@ def export_runner_world(context, filepath):
 class RunnerExporter(bpy.types.Operator):
    bl_idname = "export.runner"
    bl_label = "Export Runner"
-   filename_ext = ".runner"
+   filename_ext = ".rdump"
    filepath = StringProperty(name="File Path", subtype="FILE_PATH")
 
    def execute(self, context):
       return export_runner_world(context, self.filepath)
 
 def menu_func(self, context):
-   default_path = os.path.splitext(bpy.data.filepath)[0] + ".runner"
+   default_path = os.path.splitext(bpy.data.filepath)[0] + ".rdump"
    print("DEFAULT PATH: " + default_path)
-   self.layout.operator(RunnerExporter.bl_idname, text="Runner (.runner)").filepath = default_path
+   self.layout.operator(RunnerExporter.bl_idname, text="Runner (.rdump)").filepath = default_path
 
 def register():
    bpy.utils.register_module(__name__)
@@ -0,0 +1,356 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <common.h>
+#include <game.h>
+#include <mathlib.h>
+#include <simd.h>
+#include <timestamp.h>
+#include <bbox.h>
+#include <frustum.h>
+
+game_t* game = NULL;
+
+#define NMATRICES 1024
+#define NBOXES 10000
+
+// Runs the SIMD math kernels against their scalar references on random
+// well conditioned transforms, reporting the time per call of both and the
+// largest relative difference. Returns non zero if any kernel is off by more
+// than the tolerance. The draw transforms entry compares the per draw affine
+// math against the general mat4 one, the batch entries compare the array
+// kernels against per element calls. The frustum cull entry runs the batch
+// culler over NBOXES boxes against one box at a time and reports the share of
+// boxes they disagree on.
+
+static float frand(float min, float max)
+{
+   return min + (max - min) * ((float)rand() / (float)RAND_MAX);
+}
+
+static void random_transform(mat4f_t* m)
+{
+   quat_t q;
+   vec3f_t angles = { frand(-M_PI, M_PI), frand(-M_PI, M_PI), frand(-M_PI, M_PI) };
+   quat_from_angles(&q, &angles);
+   mat4_from_quaternion(m, &q);
+
+   float scale = frand(0.1f, 10.0f);
+   int i = 0;
+   for (i = 0; i < 12; ++i)
+   {
+      m->m[i] *= scale;
+   }
+   m->m14 = frand(-100.0f, 100.0f);
+   m->m24 = frand(-100.0f, 100.0f);
+   m->m34 = frand(-100.0f, 100.0f);
+}
+
+// reference box transform, all 8 corners one by one
+static void bbox_transform_corners(bbox_t* r, const bbox_t* b, const affine_t* m)
+{
+   bbox_reset(r);
+   int i = 0;
+   for (i = 0; i < 8; ++i)
+   {
+      vec3f_t corner = { (i & 1) ? b->max.x : b->min.x, (i & 2) ? b->max.y : b->min.y, (i & 4) ? b->max.z : b->min.z };
+      vec3f_t p;
+      affine_mult_vec3(&p, m, &corner);
+      bbox_inflate(r, &p);
+   }
+}
+
+static float relative_error(const float* a, const float* b, int n)
+{
+   float norm = 0.0f;
+   float diff = 0.0f;
+   int i = 0;
+   for (i = 0; i < n; ++i)
+   {
+      norm = fmaxf(norm, fabsf(b[i]));
+      diff = fmaxf(diff, fabsf(a[i] - b[i]));
+   }
+   return (norm > 0.0f) ? diff / norm : diff;
+}
+
+typedef struct kernel_result_t
+{
+   const char* name;
+   long scalar_us;
+   long simd_us;
+   float error;
+   float tolerance;
+} kernel_result_t;
+
+static int report(const kernel_result_t* r, long ncalls)
+{
+   int ok = (r->error <= r->tolerance);
+   LOGI("%-16s scalar %8.2f ns simd %8.2f ns speedup %5.2fx | max rel error %.3g (tolerance %.3g) %s",
+        r->name,
+        r->scalar_us * 1000.0f / ncalls, r->simd_us * 1000.0f / ncalls,
+        (r->simd_us > 0) ? (float)r->scalar_us / (float)r->simd_us : 0.0f,
+        r->error, r->tolerance, ok ? "ok" : "FAILED");
+   return ok ? 0 : -1;
+}
+
+int main(int argc, char** argv)
+{
+   static struct option long_options[] =
+   {
+      {"iterations", required_argument, 0, 'i'},
+      {0, 0, 0, 0}
+   };
+
+   int option_index = 0;
+   int c = 0;
+   long niterations = 1000;
+
+   while (1)
+   {
+      c = getopt_long (argc, argv, "i:", long_options, &option_index);
+      if (c == -1)
+      {
+         break;
+      }
+
+      switch (c)
+      {
+         case 'i':
+            niterations = strtol(optarg, NULL, 10);
+            break;
+      }
+   }
+
+   if (niterations <= 0)
+   {
+      LOGE("You should specify positive number of iterations");
+      return -1;
+   }
+
+#ifdef MATHLIB_SIMD
+   LOGI("SIMD kernels enabled");
+#else
+   LOGI("SIMD kernels disabled, comparing scalar code against itself");
+#endif
+
+   static mat4f_t a[NMATRICES];
+   static mat4f_t b[NMATRICES];
+   static mat4f_t r1[NMATRICES];
+   static mat4f_t r2[NMATRICES];
+   static vec4f_t v[NMATRICES];
+   static vec4f_t v1[NMATRICES];
+   static vec4f_t v2[NMATRICES];
+   static float d1[NMATRICES];
+   static float d2[NMATRICES];
+
+   srand(1);
+
+   long i = 0;
+   for (i = 0; i < NMATRICES; ++i)
+   {
+      random_transform(&a[i]);
+      random_transform(&b[i]);
+      v[i].x = frand(-100.0f, 100.0f);
+      v[i].y = frand(-100.0f, 100.0f);
+      v[i].z = frand(-100.0f, 100.0f);
+      v[i].w = 1.0f;
+   }
+
+   const long ncalls = niterations * NMATRICES;
+   int result = 0;
+   long n = 0;
+   timestamp_t start;
+   kernel_result_t k;
+
+#define BENCH(elapsed, body) \
+   timestamp_set(&start); \
+   for (n = 0; n < niterations; ++n) \
+      for (i = 0; i < NMATRICES; ++i) \
+         body; \
+   elapsed = timestamp_elapsed_us(&start);
+
+   k.name = "mat4_mult";
+   k.tolerance = 1e-6f;
+   BENCH(k.scalar_us, mat4_mult_scalar(&r1[i], &a[i], &b[i]));
+   BENCH(k.simd_us, mat4_mult(&r2[i], &a[i], &b[i]));
+   for (k.error = 0.0f, i = 0; i < NMATRICES; ++i)
+      k.error = fmaxf(k.error, relative_error(r2[i].m, r1[i].m, 16));
+   result |= report(&k, ncalls);
+
+   k.name = "mat4_mult_vec3";
+   k.tolerance = 1e-6f;
+   BENCH(k.scalar_us, mat4_mult_vec3_scalar((vec3f_t*)&v1[i], &a[i], (const vec3f_t*)&v[i]));
+   BENCH(k.simd_us, mat4_mult_vec3((vec3f_t*)&v2[i], &a[i], (const vec3f_t*)&v[i]));
+   for (k.error = 0.0f, i = 0; i < NMATRICES; ++i)
+      k.error = fmaxf(k.error, relative_error(&v2[i].x, &v1[i].x, 3));
+   result |= report(&k, ncalls);
+
+   k.name = "mat4_mult_vec4";
+   k.tolerance = 1e-6f;
+   BENCH(k.scalar_us, mat4_mult_vec4_scalar(&v1[i], &a[i], &v[i]));
+   BENCH(k.simd_us, mat4_mult_vec4(&v2[i], &a[i], &v[i]));
+   for (k.error = 0.0f, i = 0; i < NMATRICES; ++i)
+      k.error = fmaxf(k.error, relative_error(&v2[i].x, &v1[i].x, 4));
+   result |= report(&k, ncalls);
+
+   k.name = "mat4_determinant";
+   k.tolerance = 1e-5f;
+   BENCH(k.scalar_us, d1[i] = mat4_determinant_scalar(&a[i]));
+   BENCH(k.simd_us, d2[i] = mat4_determinant(&a[i]));
+   for (k.error = 0.0f, i = 0; i < NMATRICES; ++i)
+      k.error = fmaxf(k.error, relative_error(&d2[i], &d1[i], 1));
+   result |= report(&k, ncalls);
+
+   k.name = "mat4_invert";
+   k.tolerance = 1e-5f;
+   BENCH(k.scalar_us, (r1[i] = a[i], mat4_invert_scalar(&r1[i])));
+   BENCH(k.simd_us, (r2[i] = a[i], mat4_invert(&r2[i])));
+   for (k.error = 0.0f, i = 0; i < NMATRICES; ++i)
+      k.error = fmaxf(k.error, relative_error(r2[i].m, r1[i].m, 16));
+   result |= report(&k, ncalls);
+
+   // per draw transforms, the mat4 path world_render_mesh used to take
+   // against the affine one: a[] are views, b[] model transforms
+   static affine_t av[NMATRICES];
+   static affine_t ab[NMATRICES];
+   static mat4f_t mvi1[NMATRICES];
+   static mat4f_t mvi2[NMATRICES];
+   mat4f_t proj;
+   mat4_set_perspective(&proj, 0.8f, 1.6f, 0.1f, 100.0f);
+   for (i = 0; i < NMATRICES; ++i)
+   {
+      affine_from_mat4(&av[i], &a[i]);
+      affine_from_mat4(&ab[i], &b[i]);
+   }
+
+   k.name = "draw transforms";
+   k.tolerance = 1e-5f;
+   BENCH(k.scalar_us,
+   {
+      mat4f_t mv;
+      mat4_mult(&mv, &a[i], &b[i]);
+      mat4_mult(&r1[i], &proj, &mv);
+      mat4_inverted(&mvi1[i], &mv);
+      mat4_transpose(&mvi1[i]);
+   });
+   BENCH(k.simd_us,
+   {
+      affine_t mv;
+      mat3f_t normal;
+      affine_mult(&mv, &av[i], &ab[i]);
+      mat4_mult_affine(&r2[i], &proj, &mv);
+      affine_normal_matrix(&normal, &mv);
+      mat4_from_mat3(&mvi2[i], &normal);
+   });
+   for (k.error = 0.0f, i = 0; i < NMATRICES; ++i)
+   {
+      // only the 3x3 part of the inverse transpose reaches the shaders
+      mvi1[i].m41 = mvi1[i].m42 = mvi1[i].m43 = 0.0f;
+      mvi1[i].m14 = mvi1[i].m24 = mvi1[i].m34 = 0.0f;
+      mvi1[i].m44 = 1.0f;
+      k.error = fmaxf(k.error, relative_error(r2[i].m, r1[i].m, 16));
+      k.error = fmaxf(k.error, relative_error(mvi2[i].m, mvi1[i].m, 16));
+   }
+   result |= report(&k, ncalls);
+
+   // batch kernels against element by element calls, one batch per iteration
+   static vec3f_t p[NMATRICES];
+   static vec3f_t p1[NMATRICES];
+   static vec3f_t p2[NMATRICES];
+   static affine_t am1[NMATRICES];
+   static affine_t am2[NMATRICES];
+   static bbox_t boxes[NMATRICES];
+   static bbox_t b1[NMATRICES];
+   static bbox_t b2[NMATRICES];
+   for (i = 0; i < NMATRICES; ++i)
+   {
+      p[i].x = v[i].x;
+      p[i].y = v[i].y;
+      p[i].z = v[i].z;
+      boxes[i].min.x = frand(-10.0f, 0.0f);
+      boxes[i].min.y = frand(-10.0f, 0.0f);
+      boxes[i].min.z = frand(-10.0f, 0.0f);
+      boxes[i].max.x = frand(0.0f, 10.0f);
+      boxes[i].max.y = frand(0.0f, 10.0f);
+      boxes[i].max.z = frand(0.0f, 10.0f);
+   }
+
+#define BENCH_BATCH(elapsed, body) \
+   timestamp_set(&start); \
+   for (n = 0; n < niterations; ++n) \
+      body; \
+   elapsed = timestamp_elapsed_us(&start);
+
+   k.name = "transform points";
+   k.tolerance = 1e-6f;
+   BENCH(k.scalar_us, affine_mult_vec3(&p1[i], &av[0], &p[i]));
+   BENCH_BATCH(k.simd_us, affine_transform_points(p2, &av[0], p, NMATRICES));
+   for (k.error = 0.0f, i = 0; i < NMATRICES; ++i)
+      k.error = fmaxf(k.error, relative_error(&p2[i].x, &p1[i].x, 3));
+   result |= report(&k, ncalls);
+
+   k.name = "mult batch";
+   k.tolerance = 1e-6f;
+   BENCH(k.scalar_us, affine_mult(&am1[i], &av[0], &ab[i]));
+   BENCH_BATCH(k.simd_us, affine_mult_batch(am2, &av[0], ab, NMATRICES));
+   for (k.error = 0.0f, i = 0; i < NMATRICES; ++i)
+      k.error = fmaxf(k.error, relative_error(am2[i].m, am1[i].m, 12));
+   result |= report(&k, ncalls);
+
+   k.name = "transform boxes";
+   k.tolerance = 1e-5f;
+   BENCH(k.scalar_us, bbox_transform_corners(&b1[i], &boxes[i], &ab[i]));
+   BENCH_BATCH(k.simd_us, bbox_transform_batch(b2, boxes, ab, NMATRICES));
+   for (k.error = 0.0f, i = 0; i < NMATRICES; ++i)
+      k.error = fmaxf(k.error, relative_error(&b2[i].min.x, &b1[i].min.x, 6));
+   result |= report(&k, ncalls);
+
+   // a camera at the origin looking down -z into a field of boxes, about a
+   // tenth of them visible
+   static bbox_t field[NBOXES];
+   static unsigned char last_plane[(NBOXES + 3) / 4];
+   static unsigned int bits[(NBOXES + 31) / 32];
+   static int inside[NBOXES];
+   for (i = 0; i < NBOXES; ++i)
+   {
+      vec3f_t c = { frand(-100.0f, 100.0f), frand(-100.0f, 100.0f), frand(-100.0f, 100.0f) };
+      vec3f_t e = { frand(0.1f, 5.0f), frand(0.1f, 5.0f), frand(0.1f, 5.0f) };
+      vec3_sub(&field[i].min, &c, &e);
+      vec3_add(&field[i].max, &c, &e);
+   }
+
+   bbox_soa_t* soa = NULL;
+   bbox_soa_create(&soa, NBOXES);
+   bbox_soa_set(soa, field, 0, NBOXES);
+
+   mat4f_t view;
+   frustum_t frustum;
+   mat4_set_identity(&view);
+   frustum_set(&frustum, &proj, &view);
+
+   k.name = "frustum cull";
+   k.tolerance = 0.0f;
+   timestamp_set(&start);
+   for (n = 0; n < niterations; ++n)
+      for (i = 0; i < NBOXES; ++i)
+         inside[i] = frustum_intersect_aabb(&frustum, &field[i]);
+   k.scalar_us = timestamp_elapsed_us(&start);
+   BENCH_BATCH(k.simd_us, frustum_cull_batch(&frustum, soa, NULL, last_plane, bits));
+   long nvisible = 0;
+   long nmismatches = 0;
+   for (i = 0; i < NBOXES; ++i)
+   {
+      int visible = (bits[i >> 5] >> (i & 31)) & 1;
+      nvisible += visible;
+      nmismatches += (visible != (inside[i] >= 0));
+   }
+   k.error = (float)nmismatches / NBOXES;
+   LOGI("%ld of %d boxes visible", nvisible, NBOXES);
+   result |= report(&k, niterations * NBOXES);
+
+   bbox_soa_free(soa);
+
+#undef BENCH_BATCH
+#undef BENCH
+
+   return (result == 0) ? 0 : 1;
+}
@@ -0,0 +1,330 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <common.h>
+#include <world.h>
+#include <game.h>
+#include <stream.h>
+#include <vcache.h>
+
+game_t* game = NULL;
+
+// Reorders the triangles and vertices of every mesh of a world file for the
+// post transform cache and for vertex fetches, see vcache.h. Triangles move
+// within their cluster and within their level, so clusters and lods keep
+// their ranges. Vertices move within the window of the submeshes using them,
+// every index stays in range of its base vertex. Sizes do not change, the
+// file is rewritten in place of the memory image.
+
+typedef struct reorder_t
+{
+   const world_t* world;
+
+   // the raw image of the data, a relocated pointer of the world at some
+   // offset from the world points at that offset in it
+   char* raw;
+
+   vcache_stats_t before;
+   vcache_stats_t after;
+} reorder_t;
+
+static void* raw_pointer(const reorder_t* reorder, const void* ptr)
+{
+   return reorder->raw + ((const char*)ptr - (const char*)reorder->world);
+}
+
+static void add_stats(vcache_stats_t* r, const vcache_stats_t* stats)
+{
+   r->ntriangles += stats->ntriangles;
+   r->nvertices += stats->nvertices;
+   r->misses += stats->misses;
+}
+
+// the full indices of the submesh followed by those of its levels, relative
+// to its base vertex
+static unsigned int* read_indices(const submesh_t* submesh, long* pnindices)
+{
+   long nindices = submesh->nindices;
+   long l = 0;
+   for (l = 0; l < submesh->nlods; ++l)
+   {
+      long end = submesh->lods[l].first + submesh->lods[l].nindices;
+      nindices = (end > nindices) ? end : nindices;
+   }
+
+   unsigned int* indices = (unsigned int*)malloc((nindices + 1) * sizeof(unsigned int));
+   for (l = 0; l < nindices; ++l)
+   {
+      indices[l] = submesh_get_index(submesh, l) - submesh->base_vertex;
+   }
+
+   (*pnindices) = nindices;
+   return indices;
+}
+
+static void write_indices(const reorder_t* reorder, const submesh_t* submesh, const unsigned int* indices, long nindices)
+{
+   long l = 0;
+   if (submesh->index_size == 2)
+   {
+      unsigned short* r = (unsigned short*)raw_pointer(reorder, submesh->indices);
+      for (l = 0; l < nindices; ++l)
+      {
+         r[l] = (unsigned short)indices[l];
+      }
+   }
+   else
+   {
+      memcpy(raw_pointer(reorder, submesh->indices), indices, nindices * sizeof(unsigned int));
+   }
+}
+
+// the cluster ranges, or the whole submesh for one without clusters, and the
+// ranges of the levels
+static void optimize_triangles(const submesh_t* submesh, unsigned int* indices, long nvertices)
+{
+   long l = 0;
+   if (submesh->nclusters == 0)
+   {
+      vcache_optimize(indices, submesh->nindices, nvertices);
+   }
+   for (l = 0; l < submesh->nclusters; ++l)
+   {
+      const cluster_t* cluster = &submesh->clusters[l];
+      vcache_optimize(&indices[cluster->first], cluster->nindices, nvertices);
+   }
+   for (l = 0; l < submesh->nlods; ++l)
+   {
+      const lod_t* lod = &submesh->lods[l];
+      vcache_optimize(&indices[lod->first], lod->nindices, nvertices);
+   }
+}
+
+static void permute(void* items, const unsigned int* remap, long nitems, long size)
+{
+   char* copy = (char*)malloc(nitems * size);
+   memcpy(copy, items, nitems * size);
+
+   long l = 0;
+   for (l = 0; l < nitems; ++l)
+   {
+      memcpy((char*)items + remap[l] * size, copy + l * size, size);
+   }
+   free(copy);
+}
+
+// the submeshes of a window share its vertices, from base to base + nvertices
+static void reorder_window(reorder_t* reorder, const mesh_t* mesh, unsigned long base, long nvertices)
+{
+   const int packed = (mesh->format == VERTEX_PACKED);
+
+   long nsubmeshes = 0;
+   long ntotal = 0;
+   unsigned int** indices = (unsigned int**)calloc(mesh->nsubmeshes, sizeof(unsigned int*));
+   long* nindices = (long*)calloc(mesh->nsubmeshes, sizeof(long));
+
+   long l = 0;
+   for (l = 0; l < mesh->nsubmeshes; ++l)
+   {
+      const submesh_t* submesh = &mesh->submeshes[l];
+      if (submesh->base_vertex != base)
+         continue;
+
+      indices[l] = read_indices(submesh, &nindices[l]);
+
+      long k = 0;
+      for (k = 0; k < nindices[l]; ++k)
+      {
+         if (indices[l][k] >= nvertices)
+         {
+            LOGE("Mesh '%s' indexes past its window, leaving it as is", atom_name(mesh->name));
+            nsubmeshes = -1;
+            break;
+         }
+      }
+      if (nsubmeshes < 0)
+         break;
+
+      ++nsubmeshes;
+      ntotal += nindices[l];
+   }
+
+   if (nsubmeshes > 0)
+   {
+      unsigned int* all = (unsigned int*)malloc(ntotal * sizeof(unsigned int));
+      unsigned int* remap = (unsigned int*)malloc(nvertices * sizeof(unsigned int));
+
+      long n = 0;
+      for (l = 0; l < mesh->nsubmeshes; ++l)
+      {
+         if (indices[l] == NULL)
+            continue;
+
+         const submesh_t* submesh = &mesh->submeshes[l];
+         vcache_stats_t stats;
+         vcache_analyze(&stats, indices[l], submesh->nindices, nvertices);
+         add_stats(&reorder->before, &stats);
+
+         optimize_triangles(submesh, indices[l], nvertices);
+         memcpy(&all[n], indices[l], nindices[l] * sizeof(unsigned int));
+         n += nindices[l];
+      }
+
+      vcache_optimize_fetch(remap, all, ntotal, nvertices);
+
+      n = 0;
+      for (l = 0; l < mesh->nsubmeshes; ++l)
+      {
+         if (indices[l] == NULL)
+            continue;
+
+         const submesh_t* submesh = &mesh->submeshes[l];
+         write_indices(reorder, submesh, &all[n], nindices[l]);
+
+         vcache_stats_t stats;
+         vcache_analyze(&stats, &all[n], submesh->nindices, nvertices);
+         add_stats(&reorder->after, &stats);
+         n += nindices[l];
+      }
+
+      long vertex_size = packed ? sizeof(vertex_packed_t) : sizeof(vertex_t);
+      permute((char*)raw_pointer(reorder, mesh->vertices) + base * vertex_size, remap, nvertices, vertex_size);
+
+      long uv_size = packed ? 2 * sizeof(unsigned short) : sizeof(vec2f_t);
+      for (l = 0; l < mesh->nuvmaps; ++l)
+      {
+         const uvmap_t* uvmap = &mesh->uvmaps[l];
+         if (uvmap->uvs != NULL)
+         {
+            permute((char*)raw_pointer(reorder, uvmap->uvs) + base * uv_size, remap, nvertices, uv_size);
+         }
+      }
+
+      free(all);
+      free(remap);
+   }
+
+   for (l = 0; l < mesh->nsubmeshes; ++l)
+   {
+      free(indices[l]);
+   }
+   free(indices);
+   free(nindices);
+}
+
+static void reorder_mesh(reorder_t* reorder, const mesh_t* mesh)
+{
+   // a window ends where the next one starts
+   long l = 0;
+   for (l = 0; l < mesh->nsubmeshes; ++l)
+   {
+      unsigned long base = mesh->submeshes[l].base_vertex;
+      unsigned long end = mesh->nvertices;
+      int first = 1;
+
+      long k = 0;
+      for (k = 0; k < mesh->nsubmeshes; ++k)
+      {
+         unsigned long other = mesh->submeshes[k].base_vertex;
+         first &= !(other == base && k < l);
+         if (other > base && other < end)
+         {
+            end = other;
+         }
+      }
+
+      if (first && base < mesh->nvertices)
+      {
+         reorder_window(reorder, mesh, base, end - base);
+      }
+   }
+}
+
+static int reorder_world(const char* input, const char* output)
+{
+   char* image = NULL;
+   long image_size = 0;
+   if (world_read_image(&image, &image_size, input) != 0)
+   {
+      return -1;
+   }
+
+   world_t* world = NULL;
+   if (world_load_from_image(&world, image) != 0)
+   {
+      free(image);
+      return -1;
+   }
+
+   reorder_t reorder;
+   memset(&reorder, 0, sizeof(reorder));
+   reorder.world = world;
+   reorder.raw = image + ((const struct file_header_t*)image)->data_offset;
+
+   long l = 0;
+   for (l = 0; l < world->nmeshes; ++l)
+   {
+      const mesh_t* mesh = &world->meshes[l];
+      vcache_stats_t before = reorder.before;
+      vcache_stats_t after = reorder.after;
+
+      reorder_mesh(&reorder, mesh);
+
+      vcache_stats_t mesh_before = { reorder.before.ntriangles - before.ntriangles, reorder.before.nvertices - before.nvertices, reorder.before.misses - before.misses };
+      vcache_stats_t mesh_after = { reorder.after.ntriangles - after.ntriangles, reorder.after.nvertices - after.nvertices, reorder.after.misses - after.misses };
+      LOGI("Mesh '%s' ACMR %.3f -> %.3f ATVR %.3f -> %.3f", atom_name(mesh->name), vcache_acmr(&mesh_before), vcache_acmr(&mesh_after), vcache_atvr(&mesh_before), vcache_atvr(&mesh_after));
+   }
+
+   LOGI("World ACMR %.3f -> %.3f ATVR %.3f -> %.3f over %ld triangles", vcache_acmr(&reorder.before), vcache_acmr(&reorder.after), vcache_atvr(&reorder.before), vcache_atvr(&reorder.after), reorder.after.ntriangles);
+
+   world_free(world);
+
+   int ret = world_write_image(image, image_size, output);
+   free(image);
+   return ret;
+}
+
+int main(int argc, char** argv)
+{
+   static struct option long_options[] =
+   {
+      {"output", required_argument, 0, 'o'},
+      {0, 0, 0, 0}
+   };
+
+   int option_index = 0;
+   int c = 0;
+
+   const char* output = NULL;
+
+   while (1)
+   {
+      c = getopt_long (argc, argv, "o:", long_options, &option_index);
+      if (c == -1)
+      {
+         break;
+      }
+
+      switch (c)
+      {
+         case 'o':
+            output = optarg;
+            break;
+      }
+   }
+
+   if (optind >= argc)
+   {
+      LOGE("Usage: mesh_reorder [-o output] world");
+      return -1;
+   }
+
+   const char* input = argv[optind];
+   if (output == NULL)
+   {
+      output = input;
+   }
+
+   stream_init("");
+
+   return reorder_world(input, output) == 0 ? 0 : -1;
+}
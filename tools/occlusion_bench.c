@@ -0,0 +1,333 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <common.h>
+#include <world.h>
+#include <game.h>
+#include <stream.h>
+#include <timestamp.h>
+#include <frustum.h>
+#include <occlusion.h>
+#include <nodes.h>
+#include <hierarchy.h>
+#include <bvh.h>
+
+game_t* game = NULL;
+
+// Runs occlusion culling without a gl context, either on a scene of a world
+// file seen from its camera or on a generated corridor: two long walls with
+// a crate behind every wall segment and a few in the open. Reports how many
+// nodes pass the frustum and the occlusion test and the time per frame, and
+// can write the depth buffer of the last frame as a pgm image.
+
+#define CORRIDOR_SEGMENTS 64
+
+static vertex_t box_vertices[8];
+static unsigned int box_indices[36] =
+{
+   0, 2, 1, 1, 2, 3,
+   4, 5, 6, 5, 7, 6,
+   0, 1, 4, 1, 5, 4,
+   2, 6, 3, 3, 6, 7,
+   0, 4, 2, 2, 4, 6,
+   1, 3, 5, 3, 7, 5,
+};
+
+// unit box around the origin, scaled by the node transforms
+static void box_mesh(mesh_t* mesh, submesh_t* submesh)
+{
+   int i = 0;
+   for (i = 0; i < 8; ++i)
+   {
+      box_vertices[i].point.x = (i & 1) ? 0.5f : -0.5f;
+      box_vertices[i].point.y = (i & 2) ? 0.5f : -0.5f;
+      box_vertices[i].point.z = (i & 4) ? 0.5f : -0.5f;
+   }
+
+   memset(submesh, 0, sizeof(submesh_t));
+   submesh->index_size = sizeof(unsigned int);
+   submesh->nindices = 36;
+   submesh->indices = box_indices;
+
+   memset(mesh, 0, sizeof(mesh_t));
+   mesh->nvertices = 8;
+   mesh->vertices = box_vertices;
+   mesh->nsubmeshes = 1;
+   mesh->submeshes = submesh;
+}
+
+static void box_node(affine_t* transform, bbox_t* bounds, float x, float y, float z, float sx, float sy, float sz)
+{
+   mat4f_t m;
+   mat4_set_identity(&m);
+   m.m11 = sx;
+   m.m22 = sy;
+   m.m33 = sz;
+   m.m14 = x;
+   m.m24 = y;
+   m.m34 = z;
+   affine_from_mat4(transform, &m);
+
+   bounds->min.x = x - sx * 0.5f;
+   bounds->min.y = y - sy * 0.5f;
+   bounds->min.z = z - sz * 0.5f;
+   bounds->max.x = x + sx * 0.5f;
+   bounds->max.y = y + sy * 0.5f;
+   bounds->max.z = z + sz * 0.5f;
+}
+
+static void write_depth(const occlusion_t* occlusion, const char* fname)
+{
+   FILE* f = fopen(fname, "wb");
+   if (f == NULL)
+   {
+      LOGE("Unable to open '%s'", fname);
+      return;
+   }
+
+   fprintf(f, "P5\n%d %d\n255\n", occlusion->width, occlusion->height);
+
+   // top row first, nearer is brighter
+   int y = 0;
+   for (y = occlusion->height - 1; y >= 0; --y)
+   {
+      int x = 0;
+      for (x = 0; x < occlusion->width; ++x)
+      {
+         long tile = (y / OCCLUSION_TILE_SIZE) * occlusion->ntiles_x + (x / OCCLUSION_TILE_SIZE);
+         float d = occlusion->depth[tile * OCCLUSION_TILE_SIZE * OCCLUSION_TILE_SIZE + (y % OCCLUSION_TILE_SIZE) * OCCLUSION_TILE_SIZE + (x % OCCLUSION_TILE_SIZE)];
+         d = fminf(fmaxf(d, -1.0f), 1.0f);
+         fputc((int)((1.0f - d) * 127.5f), f);
+      }
+   }
+
+   fclose(f);
+}
+
+typedef struct bench_t
+{
+   long nnodes;
+   const affine_t* transforms;
+   const bbox_t* bounds;
+   const mesh_t** meshes;
+   const unsigned char* occluders;
+} bench_t;
+
+static void run(const bench_t* bench, const mat4f_t* proj, const mat4f_t* view, long nframes, const char* output)
+{
+   occlusion_t* occlusion = NULL;
+   if (occlusion_create(&occlusion, OCCLUSION_WIDTH, OCCLUSION_HEIGHT) != 0)
+   {
+      return;
+   }
+
+   frustum_t frustum;
+   frustum_set(&frustum, proj, view);
+
+   long* visible = (long*)malloc((bench->nnodes + 1) * sizeof(long));
+   long nvisible = 0;
+   long noccluders = 0;
+   long npassed = 0;
+   long l = 0;
+   for (l = 0; l < bench->nnodes; ++l)
+   {
+      if (frustum_intersect_aabb(&frustum, &bench->bounds[l]) >= 0)
+      {
+         visible[nvisible++] = l;
+         noccluders += bench->occluders[l];
+      }
+   }
+
+   timestamp_t start;
+   long draw_us = 0;
+   long test_us = 0;
+   long n = 0;
+   for (n = 0; n < nframes; ++n)
+   {
+      timestamp_set(&start);
+      occlusion_begin(occlusion, proj, view);
+      for (l = 0; l < nvisible; ++l)
+      {
+         long i = visible[l];
+         if (bench->occluders[i])
+         {
+            occlusion_draw_mesh(occlusion, bench->meshes[i], &bench->transforms[i]);
+         }
+      }
+      draw_us += timestamp_elapsed_us(&start);
+
+      timestamp_set(&start);
+      npassed = 0;
+      for (l = 0; l < nvisible; ++l)
+      {
+         long i = visible[l];
+         npassed += bench->occluders[i] || occlusion_test_aabb(occlusion, &bench->bounds[i]);
+      }
+      test_us += timestamp_elapsed_us(&start);
+   }
+
+   LOGI("nodes %5ld in frustum %5ld occluders %4ld | not occluded %5ld culled %5ld | us/frame: draw %6.1f test %6.1f",
+        bench->nnodes, nvisible, noccluders, npassed, nvisible - npassed,
+        (float)draw_us / nframes, (float)test_us / nframes);
+
+   if (output != NULL)
+   {
+      write_depth(occlusion, output);
+   }
+
+   free(visible);
+   occlusion_free(occlusion);
+}
+
+static void run_corridor(long nframes, const char* output)
+{
+   const long nnodes = 4 * CORRIDOR_SEGMENTS;
+   affine_t* transforms = (affine_t*)malloc(nnodes * sizeof(affine_t));
+   bbox_t* bounds = (bbox_t*)malloc(nnodes * sizeof(bbox_t));
+   const mesh_t** meshes = (const mesh_t**)malloc(nnodes * sizeof(mesh_t*));
+   unsigned char* occluders = (unsigned char*)malloc(nnodes * sizeof(unsigned char));
+
+   mesh_t box;
+   submesh_t submesh;
+   box_mesh(&box, &submesh);
+
+   // looking down -z along a corridor 4 units wide, walls are 4 units long
+   // and crates sit 1 unit behind them or on the floor of the corridor
+   long l = 0;
+   long s = 0;
+   for (s = 0; s < CORRIDOR_SEGMENTS; ++s)
+   {
+      float z = -2.0f - s * 4.0f;
+      box_node(&transforms[l], &bounds[l], -2.5f, 0.0f, z, 1.0f, 4.0f, 4.0f);
+      occluders[l++] = 1;
+      box_node(&transforms[l], &bounds[l], 2.5f, 0.0f, z, 1.0f, 4.0f, 4.0f);
+      occluders[l++] = 1;
+      box_node(&transforms[l], &bounds[l], (s & 1) ? 4.0f : -4.0f, -1.0f, z, 1.0f, 1.0f, 1.0f);
+      occluders[l++] = 0;
+      box_node(&transforms[l], &bounds[l], (s & 1) ? -1.0f : 1.0f, -1.5f, z, 0.5f, 0.5f, 0.5f);
+      occluders[l++] = 0;
+   }
+
+   for (l = 0; l < nnodes; ++l)
+   {
+      meshes[l] = &box;
+   }
+
+   mat4f_t proj;
+   mat4f_t view;
+   mat4_set_perspective(&proj, 1.0f, 1.6f, 0.1f, 100.0f);
+   mat4_set_identity(&view);
+
+   bench_t bench = { nnodes, transforms, bounds, meshes, occluders };
+   run(&bench, &proj, &view, nframes, output);
+
+   free(transforms);
+   free(bounds);
+   free(meshes);
+   free(occluders);
+}
+
+static void run_scene(const char* world_file, const char* scene_name, long nframes, const char* output)
+{
+   world_t* world = NULL;
+   if (world_load_from_file(&world, world_file) != 0)
+   {
+      return;
+   }
+
+   scene_t* scene = (scene_name != NULL) ? world_get_scene(world, atom_find(scene_name)) : &world->scenes[0];
+   node_t* camera_node = (scene != NULL) ? scene_get_node(scene, scene->camera) : NULL;
+   nodes_t* nodes = NULL;
+   if (camera_node == NULL || nodes_create(&nodes, world, scene) != 0)
+   {
+      LOGE("Unable to set up scene '%s'", scene_name);
+      world_free(world);
+      return;
+   }
+
+   // same setup as the game camera
+   camera_t* camera = world_get_camera(world, camera_node->data);
+   affine_t view_affine;
+   mat4f_t view;
+   mat4f_t proj;
+   affine_inverted(&view_affine, &nodes->hierarchy->world[camera_node - scene->nodes]);
+   affine_to_mat4(&view, &view_affine);
+   mat4_set_perspective(&proj, camera->fovy / 2.0f, camera->aspect, camera->znear, camera->zfar);
+
+   unsigned char* occluders = (unsigned char*)malloc((nodes->nnodes + 1) * sizeof(unsigned char));
+   long l = 0;
+   for (l = 0; l < nodes->nnodes; ++l)
+   {
+      occluders[l] = (nodes->flags[l] & NODE_OCCLUDER) ? 1 : 0;
+   }
+
+   bench_t bench = { nodes->nnodes, nodes->hierarchy->world, nodes->world_bounds, (const mesh_t**)nodes->data, occluders };
+   run(&bench, &proj, &view, nframes, output);
+
+   free(occluders);
+   nodes_free(nodes);
+   world_free(world);
+}
+
+int main(int argc, char** argv)
+{
+   static struct option long_options[] =
+   {
+      {"world",  required_argument, 0, 'w'},
+      {"scene",  required_argument, 0, 's'},
+      {"frames", required_argument, 0, 'f'},
+      {"output", required_argument, 0, 'o'},
+      {0, 0, 0, 0}
+   };
+
+   int option_index = 0;
+   int c = 0;
+
+   const char* world_file = NULL;
+   const char* scene_name = NULL;
+   const char* output = NULL;
+   long nframes = 100;
+
+   while (1)
+   {
+      c = getopt_long (argc, argv, "w:s:f:o:", long_options, &option_index);
+      if (c == -1)
+      {
+         break;
+      }
+
+      switch (c)
+      {
+         case 'w':
+            world_file = optarg;
+            break;
+         case 's':
+            scene_name = optarg;
+            break;
+         case 'f':
+            nframes = strtol(optarg, NULL, 10);
+            break;
+         case 'o':
+            output = optarg;
+            break;
+      }
+   }
+
+   if (nframes <= 0)
+   {
+      LOGE("You should specify positive number of frames");
+      return -1;
+   }
+
+   stream_init("");
+
+   if (world_file != NULL)
+   {
+      run_scene(world_file, scene_name, nframes, output);
+   }
+   else
+   {
+      run_corridor(nframes, output);
+   }
+
+   return 0;
+}
@@ -0,0 +1,376 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <common.h>
+#include <world.h>
+#include <game.h>
+#include <stream.h>
+#include <timestamp.h>
+#include <physics.h>
+
+game_t* game = NULL;
+
+#define MAX_RUNS 16
+
+// bullet allocates through these once main installs them, the count shows
+// whether steady state stepping allocates
+static long nallocs = 0;
+
+static void* counting_alloc(size_t size)
+{
+   ++nallocs;
+   return malloc(size);
+}
+
+static void counting_free(void* ptr)
+{
+   free(ptr);
+}
+
+typedef struct body_t
+{
+   mat4f_t transform;
+   struct physics_rigid_body_t* body;
+} body_t;
+
+static void body_transform_setter(const struct physics_rigid_body_t* b, const mat4f_t* transform, void* user_data)
+{
+   ((body_t*)user_data)->transform = *transform;
+}
+
+static void body_transform_getter(const struct physics_rigid_body_t* b, mat4f_t* transform, void* user_data)
+{
+   *transform = ((body_t*)user_data)->transform;
+}
+
+static void node_transform_setter(const struct physics_rigid_body_t* b, const mat4f_t* transform, void* user_data)
+{
+   ((node_t*)user_data)->transform = *transform;
+}
+
+static void node_transform_getter(const struct physics_rigid_body_t* b, mat4f_t* transform, void* user_data)
+{
+   *transform = ((node_t*)user_data)->transform;
+}
+
+static void draw_line(const vec3f_t* from, const vec3f_t* to, const vec3f_t* color)
+{
+}
+
+static void set_default_phys(phys_t* phys, int type, float mass)
+{
+   memset(phys, 0, sizeof(phys_t));
+   phys->type = type;
+   phys->mass = mass;
+   phys->friction = 0.5f;
+   phys->restitution = 0.1f;
+   phys->linear_damping = 0.04f;
+   phys->angular_damping = 0.1f;
+   phys->linear_sleeping_threshold = 0.8f;
+   phys->angular_sleeping_threshold = 1.0f;
+   phys->inertia_factor = 0.4f;
+   phys->linear_factor.x = phys->linear_factor.y = phys->linear_factor.z = 1.0f;
+   phys->angular_factor.x = phys->angular_factor.y = phys->angular_factor.z = 1.0f;
+   phys->shape.margin = 0.04f;
+}
+
+static int add_body(struct physics_world_t* phys, body_t* body, const phys_t* props, float x, float y, float z)
+{
+   mat4_set_translation(&body->transform, x, y, z);
+   if (physics_rigid_body_create(&body->body, props, NULL, body_transform_setter, body_transform_getter, body) != 0)
+   {
+      return -1;
+   }
+   physics_world_add_rigid_body(phys, body->body);
+   return 0;
+}
+
+// Spawns a static ground slab and a square grid of alternating crates and
+// barrels stacked in layers of at most 32x32 bodies.
+static body_t* spawn_bodies(struct physics_world_t* phys, long nbodies)
+{
+   body_t* bodies = (body_t*)malloc((nbodies + 1) * sizeof(body_t));
+   memset(bodies, 0, (nbodies + 1) * sizeof(body_t));
+
+   phys_t ground;
+   set_default_phys(&ground, PHYS_STATIC, 0.0f);
+   ground.shape.type = SHAPE_BOX;
+   ground.shape.extents.x = ground.shape.extents.y = 200.0f;
+   ground.shape.extents.z = 1.0f;
+   add_body(phys, &bodies[nbodies], &ground, 0.0f, 0.0f, -0.5f);
+
+   phys_t crate;
+   set_default_phys(&crate, PHYS_RIGID, 1.0f);
+   crate.shape.type = SHAPE_BOX;
+   crate.shape.extents.x = crate.shape.extents.y = crate.shape.extents.z = 1.0f;
+
+   phys_t barrel;
+   set_default_phys(&barrel, PHYS_RIGID, 1.0f);
+   barrel.shape.type = SHAPE_CYLINDER;
+   barrel.shape.radius = 0.5f;
+   barrel.shape.extents.z = 1.2f;
+
+   const long side = 32;
+   const float spacing = 1.5f;
+   long l = 0;
+   for (l = 0; l < nbodies; ++l)
+   {
+      long layer = l / (side * side);
+      long row = (l / side) % side;
+      long column = l % side;
+
+      float x = (column - side / 2) * spacing;
+      float y = (row - side / 2) * spacing;
+      float z = 1.0f + layer * spacing;
+
+      add_body(phys, &bodies[l], (l & 1) ? &barrel : &crate, x, y, z);
+   }
+
+   return bodies;
+}
+
+static int compare_longs(const void* a, const void* b)
+{
+   long la = *(const long*)a;
+   long lb = *(const long*)b;
+   return (la > lb) - (la < lb);
+}
+
+static long percentile(const long* sorted, long count, int p)
+{
+   long index = (count * p) / 100;
+   return sorted[index < count ? index : count - 1];
+}
+
+static void run(const char* world_file, const char* scene_name, long nbodies, long nframes, float dt, int profile)
+{
+   vec3f_t worldMin = { -1000.0f, -1000.0f, -1000.0f };
+   vec3f_t worldMax = { 1000.0f, 1000.0f, 1000.0f };
+   vec3f_t gravity = { 0.0f, 0.0f, -9.81f };
+
+   struct physics_world_t* phys = NULL;
+   if (physics_world_create(&phys, &worldMin, &worldMax, draw_line) != 0)
+   {
+      LOGE("Unable to create physworld");
+      return;
+   }
+
+   world_t* world = NULL;
+   scene_t* scene = NULL;
+   body_t* bodies = NULL;
+   struct physics_rigid_body_t** scene_bodies = NULL;
+
+   long l = 0;
+   if (world_file != NULL)
+   {
+      if (world_load_from_file(&world, world_file) != 0)
+      {
+         physics_world_delete(phys);
+         return;
+      }
+
+      scene = (scene_name != NULL) ? world_get_scene(world, atom_find(scene_name)) : &world->scenes[0];
+      if (scene == NULL)
+      {
+         LOGE("Unable to find scene '%s'", scene_name);
+         world_free(world);
+         physics_world_delete(phys);
+         return;
+      }
+
+      gravity = scene->gravity;
+      scene_bodies = (struct physics_rigid_body_t**)malloc(scene->nnodes * sizeof(struct physics_rigid_body_t*));
+      memset(scene_bodies, 0, scene->nnodes * sizeof(struct physics_rigid_body_t*));
+
+      nbodies = 0;
+      struct node_t* node = &scene->nodes[0];
+      for (l = 0; l < scene->nnodes; ++l, ++node)
+      {
+         if (node->phys.type == PHYS_NOCOLLISION)
+            continue;
+
+         struct mesh_t* mesh = world_get_mesh(world, node->data);
+         if (physics_rigid_body_create(&scene_bodies[l], &node->phys, mesh, node_transform_setter, node_transform_getter, node) == 0)
+         {
+            physics_world_add_rigid_body(phys, scene_bodies[l]);
+            ++nbodies;
+         }
+      }
+   }
+   else
+   {
+      bodies = spawn_bodies(phys, nbodies);
+   }
+
+   physics_world_set_gravity(phys, &gravity);
+
+   long* times = (long*)malloc(nframes * sizeof(long));
+   long total = 0;
+   long max_pairs = 0;
+   long max_contacts = 0;
+   long nbegin = 0;
+   long nend = 0;
+
+   long allocs_before = nallocs;
+
+   physics_stats_t stats;
+   for (l = 0; l < nframes; ++l)
+   {
+      timestamp_t start;
+      timestamp_set(&start);
+      physics_world_step(phys, dt, 1, dt);
+      times[l] = timestamp_elapsed_us(&start);
+      total += times[l];
+
+      const physics_contact_event_t* events = NULL;
+      long nevents = physics_world_get_contact_events(phys, &events);
+      long e = 0;
+      for (e = 0; e < nevents; ++e)
+      {
+         if (events[e].type == CONTACT_BEGIN) ++nbegin;
+         else if (events[e].type == CONTACT_END) ++nend;
+      }
+
+      physics_world_get_stats(phys, &stats);
+      if (stats.npairs > max_pairs) max_pairs = stats.npairs;
+      if (stats.ncontacts > max_contacts) max_contacts = stats.ncontacts;
+   }
+
+   qsort(times, nframes, sizeof(long), compare_longs);
+
+   LOGI("bodies %6ld frames %5ld | step us: mean %7ld p50 %7ld p90 %7ld p99 %7ld max %7ld | pairs %6ld (max %6ld) contacts %6ld (max %6ld) | begin %6ld end %6ld | allocs/frame %.2f",
+        nbodies, nframes,
+        total / nframes,
+        percentile(times, nframes, 50), percentile(times, nframes, 90), percentile(times, nframes, 99), times[nframes - 1],
+        stats.npairs, max_pairs, stats.ncontacts, max_contacts,
+        nbegin, nend,
+        (float)(nallocs - allocs_before) / (float)nframes);
+
+   free(times);
+
+   if (profile)
+   {
+      physics_profile_t last_step;
+      if (physics_world_get_profile(phys, &last_step) == 0)
+      {
+         physics_profile_show(&last_step);
+      }
+   }
+
+   if (scene_bodies != NULL)
+   {
+      for (l = 0; l < scene->nnodes; ++l)
+      {
+         if (scene_bodies[l] != NULL)
+         {
+            physics_world_remove_rigid_body(phys, scene_bodies[l]);
+            physics_rigid_body_delete(scene_bodies[l]);
+         }
+      }
+      free(scene_bodies);
+   }
+
+   if (bodies != NULL)
+   {
+      for (l = 0; l <= nbodies; ++l)
+      {
+         physics_world_remove_rigid_body(phys, bodies[l].body);
+         physics_rigid_body_delete(bodies[l].body);
+      }
+      free(bodies);
+   }
+
+   physics_world_delete(phys);
+
+   if (world != NULL)
+   {
+      world_free(world);
+   }
+}
+
+int main(int argc, char** argv)
+{
+   static struct option long_options[] =
+   {
+      {"world",   required_argument, 0, 'w'},
+      {"scene",   required_argument, 0, 's'},
+      {"bodies",  required_argument, 0, 'b'},
+      {"frames",  required_argument, 0, 'f'},
+      {"dt",      required_argument, 0, 'd'},
+      {"profile", no_argument,       0, 'p'},
+      {0, 0, 0, 0}
+   };
+
+   int option_index = 0;
+   int c = 0;
+
+   const char* world_file = NULL;
+   const char* scene_name = NULL;
+   long counts[MAX_RUNS] = { 10, 100, 1000, 10000 };
+   long nruns = 4;
+   long nframes = 600;
+   float dt = 1.0f / 60.0f;
+   int profile = 0;
+
+   while (1)
+   {
+      c = getopt_long (argc, argv, "w:s:b:f:d:p", long_options, &option_index);
+      if (c == -1)
+      {
+         break;
+      }
+
+      switch (c)
+      {
+         case 'w':
+            world_file = optarg;
+            break;
+         case 's':
+            scene_name = optarg;
+            break;
+         case 'b':
+         {
+            // comma separated list of body counts, one run per count
+            char* p = optarg;
+            nruns = 0;
+            while (*p != '\0' && nruns < MAX_RUNS)
+            {
+               counts[nruns++] = strtol(p, &p, 10);
+               if (*p == ',') ++p;
+            }
+            break;
+         }
+         case 'f':
+            nframes = strtol(optarg, NULL, 10);
+            break;
+         case 'd':
+            dt = atof(optarg);
+            break;
+         case 'p':
+            profile = 1;
+            break;
+      }
+   }
+
+   if (nframes <= 0)
+   {
+      LOGE("You should specify positive number of frames");
+      return -1;
+   }
+
+   stream_init("");
+   physics_set_alloc_hooks(counting_alloc, counting_free);
+
+   if (world_file != NULL)
+   {
+      run(world_file, scene_name, 0, nframes, dt, profile);
+      return 0;
+   }
+
+   long l = 0;
+   for (l = 0; l < nruns; ++l)
+   {
+      run(NULL, NULL, counts[l], nframes, dt, profile);
+   }
+
+   return 0;
+}
@@ -0,0 +1,319 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <common.h>
+#include <world.h>
+#include <game.h>
+#include <stream.h>
+#include <frustum.h>
+#include <occlusion.h>
+#include <nodes.h>
+#include <hierarchy.h>
+#include <pvs.h>
+
+game_t* game = NULL;
+
+// Bakes potentially visible sets into a world file. The bounds of every scene
+// are split into cells and each cell is looked at from its corners and its
+// center, six cube faces per sample, with the occluders rasterized by the
+// occlusion module. A node is visible from the cell if its box passes the
+// frustum and the depth test of any face. Dynamic nodes are left out, the
+// game never culls them by the sets. The sets are appended to the data of
+// the file and the scenes are patched to point at them.
+
+#define PVS_BAKE_SIZE 128
+#define PVS_BAKE_ZNEAR 0.05f
+#define PVS_BAKE_ZFAR 1000.0f
+
+typedef struct bake_t
+{
+   const nodes_t* nodes;
+   occlusion_t* occlusion;
+   mat4f_t proj;
+   unsigned char* bits;
+} bake_t;
+
+static void bake_face(bake_t* bake, const vec3f_t* eye, const vec3f_t* dir, const vec3f_t* up)
+{
+   const nodes_t* nodes = bake->nodes;
+   const unsigned char* flags = nodes->flags;
+
+   vec3f_t at;
+   vec3_add(&at, eye, dir);
+   mat4f_t view;
+   mat4_set_lookat(&view, eye, &at, up);
+
+   frustum_t frustum;
+   frustum_set(&frustum, &bake->proj, &view);
+
+   occlusion_begin(bake->occlusion, &bake->proj, &view);
+   long l = 0;
+   for (l = 0; l < nodes->nnodes; ++l)
+   {
+      if ((flags[l] & NODE_OCCLUDER) && frustum_intersect_aabb(&frustum, &nodes->world_bounds[l]) >= 0)
+      {
+         occlusion_draw_mesh(bake->occlusion, (const mesh_t*)nodes->data[l], &nodes->hierarchy->world[l]);
+      }
+   }
+
+   for (l = 0; l < nodes->nnodes; ++l)
+   {
+      if ((flags[l] & NODE_DYNAMIC) || (bake->bits[l >> 3] & (1 << (l & 7))))
+         continue;
+
+      // occluders are tested too, a wall hidden by another one is culled
+      if (frustum_intersect_aabb(&frustum, &nodes->world_bounds[l]) >= 0 && occlusion_test_aabb(bake->occlusion, &nodes->world_bounds[l]))
+      {
+         bake->bits[l >> 3] |= (1 << (l & 7));
+      }
+   }
+}
+
+static void bake_sample(bake_t* bake, const vec3f_t* eye)
+{
+   static const vec3f_t dirs[6] =
+   {
+      { 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f },
+      { 0.0f, 1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f },
+      { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f },
+   };
+   static const vec3f_t ups[6] =
+   {
+      { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f },
+      { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f },
+      { 0.0f, 1.0f, 0.0f }, { 0.0f, 1.0f, 0.0f },
+   };
+
+   int i = 0;
+   for (i = 0; i < 6; ++i)
+   {
+      bake_face(bake, eye, &dirs[i], &ups[i]);
+   }
+}
+
+// returns the blob of the sets of a scene laid out as in the file, with
+// offsets relative to its start
+static char* bake_scene(long* psize, const nodes_t* nodes, float cell_size)
+{
+   if (nodes->nnodes == 0)
+   {
+      return NULL;
+   }
+
+   pvs_t pvs;
+   memset(&pvs, 0, sizeof(pvs));
+   pvs.nnodes = nodes->nnodes;
+
+   bbox_reset(&pvs.bounds);
+   long l = 0;
+   for (l = 0; l < nodes->nnodes; ++l)
+   {
+      bbox_inflate(&pvs.bounds, &nodes->world_bounds[l].min);
+      bbox_inflate(&pvs.bounds, &nodes->world_bounds[l].max);
+   }
+
+   const float* min = &pvs.bounds.min.x;
+   const float* max = &pvs.bounds.max.x;
+   int i = 0;
+   for (i = 0; i < 3; ++i)
+   {
+      pvs.ncells[i] = (unsigned long)ceilf((max[i] - min[i]) / cell_size);
+      if (pvs.ncells[i] == 0)
+      {
+         pvs.ncells[i] = 1;
+      }
+   }
+
+   long ncells = pvs_cell_count(&pvs);
+   long nbytes = (nodes->nnodes + 7) / 8;
+
+   bake_t bake;
+   bake.nodes = nodes;
+   bake.bits = (unsigned char*)malloc(nbytes);
+   mat4_set_perspective(&bake.proj, M_PI / 2.0f, 1.0f, PVS_BAKE_ZNEAR, PVS_BAKE_ZFAR);
+   if (occlusion_create(&bake.occlusion, PVS_BAKE_SIZE, PVS_BAKE_SIZE) != 0)
+   {
+      free(bake.bits);
+      return NULL;
+   }
+
+   // worst case of every cell compressing badly
+   long header_size = (sizeof(pvs_t) + 7) & ~7;
+   long offsets_size = (ncells + 1) * sizeof(unsigned long);
+   char* blob = (char*)malloc(header_size + offsets_size + ncells * (nbytes + nbytes / 2 + 2));
+   unsigned long* offsets = (unsigned long*)(blob + header_size);
+   unsigned char* data = (unsigned char*)(blob + header_size + offsets_size);
+
+   LOGI("Baking %lux%lux%lu cells of %ld nodes", pvs.ncells[0], pvs.ncells[1], pvs.ncells[2], nodes->nnodes);
+
+   long nvisible = 0;
+   long cell = 0;
+   for (cell = 0; cell < ncells; ++cell)
+   {
+      // same order as pvs_find_cell, z major
+      long c[3];
+      c[0] = cell % pvs.ncells[0];
+      c[1] = (cell / pvs.ncells[0]) % pvs.ncells[1];
+      c[2] = cell / (pvs.ncells[0] * pvs.ncells[1]);
+
+      float lo[3];
+      float hi[3];
+      for (i = 0; i < 3; ++i)
+      {
+         float size = (max[i] - min[i]) / pvs.ncells[i];
+         lo[i] = min[i] + c[i] * size;
+         hi[i] = lo[i] + size;
+      }
+
+      memset(bake.bits, 0, nbytes);
+
+      int s = 0;
+      for (s = 0; s < 8; ++s)
+      {
+         vec3f_t eye = { (s & 1) ? hi[0] : lo[0], (s & 2) ? hi[1] : lo[1], (s & 4) ? hi[2] : lo[2] };
+         bake_sample(&bake, &eye);
+      }
+      vec3f_t center = { (lo[0] + hi[0]) * 0.5f, (lo[1] + hi[1]) * 0.5f, (lo[2] + hi[2]) * 0.5f };
+      bake_sample(&bake, &center);
+
+      for (l = 0; l < nodes->nnodes; ++l)
+      {
+         nvisible += (bake.bits[l >> 3] >> (l & 7)) & 1;
+      }
+
+      offsets[cell] = data - (unsigned char*)(blob + header_size + offsets_size);
+      data += pvs_compress(data, bake.bits, nbytes);
+   }
+   offsets[ncells] = data - (unsigned char*)(blob + header_size + offsets_size);
+
+   LOGI("Visible %.1f of %ld nodes per cell, %lu bytes", (float)nvisible / ncells, nodes->nnodes, offsets[ncells]);
+
+   pvs.offsets = (unsigned long*)header_size;
+   pvs.data = (unsigned char*)(header_size + offsets_size);
+   memcpy(blob, &pvs, sizeof(pvs));
+
+   occlusion_free(bake.occlusion);
+   free(bake.bits);
+
+   *psize = header_size + offsets_size + offsets[ncells];
+   return blob;
+}
+
+static int bake_world(const char* input, const char* output, const char* scene_name, float cell_size)
+{
+   char* image = NULL;
+   long image_size = 0;
+   if (world_read_image(&image, &image_size, input) != 0)
+   {
+      return -1;
+   }
+
+   world_t* world = NULL;
+   if (world_load_from_image(&world, image) != 0)
+   {
+      free(image);
+      return -1;
+   }
+
+   // the image keeps the data as the file stores it, scene i of the
+   // relocated world is scene i of the image
+   long data_offset = ((const struct file_header_t*)image)->data_offset;
+   long scenes_offset = (long)((const world_t*)(image + data_offset))->scenes;
+
+   long l = 0;
+   for (l = 0; l < world->nscenes; ++l)
+   {
+      scene_t* scene = &world->scenes[l];
+      if (scene_name != NULL && strcmp(atom_name(scene->name), scene_name) != 0)
+         continue;
+
+      nodes_t* nodes = NULL;
+      if (nodes_create(&nodes, world, scene) != 0)
+      {
+         LOGE("Unable to set up scene '%s'", atom_name(scene->name));
+         continue;
+      }
+
+      LOGI("Scene '%s'", atom_name(scene->name));
+
+      long size = 0;
+      char* blob = bake_scene(&size, nodes, cell_size);
+      nodes_free(nodes);
+      if (blob == NULL)
+         continue;
+
+      long offset = world_append_blob(&image, &image_size, blob, size);
+      free(blob);
+
+      // a scene baked before keeps its old blob in the file unreferenced
+      scene_t* raw_scene = (scene_t*)(image + data_offset + scenes_offset) + l;
+      raw_scene->pvs = (struct pvs_t*)offset;
+   }
+
+   world_free(world);
+
+   int ret = world_write_image(image, image_size, output);
+   free(image);
+   return ret;
+}
+
+int main(int argc, char** argv)
+{
+   static struct option long_options[] =
+   {
+      {"output", required_argument, 0, 'o'},
+      {"scene",  required_argument, 0, 's'},
+      {"cell",   required_argument, 0, 'c'},
+      {0, 0, 0, 0}
+   };
+
+   int option_index = 0;
+   int c = 0;
+
+   const char* output = NULL;
+   const char* scene_name = NULL;
+   float cell_size = 4.0f;
+
+   while (1)
+   {
+      c = getopt_long (argc, argv, "o:s:c:", long_options, &option_index);
+      if (c == -1)
+      {
+         break;
+      }
+
+      switch (c)
+      {
+         case 'o':
+            output = optarg;
+            break;
+         case 's':
+            scene_name = optarg;
+            break;
+         case 'c':
+            cell_size = strtof(optarg, NULL);
+            break;
+      }
+   }
+
+   if (optind >= argc)
+   {
+      LOGE("Usage: pvs_bake [-o output] [-s scene] [-c cell size] world");
+      return -1;
+   }
+
+   if (cell_size <= 0.0f)
+   {
+      LOGE("You should specify positive cell size");
+      return -1;
+   }
+
+   const char* input = argv[optind];
+   if (output == NULL)
+   {
+      output = input;
+   }
+
+   stream_init("");
+
+   return bake_world(input, output, scene_name, cell_size) == 0 ? 0 : -1;
+}